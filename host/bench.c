@@ -0,0 +1,1132 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uORB/uORB.h>
+
+#include "../packets/decoder.h"
+#include "../packets/fec.h"
+#include "../packets/fixedpoint.h"
+#include "../packets/frame.h"
+#include "../packets/lz.h"
+#include "../packets/packets.h"
+#include "../telemetry/packager.h"
+#include "../telemetry/syncro.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Array length helper */
+
+#define array_len(arr) sizeof(arr) / sizeof((arr)[0])
+
+/* Number of distinct input samples cycled through by each benchmark */
+
+#define NSAMPLES 256
+
+/* Default number of operations per benchmark */
+
+#define DEFAULT_ITERATIONS 1000000
+
+/* Packets published through syncro for the latency benchmark, and the time
+ * between them.
+ */
+
+#define LATENCY_PACKETS 20000
+#define LATENCY_PERIOD_NS 50000
+
+/* Bytes of packets compressed together by the compression benchmark, the
+ * default log compression group size
+ */
+
+#define LZ_GROUP 1024
+
+/* Most packets and bytes of packets in the compression corpus */
+
+#define CORPUS_MAXPACKETS 16384
+#define CORPUS_MAXLEN (CORPUS_MAXPACKETS * (CONFIG_PYGMY_PACKET_MAXLEN + 2))
+
+/* Distinct radio packets protected by the parity benchmarks, one for every
+ * packet number
+ */
+
+#define FEC_NPACKETS 256
+
+/* Radio packets sent through the lossy channel of each loss simulation, and
+ * the mean length of a burst of losses in the bursty channel
+ */
+
+#define FEC_LOSS_PACKETS 50000
+#define FEC_BURST_LEN 4
+
+/* Most interleaved parity groups simulated */
+
+#define FEC_DEPTH_MAX 4
+
+/* Keeps the compiler from optimizing away benchmark results */
+
+#define clobber() __asm__ volatile("" : : : "memory")
+
+/* Times `iterations` runs of `body` and reports them as benchmark `name`.
+ * `i` is the iteration number inside `body`.
+ */
+
+#define bench_loop(name, iterations, body)                                   \
+  do                                                                         \
+    {                                                                        \
+      uint64_t start = now_ns();                                             \
+      for (unsigned long i = 0; i < (iterations); i++)                       \
+        {                                                                    \
+          body;                                                              \
+          clobber();                                                         \
+        }                                                                    \
+      report((name), (iterations), now_ns() - start);                        \
+    }                                                                        \
+  while (0)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct sensor_baro baro[NSAMPLES];
+static struct sensor_accel accel[NSAMPLES];
+static struct sensor_gyro gyro[NSAMPLES];
+static struct sensor_mag mag[NSAMPLES];
+static struct sensor_gnss gnss[NSAMPLES];
+
+static volatile int16_t converted;
+static uint8_t block_buf[32];
+static uint8_t pkt_buf[CONFIG_PYGMY_PACKET_MAXLEN];
+static struct packet_s pkt;
+static struct packet_hdr_s hdr;
+static struct packager_s pkgr;
+
+static FILE *out;
+static int nresults;
+
+static syncro_t syncro;
+static uint64_t latencies[LATENCY_PACKETS];
+
+/* Packets the compression benchmark compresses, grouped the way the log
+ * thread groups them: back to back, each preceded by its length
+ */
+
+static uint8_t corpus[CORPUS_MAXLEN];
+static size_t corpus_len;
+static unsigned long corpus_packets;
+static size_t groups[CORPUS_MAXPACKETS + 1]; /* Start of each group */
+static unsigned long ngroups;
+
+/* Radio packets for the parity benchmarks, and the packets as they are
+ * sent: data packets with parity packets between them
+ */
+
+static uint8_t fec_data[FEC_NPACKETS][CONFIG_PYGMY_PACKET_MAXLEN];
+static struct packet_s fec_pkts[FEC_NPACKETS];
+static uint8_t fec_air[2 * FEC_NPACKETS][CONFIG_PYGMY_PACKET_MAXLEN];
+static struct packet_view_s fec_views[2 * FEC_NPACKETS];
+static unsigned long fec_nair;
+
+static struct fec_group_s fec_groups[FEC_DEPTH_MAX];
+static struct fec_enc_s fec_enc;
+static struct fec_dec_s fec_dec;
+static uint8_t parity_buf[CONFIG_PYGMY_PACKET_MAXLEN];
+static uint8_t lost_buf[CONFIG_PYGMY_PACKET_MAXLEN];
+
+static uint16_t lz_table[LZ_TABLE_LEN];
+static uint8_t lz_out[LZ_BOUND(LZ_GROUP)];
+static uint8_t lz_raw[LZ_GROUP];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a;
+  uint64_t y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/****************************************************************************
+ * Name: report
+ *
+ * Description:
+ *   Emits one benchmark result as a JSON object.
+ ****************************************************************************/
+
+static void report(const char *name, unsigned long iterations,
+                   uint64_t elapsed_ns)
+{
+  double ns = (double)elapsed_ns / iterations;
+
+  fprintf(out,
+          "%s\n    {\"name\": \"%s\", \"iterations\": %lu, "
+          "\"ns_per_op\": %.2f, \"ops_per_s\": %.0f}",
+          nresults++ ? "," : "", name, iterations, ns, 1e9 / ns);
+}
+
+/****************************************************************************
+ * Name: samples_init
+ *
+ * Description:
+ *   Fills the input sample tables with plausible, varying sensor readings.
+ ****************************************************************************/
+
+static void samples_init(void)
+{
+  srand(1);
+
+  for (int i = 0; i < NSAMPLES; i++)
+    {
+      float r = (float)rand() / RAND_MAX;
+
+      baro[i].timestamp = i * 40000ull;
+      baro[i].pressure = 700.0f + 320.0f * r;
+      baro[i].temperature = 15.0f + 10.0f * r;
+
+      accel[i].timestamp = i * 20000ull;
+      accel[i].x = 2.0f * r - 1.0f;
+      accel[i].y = 1.0f - 2.0f * r;
+      accel[i].z = 9.81f + 150.0f * r;
+
+      gyro[i].timestamp = i * 20000ull;
+      gyro[i].x = 0.5f * r;
+      gyro[i].y = -0.5f * r;
+      gyro[i].z = 20.0f * r;
+
+      mag[i].timestamp = i * 20000ull;
+      mag[i].x = 20.0f + r;
+      mag[i].y = r;
+      mag[i].z = -40.0f - r;
+
+      gnss[i].timestamp = i * 100000ull;
+      gnss[i].latitude = 45.4215 + r * 1e-3;
+      gnss[i].longitude = -75.6972 - r * 1e-3;
+    }
+}
+
+/****************************************************************************
+ * Name: bench_blocks
+ *
+ * Description:
+ *   Measures the cost of converting a sensor sample into each kind of block.
+ ****************************************************************************/
+
+static void bench_blocks(unsigned long n)
+{
+  bench_loop("block_init_pressure", n,
+             block_init_pressure((void *)block_buf, &baro[i % NSAMPLES]));
+  bench_loop("block_init_temp", n,
+             block_init_temp((void *)block_buf, &baro[i % NSAMPLES]));
+  bench_loop("block_init_alt", n,
+             block_init_alt((void *)block_buf, &baro[i % NSAMPLES]));
+  bench_loop("block_init_accel", n,
+             block_init_accel((void *)block_buf, &accel[i % NSAMPLES]));
+  bench_loop("block_init_gyro", n,
+             block_init_gyro((void *)block_buf, &gyro[i % NSAMPLES]));
+  bench_loop("block_init_mag", n,
+             block_init_mag((void *)block_buf, &mag[i % NSAMPLES]));
+  bench_loop("block_init_volt", n,
+             block_init_volt((void *)block_buf, 3700 + i % NSAMPLES));
+  bench_loop("block_init_coord", n,
+             block_init_coord((void *)block_buf, &gnss[i % NSAMPLES]));
+}
+
+/****************************************************************************
+ * Name: bench_convert
+ *
+ * Description:
+ *   Compares the floating point and integer kernels used to convert IMU
+ *   readings to packet units. On the host the FPU makes floating point
+ *   cheap; the integer kernel is for cores where floats are emulated.
+ ****************************************************************************/
+
+static void bench_convert(unsigned long n)
+{
+  bench_loop("convert16/float", n,
+             converted = float_convert16(accel[i % NSAMPLES].z, 100.0f));
+  bench_loop("convert16/fixed", n,
+             converted = fixed_convert16(accel[i % NSAMPLES].z,
+                                         fixed_scale(100.0f)));
+}
+
+/****************************************************************************
+ * Name: packet_start
+ *
+ * Description:
+ *   Resets the benchmark packet to just a header, ready for blocks.
+ ****************************************************************************/
+
+static void packet_start(void)
+{
+  packet_reset(&pkt);
+  packet_push(&pkt, &hdr, sizeof(hdr));
+}
+
+/****************************************************************************
+ * Name: bench_push
+ *
+ * Description:
+ *   Measures the cost of appending raw data and blocks to a packet,
+ *   including resetting the packet whenever it fills up.
+ ****************************************************************************/
+
+static void bench_push(unsigned long n)
+{
+  packet_init(&pkt, pkt_buf);
+
+  bench_loop("packet_push/header", n, {
+    if (packet_push(&pkt, block_buf, sizeof(struct packet_hdr_s)))
+      {
+        packet_reset(&pkt);
+      }
+  });
+
+  packet_start();
+  bench_loop("packet_push_block/press", n, {
+    if (packet_push_block(&pkt, PACKET_PRESS, i, block_buf, sizeof(press_p)))
+      {
+        packet_start();
+      }
+  });
+
+  packet_start();
+  bench_loop("packet_push_block/accel", n, {
+    if (packet_push_block(&pkt, PACKET_ACCEL, i, block_buf, sizeof(accel_p)))
+      {
+        packet_start();
+      }
+  });
+
+  packet_start();
+  bench_loop("packet_push_block/coord", n, {
+    if (packet_push_block(&pkt, PACKET_COORD, i, block_buf, sizeof(coord_p)))
+      {
+        packet_start();
+      }
+  });
+}
+
+/****************************************************************************
+ * Name: bench_frame
+ *
+ * Description:
+ *   Measures framing a full packet for the log, which is dominated by its
+ *   CRC, and verifying it again when read back.
+ ****************************************************************************/
+
+static void bench_frame(unsigned long n)
+{
+  static uint8_t frame_buf[sizeof(struct frame_hdr_s) +
+                           CONFIG_PYGMY_PACKET_MAXLEN];
+  struct frame_view_s frame;
+  uint8_t *payload = &frame_buf[sizeof(struct frame_hdr_s)];
+
+  for (int i = 0; i < CONFIG_PYGMY_PACKET_MAXLEN; i++)
+    {
+      payload[i] = rand();
+    }
+
+  bench_loop("frame_init/packet", n,
+             frame_init((void *)frame_buf, FRAME_PACKET, payload,
+                        CONFIG_PYGMY_PACKET_MAXLEN - i % 8));
+
+  frame_init((void *)frame_buf, FRAME_PACKET, payload,
+             CONFIG_PYGMY_PACKET_MAXLEN);
+  bench_loop("frame_parse/packet", n,
+             frame_parse(frame_buf, sizeof(frame_buf), &frame));
+}
+
+/****************************************************************************
+ * Name: bench_package
+ *
+ * Description:
+ *   Measures full packet assembly through `package_uorb`, with the sensor
+ *   mix of the default Kconfig rates (one barometer sample for every two of
+ *   each IMU sensor).
+ ****************************************************************************/
+
+static void bench_package(unsigned long n)
+{
+  static const enum sensor_kind mix[] = {
+      SENSOR_BARO, SENSOR_ACCEL, SENSOR_GYRO, SENSOR_MAG,
+      SENSOR_ACCEL, SENSOR_GYRO, SENSOR_MAG,
+  };
+
+  unsigned long packets = 0;
+  unsigned long samples = 0;
+  uint64_t start;
+  uint64_t elapsed;
+  void *data;
+  int err;
+
+  package_init(&pkgr, PACKAGE_LOG);
+  package_uorb(&pkgr, &pkt, SENSOR_GPS, &gnss[0], block_buf);
+  packet_init(&pkt, pkt_buf);
+
+  start = now_ns();
+  while (samples < n)
+    {
+      packet_start();
+      package_coord(&pkgr, &pkt, block_buf);
+
+      do
+        {
+          enum sensor_kind sensor = mix[samples % array_len(mix)];
+
+          switch (sensor)
+            {
+            case SENSOR_BARO:
+              data = &baro[samples % NSAMPLES];
+              break;
+            case SENSOR_ACCEL:
+              data = &accel[samples % NSAMPLES];
+              break;
+            case SENSOR_GYRO:
+              data = &gyro[samples % NSAMPLES];
+              break;
+            default:
+              data = &mag[samples % NSAMPLES];
+              break;
+            }
+
+          err = package_uorb(&pkgr, &pkt, sensor, data, block_buf);
+          samples++;
+          clobber();
+        }
+      while (err != ENOMEM);
+
+      packets++;
+    }
+
+  elapsed = now_ns() - start;
+  report("package_uorb/sample", samples, elapsed);
+  report("package_uorb/packet", packets, elapsed);
+}
+
+/****************************************************************************
+ * Name: consumer
+ *
+ * Description:
+ *   Consumes packets from syncro and records how long after publishing each
+ *   one was received. The publish time is stored at the start of the packet.
+ ****************************************************************************/
+
+static void *consumer(void *arg)
+{
+  uint8_t contents[CONFIG_PYGMY_PACKET_MAXLEN];
+  struct packet_s local = {.contents = contents, .len = 0};
+  uint64_t published;
+  uint32_t seq;
+
+  (void)arg;
+
+  for (;;)
+    {
+      syncro_consume(&syncro, SYNCRO_LOGGER, &local);
+
+      memcpy(&published, contents, sizeof(published));
+      memcpy(&seq, contents + sizeof(published), sizeof(seq));
+      latencies[seq] = now_ns() - published;
+
+      if (seq == LATENCY_PACKETS - 1)
+        {
+          return NULL;
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: bench_latency
+ *
+ * Description:
+ *   Measures the time from `syncro_publish` until the logging consumer has a
+ *   copy of a full size packet, with the consumer usually asleep waiting for
+ *   it as in flight.
+ ****************************************************************************/
+
+static void bench_latency(void)
+{
+  pthread_t tid;
+  struct packet_s *shared;
+  struct timespec next;
+  uint64_t published;
+  uint64_t total = 0;
+  unsigned long received = 0;
+
+  memset(latencies, 0, sizeof(latencies));
+  syncro_init(&syncro);
+  pthread_create(&tid, NULL, consumer, NULL);
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+  for (uint32_t seq = 0; seq < LATENCY_PACKETS; seq++)
+    {
+      shared = syncro_claim(&syncro);
+      memset(shared->contents, 0, CONFIG_PYGMY_PACKET_MAXLEN);
+      shared->len = CONFIG_PYGMY_PACKET_MAXLEN;
+
+      published = now_ns();
+      memcpy(shared->contents, &published, sizeof(published));
+      memcpy(shared->contents + sizeof(published), &seq, sizeof(seq));
+      syncro_publish(&syncro);
+
+      next.tv_nsec += LATENCY_PERIOD_NS;
+      if (next.tv_nsec >= 1000000000L)
+        {
+          next.tv_nsec -= 1000000000L;
+          next.tv_sec++;
+        }
+
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+  pthread_join(tid, NULL);
+
+  /* Packets the consumer dropped have no latency recorded */
+
+  for (int i = 0; i < LATENCY_PACKETS; i++)
+    {
+      if (latencies[i] != 0)
+        {
+          latencies[received++] = latencies[i];
+          total += latencies[i];
+        }
+    }
+
+  qsort(latencies, received, sizeof(latencies[0]), cmp_u64);
+
+  fprintf(out,
+          ",\n    {\"name\": \"syncro/publish_to_consume\", "
+          "\"samples\": %lu, \"dropped\": %u, \"mean_ns\": %.0f, "
+          "\"p50_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu}",
+          received, syncro_drops(&syncro, SYNCRO_LOGGER),
+          (double)total / received,
+          (unsigned long long)latencies[received / 2],
+          (unsigned long long)latencies[received * 99 / 100],
+          (unsigned long long)latencies[received - 1]);
+}
+
+/****************************************************************************
+ * Name: corpus_add
+ *
+ * Description:
+ *   Adds a packet to the compression corpus, starting a new group if it
+ *   doesn't fit in the current one.
+ *
+ * Returns:
+ *   0 on success, ENOMEM if the corpus is full.
+ ****************************************************************************/
+
+static int corpus_add(const uint8_t *contents, uint16_t len)
+{
+  if (corpus_packets == CORPUS_MAXPACKETS ||
+      corpus_len + sizeof(len) + len > sizeof(corpus))
+    {
+      return ENOMEM;
+    }
+
+  if (ngroups == 0 ||
+      corpus_len + sizeof(len) + len - groups[ngroups - 1] > LZ_GROUP)
+    {
+      groups[ngroups++] = corpus_len;
+    }
+
+  memcpy(&corpus[corpus_len], &len, sizeof(len));
+  memcpy(&corpus[corpus_len + sizeof(len)], contents, len);
+  corpus_len += sizeof(len) + len;
+  corpus_packets++;
+  groups[ngroups] = corpus_len;
+  return 0;
+}
+
+/****************************************************************************
+ * Name: corpus_load
+ *
+ * Description:
+ *   Fills the compression corpus with the packets of a recorded log file or
+ *   log segment. Compressed frames are decompressed back into packets.
+ *
+ * Returns:
+ *   0 on success, errno error code on failure
+ ****************************************************************************/
+
+static int corpus_load(const char *path)
+{
+  static uint8_t file[CORPUS_MAXLEN * 2];
+  static uint8_t raw[LZ_INPUT_MAX];
+  FILE *f;
+  size_t len;
+  size_t start = 0;
+  size_t rawlen;
+  uint16_t pktlen;
+  struct logseg_hdr_s seg;
+  struct frame_iter_s frames;
+  struct frame_view_s frame;
+  struct frame_lz_s lz;
+
+  f = fopen(path, "rb");
+  if (f == NULL)
+    {
+      fprintf(stderr, "Couldn't open '%s': %d\n", path, errno);
+      return errno;
+    }
+
+  len = fread(file, 1, sizeof(file), f);
+  fclose(f);
+
+  if (logseg_parse(file, len, &seg) == 0)
+    {
+      start = seg.hdrlen;
+    }
+
+  frame_iter_init(&frames, &file[start], len - start);
+  while (frame_iter_next(&frames, &frame) == 0)
+    {
+      if (frame.type == FRAME_PACKET)
+        {
+          if (corpus_add(frame.payload, frame.len)) break;
+          continue;
+        }
+
+      if (frame.type != FRAME_LZ || frame.len < sizeof(lz) ||
+          lz_decompress(frame.payload + sizeof(lz), frame.len - sizeof(lz),
+                        raw, sizeof(raw), &rawlen))
+        {
+          continue;
+        }
+
+      for (size_t pos = 0; pos + sizeof(pktlen) <= rawlen;
+           pos += sizeof(pktlen) + pktlen)
+        {
+          memcpy(&pktlen, &raw[pos], sizeof(pktlen));
+          if (pktlen > rawlen - pos - sizeof(pktlen) ||
+              corpus_add(&raw[pos + sizeof(pktlen)], pktlen))
+            {
+              break;
+            }
+        }
+    }
+
+  if (corpus_packets == 0)
+    {
+      fprintf(stderr, "No packets in '%s'.\n", path);
+      return EBADMSG;
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: corpus_generate
+ *
+ * Description:
+ *   Fills the compression corpus with packets assembled by `package_uorb`
+ *   from the synthetic samples, as in `bench_package`.
+ ****************************************************************************/
+
+static void corpus_generate(void)
+{
+  static const enum sensor_kind mix[] = {
+      SENSOR_BARO, SENSOR_ACCEL, SENSOR_GYRO, SENSOR_MAG,
+      SENSOR_ACCEL, SENSOR_GYRO, SENSOR_MAG,
+  };
+
+  unsigned long samples = 0;
+  void *data;
+  int err;
+
+  package_init(&pkgr, PACKAGE_LOG);
+  package_uorb(&pkgr, &pkt, SENSOR_GPS, &gnss[0], block_buf);
+  packet_init(&pkt, pkt_buf);
+
+  do
+    {
+      hdr.num++;
+      hdr.time = samples * 10;
+      packet_start();
+      package_coord(&pkgr, &pkt, block_buf);
+
+      do
+        {
+          enum sensor_kind sensor = mix[samples % array_len(mix)];
+
+          switch (sensor)
+            {
+            case SENSOR_BARO:
+              data = &baro[samples % NSAMPLES];
+              break;
+            case SENSOR_ACCEL:
+              data = &accel[samples % NSAMPLES];
+              break;
+            case SENSOR_GYRO:
+              data = &gyro[samples % NSAMPLES];
+              break;
+            default:
+              data = &mag[samples % NSAMPLES];
+              break;
+            }
+
+          err = package_uorb(&pkgr, &pkt, sensor, data, block_buf);
+          samples++;
+        }
+      while (err != ENOMEM);
+    }
+  while (corpus_add(pkt.contents, pkt.len) == 0);
+}
+
+/****************************************************************************
+ * Name: bench_lz
+ *
+ * Description:
+ *   Measures log compression: the time to compress and decompress a group
+ *   of packets, and how much smaller the log gets compared to logging every
+ *   packet in its own frame.
+ ****************************************************************************/
+
+static void bench_lz(unsigned long n)
+{
+  size_t frames_len = 0;
+  size_t lz_len = 0;
+  size_t rawlen;
+  size_t len;
+  uint64_t start;
+  uint64_t compress_ns;
+  uint64_t decompress_ns;
+  unsigned long iterations = n / 100 ? n / 100 : 1;
+
+  /* Sizes of the log with and without compression */
+
+  frames_len = corpus_len + corpus_packets * (sizeof(struct frame_hdr_s) -
+                                              sizeof(uint16_t));
+  for (unsigned long g = 0; g < ngroups; g++)
+    {
+      len = lz_compress(&corpus[groups[g]], groups[g + 1] - groups[g], lz_out,
+                        sizeof(lz_out), lz_table);
+      lz_len += sizeof(struct frame_hdr_s) + sizeof(struct frame_lz_s) + len;
+    }
+
+  start = now_ns();
+  for (unsigned long i = 0; i < iterations; i++)
+    {
+      unsigned long g = i % ngroups;
+      lz_compress(&corpus[groups[g]], groups[g + 1] - groups[g], lz_out,
+                  sizeof(lz_out), lz_table);
+      clobber();
+    }
+
+  compress_ns = now_ns() - start;
+  report("lz_compress/group", iterations, compress_ns);
+
+  /* Decompress groups compressed ahead of time, one after another */
+
+  start = 0;
+  decompress_ns = 0;
+  for (unsigned long i = 0; i < iterations; i++)
+    {
+      unsigned long g = i % ngroups;
+
+      len = lz_compress(&corpus[groups[g]], groups[g + 1] - groups[g], lz_out,
+                        sizeof(lz_out), lz_table);
+      start = now_ns();
+      lz_decompress(lz_out, len, lz_raw, sizeof(lz_raw), &rawlen);
+      clobber();
+      decompress_ns += now_ns() - start;
+    }
+
+  report("lz_decompress/group", iterations, decompress_ns);
+
+  fprintf(out,
+          ",\n    {\"name\": \"lz/ratio\", \"packets\": %lu, "
+          "\"groups\": %lu, \"group_len\": %d, \"log_bytes\": %zu, "
+          "\"compressed_bytes\": %zu, \"ratio\": %.3f, "
+          "\"compress_mb_per_s\": %.1f, \"decompress_mb_per_s\": %.1f}",
+          corpus_packets, ngroups, LZ_GROUP, frames_len, lz_len,
+          (double)frames_len / lz_len,
+          (double)corpus_len / ngroups * iterations * 1e3 / compress_ns,
+          (double)corpus_len / ngroups * iterations * 1e3 / decompress_ns);
+}
+
+/****************************************************************************
+ * Name: fec_generate
+ *
+ * Description:
+ *   Fills the parity benchmark packets with accelerometer blocks, from half
+ *   to all of the longest length parity can protect.
+ ****************************************************************************/
+
+static void fec_generate(void)
+{
+  size_t target;
+  unsigned long sample = 0;
+
+  for (int i = 0; i < FEC_NPACKETS; i++)
+    {
+      packet_init(&fec_pkts[i], fec_data[i]);
+      packet_push(&fec_pkts[i], &hdr, sizeof(hdr));
+
+      target = FEC_DATA_MAXLEN / 2 + rand() % (FEC_DATA_MAXLEN / 2 + 1);
+      while (fec_pkts[i].len + sizeof(struct block_hdr_s) +
+                 sizeof(accel_p) <=
+             target)
+        {
+          pkt_time_t time = block_init_accel(
+              (void *)block_buf, &accel[sample++ % NSAMPLES]);
+          packet_push_block(&fec_pkts[i], PACKET_ACCEL, time, block_buf,
+                            sizeof(accel_p));
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: bench_fec
+ *
+ * Description:
+ *   Measures radio parity: adding a packet to its group (building the
+ *   parity packet when the group is complete), and decoding received
+ *   packets, with and without one packet of every group to rebuild.
+ *   Groups are 8 packets, the default.
+ ****************************************************************************/
+
+static void bench_fec(unsigned long n)
+{
+  struct packet_s parity;
+  struct packet_s lost;
+  unsigned long nlost = 0;
+
+  packet_init(&parity, parity_buf);
+  packet_init(&lost, lost_buf);
+
+  fec_enc_init(&fec_enc, fec_groups, 1, 8);
+  bench_loop("fec_enc_push/packet", n, {
+    fec_enc_push(&fec_enc, &fec_pkts[i % FEC_NPACKETS]);
+    fec_enc_parity(&fec_enc, &parity);
+  });
+
+  /* Record one pass over the packets as it is sent */
+
+  fec_enc_init(&fec_enc, fec_groups, 1, 8);
+  fec_nair = 0;
+  for (int i = 0; i < FEC_NPACKETS; i++)
+    {
+      fec_enc_push(&fec_enc, &fec_pkts[i]);
+      memcpy(fec_air[fec_nair], fec_pkts[i].contents, fec_pkts[i].len);
+      packet_parse(fec_air[fec_nair], fec_pkts[i].len, &fec_views[fec_nair]);
+      fec_nair++;
+
+      if (fec_enc_parity(&fec_enc, &parity) == 0)
+        {
+          memcpy(fec_air[fec_nair], parity.contents, parity.len);
+          packet_parse(fec_air[fec_nair], parity.len, &fec_views[fec_nair]);
+          fec_nair++;
+        }
+    }
+
+  fec_dec_init(&fec_dec);
+  bench_loop("fec_dec_push/no_loss", n,
+             fec_dec_push(&fec_dec, &fec_views[i % fec_nair], &lost));
+
+  /* Leave out the first packet of every group: the one after a parity */
+
+  fec_dec_init(&fec_dec);
+  bench_loop("fec_dec_push/rebuild", n, {
+    unsigned long j = i % fec_nair;
+
+    if (j == 0 || !fec_is_parity(&fec_views[j - 1]))
+      {
+        nlost += fec_dec_push(&fec_dec, &fec_views[j], &lost) == 0;
+      }
+  });
+
+  if (nlost == 0)
+    {
+      fprintf(stderr, "No packets were rebuilt.\n");
+    }
+}
+
+/****************************************************************************
+ * Name: fec_channel
+ *
+ * Description:
+ *   Decides if the next packet through the simulated radio channel is lost.
+ *   The random channel loses each packet independently. The bursty channel
+ *   is a two state (Gilbert-Elliott) channel that loses every packet while
+ *   in its bad state, with bursts of `FEC_BURST_LEN` packets on average.
+ *
+ * Arguments:
+ *  bursty - Use the bursty channel
+ *  loss - The fraction of packets lost on average
+ *  rng - The channel's random number generator state
+ *  bad - The bursty channel's state
+ *
+ ****************************************************************************/
+
+static bool fec_channel(bool bursty, double loss, uint32_t *rng, bool *bad)
+{
+  double r;
+
+  /* xorshift32, so the channel is the same on every host */
+
+  *rng ^= *rng << 13;
+  *rng ^= *rng >> 17;
+  *rng ^= *rng << 5;
+  r = (double)*rng / UINT32_MAX;
+
+  if (!bursty)
+    {
+      return r < loss;
+    }
+
+  if (*bad)
+    {
+      *bad = r >= 1.0 / FEC_BURST_LEN;
+    }
+  else
+    {
+      *bad = r < loss / (1.0 - loss) / FEC_BURST_LEN;
+    }
+
+  return *bad;
+}
+
+/****************************************************************************
+ * Name: fec_simulate
+ *
+ * Description:
+ *   Sends radio packets through a lossy channel, with parity packets when
+ *   `count` is not 0, and reports the fraction of packets the ground ends
+ *   up with and the goodput: bytes of packets the ground ends up with per
+ *   byte sent. Rebuilt packets are checked against the packets sent.
+ *
+ * Arguments:
+ *  count - Packets in each parity group, 0 for no parity
+ *  depth - Interleaved parity groups
+ *  bursty - Use the bursty channel
+ *  loss - The fraction of packets lost on average
+ *
+ ****************************************************************************/
+
+static void fec_simulate(uint8_t count, uint8_t depth, bool bursty,
+                         double loss)
+{
+  struct packet_s parity;
+  struct packet_s lost;
+  struct packet_view_s view;
+  uint64_t sent_bytes = 0;
+  uint64_t got_bytes = 0;
+  unsigned long got = 0;
+  unsigned long rebuilt = 0;
+  unsigned long wrong = 0;
+  uint32_t rng = 2463534242u;
+  bool bad = false;
+  struct packet_s *data;
+
+  packet_init(&parity, parity_buf);
+  packet_init(&lost, lost_buf);
+
+  if (count > 0)
+    {
+      fec_enc_init(&fec_enc, fec_groups, depth, count);
+    }
+
+  fec_dec_init(&fec_dec);
+
+  for (unsigned long i = 0; i < FEC_LOSS_PACKETS; i++)
+    {
+      data = &fec_pkts[i % FEC_NPACKETS];
+      if (count > 0)
+        {
+          fec_enc_push(&fec_enc, data);
+        }
+
+      sent_bytes += data->len;
+      if (!fec_channel(bursty, loss, &rng, &bad))
+        {
+          got++;
+          got_bytes += data->len;
+          packet_parse(data->contents, data->len, &view);
+          fec_dec_push(&fec_dec, &view, &lost);
+        }
+
+      if (count == 0 || fec_enc_parity(&fec_enc, &parity))
+        {
+          continue;
+        }
+
+      sent_bytes += parity.len;
+      if (fec_channel(bursty, loss, &rng, &bad))
+        {
+          continue;
+        }
+
+      packet_parse(parity.contents, parity.len, &view);
+      if (fec_dec_push(&fec_dec, &view, &lost))
+        {
+          continue;
+        }
+
+      /* Packet numbers are packet indices, as 256 packets are cycled */
+
+      data = &fec_pkts[((struct packet_hdr_s *)lost.contents)->num];
+      if (lost.len != data->len ||
+          memcmp(lost.contents, data->contents, lost.len))
+        {
+          wrong++;
+          continue;
+        }
+
+      rebuilt++;
+      got++;
+      got_bytes += lost.len;
+    }
+
+  fprintf(out,
+          ",\n    {\"name\": \"fec/loss\", \"channel\": \"%s\", "
+          "\"group\": %u, \"depth\": %u, \"loss\": %.2f, "
+          "\"delivered\": %.4f, \"goodput\": %.4f, \"rebuilt\": %lu, "
+          "\"wrong\": %lu}",
+          bursty ? "bursty" : "random", count, count ? depth : 0, loss,
+          (double)got / FEC_LOSS_PACKETS, (double)got_bytes / sent_bytes,
+          rebuilt, wrong);
+}
+
+/****************************************************************************
+ * Name: bench_fec_loss
+ *
+ * Description:
+ *   Simulates radio packet loss, comparing no parity with several parity
+ *   group sizes and interleaving depths over random and bursty channels.
+ ****************************************************************************/
+
+static void bench_fec_loss(void)
+{
+  static const double losses[] = {0.0, 0.01, 0.02, 0.05, 0.1, 0.2, 0.3};
+  static const uint8_t schemes[][2] = {
+      {0, 1}, {4, 1}, {8, 1}, {16, 1}, {8, 4},
+  };
+
+  for (int bursty = 0; bursty < 2; bursty++)
+    {
+      for (size_t s = 0; s < array_len(schemes); s++)
+        {
+          for (size_t l = 0; l < array_len(losses); l++)
+            {
+              fec_simulate(schemes[s][0], schemes[s][1], bursty, losses[l]);
+            }
+        }
+    }
+}
+
+static void usage(FILE *stream, const char *name)
+{
+  fprintf(stream,
+          "Usage: %s [-n iterations] [-o output.json] [-l logfile]\n\n"
+          "Benchmarks packet construction, the syncro ring, log\n"
+          "compression and radio parity, reporting results as JSON.\n\n"
+          "  -l  Recorded log to measure compression on, instead of\n"
+          "      synthetic packets\n",
+          name);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+  int c;
+  unsigned long n = DEFAULT_ITERATIONS;
+  const char *logfile = NULL;
+
+  out = stdout;
+
+  while ((c = getopt(argc, argv, "hn:o:l:")) != -1)
+    {
+      switch (c)
+        {
+        case 'n':
+          n = strtoul(optarg, NULL, 10);
+          break;
+        case 'o':
+          out = fopen(optarg, "w");
+          if (out == NULL)
+            {
+              fprintf(stderr, "Couldn't open '%s': %d\n", optarg, errno);
+              return EXIT_FAILURE;
+            }
+          break;
+        case 'l':
+          logfile = optarg;
+          break;
+        case 'h':
+          usage(stdout, argv[0]);
+          return EXIT_SUCCESS;
+        default:
+          usage(stderr, argv[0]);
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (n == 0)
+    {
+      usage(stderr, argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  samples_init();
+  frame_crc_init();
+  packet_header_init(&hdr, "BENCH", 0);
+  packager_init();
+  package_init(&pkgr, PACKAGE_LOG);
+
+  if (logfile != NULL && corpus_load(logfile))
+    {
+      return EXIT_FAILURE;
+    }
+
+  fprintf(out, "{\n  \"packet_maxlen\": %d,\n  \"results\": [",
+          CONFIG_PYGMY_PACKET_MAXLEN);
+
+  bench_blocks(n);
+  bench_convert(n);
+  bench_push(n);
+  bench_frame(n);
+  bench_package(n);
+  bench_latency();
+
+  if (logfile == NULL)
+    {
+      corpus_generate();
+    }
+
+  bench_lz(n);
+
+  fec_generate();
+  bench_fec(n);
+  bench_fec_loss();
+
+  fprintf(out, "\n  ]\n}\n");
+
+  if (out != stdout)
+    {
+      fclose(out);
+    }
+
+  return EXIT_SUCCESS;
+}
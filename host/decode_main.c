@@ -0,0 +1,950 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../packets/decoder.h"
+#include "../packets/fec.h"
+#include "../packets/frame.h"
+#include "../packets/lz.h"
+#include "../packets/packets.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Array length helper */
+
+#define array_len(arr) (sizeof(arr) / sizeof((arr)[0]))
+
+/* Output buffer size for each output file */
+
+#define OUT_BUFSIZE (1 << 20)
+
+/* Most columns in any table, including time */
+
+#define MAX_COLUMNS 5
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+enum format_e
+{
+  FORMAT_CSV,     /* One <table>.csv file per table */
+  FORMAT_COLUMNS, /* One <table>.<column>.bin file per column */
+};
+
+/* A buffered output file. Plain `write` calls on large buffers avoid the
+ * per-call overhead of stdio, which otherwise dominates decoding time.
+ */
+
+struct out_s
+{
+  int fd;        /* Output file, -1 if unused */
+  char *buf;     /* Pending output */
+  size_t len;    /* Length of pending output */
+};
+
+/* An output table. The first column is always the mission time. */
+
+struct table_s
+{
+  const char *name;                  /* Table name */
+  const char *columns[MAX_COLUMNS];  /* Column names */
+  int ncolumns;                      /* Number of columns */
+  struct out_s files[MAX_COLUMNS];   /* Output files (only [0] for CSV) */
+  unsigned long rows;                /* Rows written */
+};
+
+/* Tables, one per block kind plus one describing the packets themselves
+ * and one of radio profile notices
+ */
+
+enum table_e
+{
+  TABLE_PRESS = PACKET_PRESS,
+  TABLE_TEMP = PACKET_TEMP,
+  TABLE_ALT = PACKET_ALT,
+  TABLE_COORD = PACKET_COORD,
+  TABLE_ACCEL = PACKET_ACCEL,
+  TABLE_GYRO = PACKET_GYRO,
+  TABLE_MAG = PACKET_MAG,
+  TABLE_VOLT = PACKET_VOLT,
+  TABLE_PACKETS,
+  TABLE_PROFILE,
+  TABLE_COUNT,
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct table_s tables[] = {
+    [TABLE_PRESS] = {"press", {"time", "press"}, 2},
+    [TABLE_TEMP] = {"temp", {"time", "temp"}, 2},
+    [TABLE_ALT] = {"alt", {"time", "alt"}, 2},
+    [TABLE_COORD] = {"coord", {"time", "lat", "lon"}, 3},
+    [TABLE_ACCEL] = {"accel", {"time", "x", "y", "z"}, 4},
+    [TABLE_GYRO] = {"gyro", {"time", "x", "y", "z"}, 4},
+    [TABLE_MAG] = {"mag", {"time", "x", "y", "z"}, 4},
+    [TABLE_VOLT] = {"volt", {"time", "voltage"}, 2},
+    [TABLE_PACKETS] = {"packets", {"time", "num", "version", "len"}, 4},
+    [TABLE_PROFILE] = {"profile", {"time", "profile", "spread", "countdown"},
+                       4},
+};
+
+static enum format_e format = FORMAT_CSV;
+
+/* Mission time range of the packets to decode, inclusive */
+
+static pkt_time_t range_from = 0;
+static pkt_time_t range_to = UINT32_MAX;
+
+/* Decompressed contents of a compressed log frame */
+
+static uint8_t lz_buf[LZ_INPUT_MAX];
+
+/* Radio packets remembered to rebuild lost ones from parity, and a rebuilt
+ * packet
+ */
+
+static struct fec_dec_s fec;
+static uint8_t lost_buf[CONFIG_PYGMY_PACKET_MAXLEN];
+
+/* Parity packets received and lost packets rebuilt from them */
+
+static unsigned long parity_packets;
+static unsigned long rebuilt_packets;
+
+/* "00" to "99" for formatting integers */
+
+static const char digit_pairs[] = "00010203040506070809"
+                                  "10111213141516171819"
+                                  "20212223242526272829"
+                                  "30313233343536373839"
+                                  "40414243444546474849"
+                                  "50515253545556575859"
+                                  "60616263646566676869"
+                                  "70717273747576777879"
+                                  "80818283848586878889"
+                                  "90919293949596979899";
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(FILE *stream, const char *name)
+{
+  fprintf(stream,
+          "Usage: %s [-f csv|columns] [-o output_dir] [-t from,to] "
+          "file...\n\n"
+          "Decodes telemetry log files and radio captures into one table "
+          "per block kind.\n\n"
+          "  -f  csv: <table>.csv files (default)\n"
+          "      columns: <table>.<column>.bin files of little endian "
+          "int32_t,\n"
+          "               with time as uint32_t milliseconds\n"
+          "  -o  Directory to write the tables to (default .)\n"
+          "  -t  Only decode packets from mission time `from` to `to` (ms),\n"
+          "      seeking through the time index of log segments\n",
+          name);
+}
+
+static uint64_t now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/****************************************************************************
+ * Name: out_open
+ *
+ * Description:
+ *   Opens an output file with a large buffer.
+ *
+ * Returns:
+ *   0 on success, errno error code on failure
+ ****************************************************************************/
+
+static int out_open(struct out_s *out, const char *path)
+{
+  int err;
+
+  out->len = 0;
+  out->buf = malloc(OUT_BUFSIZE);
+  if (out->buf == NULL)
+    {
+      return ENOMEM;
+    }
+
+  out->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (out->fd < 0)
+    {
+      err = errno;
+      fprintf(stderr, "Couldn't open '%s': %d\n", path, err);
+      return err;
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: out_flush
+ *
+ * Description:
+ *   Writes out all pending output.
+ ****************************************************************************/
+
+static void out_flush(struct out_s *out)
+{
+  ssize_t b_written;
+  size_t done = 0;
+
+  while (done < out->len)
+    {
+      b_written = write(out->fd, out->buf + done, out->len - done);
+      if (b_written < 0)
+        {
+          fprintf(stderr, "Couldn't write output: %d\n", errno);
+          exit(EXIT_FAILURE);
+        }
+
+      done += b_written;
+    }
+
+  out->len = 0;
+}
+
+/****************************************************************************
+ * Name: out_reserve
+ *
+ * Description:
+ *   Makes room for `nbytes` more bytes of output.
+ *
+ * Returns:
+ *   Where to put the output
+ ****************************************************************************/
+
+static inline char *out_reserve(struct out_s *out, size_t nbytes)
+{
+  if (out->len + nbytes > OUT_BUFSIZE)
+    {
+      out_flush(out);
+    }
+
+  return out->buf + out->len;
+}
+
+/****************************************************************************
+ * Name: out_close
+ ****************************************************************************/
+
+static void out_close(struct out_s *out)
+{
+  if (out->fd >= 0)
+    {
+      out_flush(out);
+      close(out->fd);
+      out->fd = -1;
+    }
+
+  free(out->buf);
+  out->buf = NULL;
+}
+
+/****************************************************************************
+ * Name: tables_open
+ *
+ * Description:
+ *   Opens the output files of all tables and writes CSV headings.
+ ****************************************************************************/
+
+static int tables_open(void)
+{
+  char path[256];
+  struct table_s *t;
+  int err;
+
+  for (t = tables; t < tables + array_len(tables); t++)
+    {
+      for (int i = 0; i < MAX_COLUMNS; i++)
+        {
+          t->files[i].fd = -1;
+        }
+    }
+
+  for (t = tables; t < tables + array_len(tables); t++)
+    {
+      if (format == FORMAT_CSV)
+        {
+          snprintf(path, sizeof(path), "%s.csv", t->name);
+          err = out_open(&t->files[0], path);
+          if (err) return err;
+
+          for (int i = 0; i < t->ncolumns; i++)
+            {
+              t->files[0].len +=
+                  sprintf(out_reserve(&t->files[0], 32), "%s%s",
+                          i ? "," : "", t->columns[i]);
+            }
+
+          *out_reserve(&t->files[0], 1) = '\n';
+          t->files[0].len++;
+          continue;
+        }
+
+      for (int i = 0; i < t->ncolumns; i++)
+        {
+          snprintf(path, sizeof(path), "%s.%s.bin", t->name, t->columns[i]);
+          err = out_open(&t->files[i], path);
+          if (err) return err;
+        }
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: tables_close
+ ****************************************************************************/
+
+static void tables_close(void)
+{
+  struct table_s *t;
+
+  for (t = tables; t < tables + array_len(tables); t++)
+    {
+      for (int i = 0; i < MAX_COLUMNS; i++)
+        {
+          out_close(&t->files[i]);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: put_int
+ *
+ * Description:
+ *   Formats a decimal integer, much faster than printf.
+ *
+ * Returns:
+ *   The end of the formatted integer
+ ****************************************************************************/
+
+static inline char *put_int(char *buf, int64_t value)
+{
+  char digits[20];
+  char *pos = digits + sizeof(digits);
+  uint64_t u = value < 0 ? -(uint64_t)value : (uint64_t)value;
+  size_t n;
+
+  if (value < 0)
+    {
+      *buf++ = '-';
+    }
+
+  /* Two digits at a time */
+
+  while (u >= 100)
+    {
+      pos -= 2;
+      memcpy(pos, &digit_pairs[2 * (u % 100)], 2);
+      u /= 100;
+    }
+
+  if (u >= 10)
+    {
+      pos -= 2;
+      memcpy(pos, &digit_pairs[2 * u], 2);
+    }
+  else
+    {
+      *--pos = '0' + u;
+    }
+
+  n = digits + sizeof(digits) - pos;
+  memcpy(buf, pos, n);
+  return buf + n;
+}
+
+/****************************************************************************
+ * Name: emit
+ *
+ * Description:
+ *   Writes a row to a table.
+ ****************************************************************************/
+
+static void emit(enum table_e table, pkt_time_t time, const int32_t *values)
+{
+  struct table_s *t = &tables[table];
+  char *start;
+  char *pos;
+
+  t->rows++;
+
+  if (format == FORMAT_CSV)
+    {
+      start = pos = out_reserve(&t->files[0], MAX_COLUMNS * 12 + 1);
+      pos = put_int(pos, time);
+      for (int i = 1; i < t->ncolumns; i++)
+        {
+          *pos++ = ',';
+          pos = put_int(pos, values[i - 1]);
+        }
+
+      *pos++ = '\n';
+      t->files[0].len += pos - start;
+      return;
+    }
+
+  memcpy(out_reserve(&t->files[0], sizeof(time)), &time, sizeof(time));
+  t->files[0].len += sizeof(time);
+
+  for (int i = 1; i < t->ncolumns; i++)
+    {
+      memcpy(out_reserve(&t->files[i], sizeof(values[i - 1])),
+             &values[i - 1], sizeof(values[i - 1]));
+      t->files[i].len += sizeof(values[i - 1]);
+    }
+}
+
+/****************************************************************************
+ * Name: emit_block
+ *
+ * Description:
+ *   Writes the contents of a block to the table of its kind, expanding
+ *   batches into their samples.
+ *
+ * Returns:
+ *   0 on success, EBADMSG if a batch is malformed
+ ****************************************************************************/
+
+static int emit_block(const struct block_view_s *blk)
+{
+  int32_t values[MAX_COLUMNS];
+  struct batch_iter_s batch;
+  struct batch_sample_s sample;
+  int err;
+
+  switch (blk->kind)
+    {
+    case PACKET_PRESS:
+      values[0] = ((const press_p *)blk->data)->press;
+      break;
+    case PACKET_TEMP:
+      values[0] = ((const temp_p *)blk->data)->temp;
+      break;
+    case PACKET_ALT:
+      values[0] = ((const alt_p *)blk->data)->alt;
+      break;
+    case PACKET_COORD:
+      values[0] = ((const coord_p *)blk->data)->lat;
+      values[1] = ((const coord_p *)blk->data)->lon;
+      break;
+    case PACKET_ACCEL:
+    case PACKET_GYRO:
+    case PACKET_MAG:
+      values[0] = ((const accel_p *)blk->data)->x;
+      values[1] = ((const accel_p *)blk->data)->y;
+      values[2] = ((const accel_p *)blk->data)->z;
+      break;
+    case PACKET_VOLT:
+      values[0] = ((const volt_p *)blk->data)->voltage;
+      break;
+    case PACKET_PROFILE:
+      values[0] = ((const profile_p *)blk->data)->profile;
+      values[1] = ((const profile_p *)blk->data)->spread;
+      values[2] = ((const profile_p *)blk->data)->countdown;
+      emit(TABLE_PROFILE, blk->time, values);
+      return 0;
+    case PACKET_BATCH:
+      {
+        uint8_t kind = ((const batch_p *)blk->data)->kind;
+
+        if (kind != PACKET_ACCEL && kind != PACKET_GYRO && kind != PACKET_MAG)
+          {
+            return EBADMSG;
+          }
+
+        batch_iter_init(&batch, blk);
+        while ((err = batch_iter_next(&batch, &sample)) == 0)
+          {
+            values[0] = sample.x;
+            values[1] = sample.y;
+            values[2] = sample.z;
+            emit(kind, sample.time, values);
+          }
+
+        return err == ENODATA ? 0 : err;
+      }
+    default:
+      return EBADMSG;
+    }
+
+  emit(blk->kind, blk->time, values);
+  return 0;
+}
+
+/****************************************************************************
+ * Name: decode_packet
+ *
+ * Description:
+ *   Writes a packet and all of its blocks to the tables, if it is in the
+ *   time range being decoded.
+ ****************************************************************************/
+
+static void decode_packet(const struct packet_view_s *pkt,
+                          unsigned long *bad)
+{
+  struct block_iter_s blks;
+  struct block_view_s blk;
+  int32_t values[MAX_COLUMNS];
+
+  if (pkt->time < range_from || pkt->time > range_to)
+    {
+      return;
+    }
+
+  values[0] = pkt->num;
+  values[1] = pkt->version;
+  values[2] = pkt->len;
+  emit(TABLE_PACKETS, pkt->time, values);
+
+  block_iter_init(&blks, pkt);
+  while (block_iter_next(&blks, &blk) == 0)
+    {
+      if (emit_block(&blk))
+        {
+          (*bad)++;
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: seek_marks
+ *
+ * Description:
+ *   Finds where to start decoding a log segment from to get every packet
+ *   from `range_from` on, using the time index ending the segment.
+ *
+ * Returns:
+ *   The offset of the last indexed frame no later than `range_from`, or
+ *   `start` if there is none.
+ ****************************************************************************/
+
+static size_t seek_marks(const struct frame_view_s *index, size_t start)
+{
+  struct frame_mark_s mark;
+  size_t lo = 0;
+  size_t hi = index->len / sizeof(mark);
+  size_t mid;
+
+  /* Find the first mark later than `range_from` */
+
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      memcpy(&mark, index->payload + mid * sizeof(mark), sizeof(mark));
+      if (mark.time <= range_from)
+        {
+          lo = mid + 1;
+        }
+      else
+        {
+          hi = mid;
+        }
+    }
+
+  if (lo == 0)
+    {
+      return start;
+    }
+
+  memcpy(&mark, index->payload + (lo - 1) * sizeof(mark), sizeof(mark));
+  return mark.offset > start ? mark.offset : start;
+}
+
+/****************************************************************************
+ * Name: decode_lz
+ *
+ * Description:
+ *   Decompresses a compressed log frame and writes all of its packets to
+ *   the tables.
+ *
+ * Returns:
+ *   0 on success, EBADMSG if the frame is malformed
+ ****************************************************************************/
+
+static int decode_lz(const struct frame_view_s *frame, unsigned long *bad)
+{
+  struct frame_lz_s lz;
+  struct packet_view_s pkt;
+  size_t rawlen;
+  size_t pos;
+  uint16_t len;
+
+  if (frame->len < sizeof(lz))
+    {
+      return EBADMSG;
+    }
+
+  memcpy(&lz, frame->payload, sizeof(lz));
+  if (lz_decompress(frame->payload + sizeof(lz), frame->len - sizeof(lz),
+                    lz_buf, sizeof(lz_buf), &rawlen) ||
+      rawlen != lz.rawlen)
+    {
+      return EBADMSG;
+    }
+
+  for (pos = 0; pos + sizeof(len) <= rawlen; pos += sizeof(len) + len)
+    {
+      memcpy(&len, &lz_buf[pos], sizeof(len));
+      if (len > rawlen - pos - sizeof(len))
+        {
+          return EBADMSG;
+        }
+
+      if (packet_parse(&lz_buf[pos + sizeof(len)], len, &pkt))
+        {
+          (*bad)++;
+          continue;
+        }
+
+      decode_packet(&pkt, bad);
+    }
+
+  return pos == rawlen ? 0 : EBADMSG;
+}
+
+/****************************************************************************
+ * Name: decode_radio
+ *
+ * Description:
+ *   Writes a received radio packet to the tables. Parity packets aren't
+ *   data, but rebuild a lost packet of their group when they can; it is
+ *   written out of order, as it arrives with the parity.
+ ****************************************************************************/
+
+static void decode_radio(const struct packet_view_s *pkt, unsigned long *bad)
+{
+  struct packet_s lost;
+  struct packet_view_s view;
+
+  packet_init(&lost, lost_buf);
+
+  if (!fec_is_parity(pkt))
+    {
+      fec_dec_push(&fec, pkt, &lost);
+      decode_packet(pkt, bad);
+      return;
+    }
+
+  parity_packets++;
+  if (fec_dec_push(&fec, pkt, &lost) == 0 &&
+      packet_parse(lost.contents, lost.len, &view) == 0)
+    {
+      rebuilt_packets++;
+      decode_packet(&view, bad);
+    }
+}
+
+/****************************************************************************
+ * Name: decode_file
+ *
+ * Description:
+ *   Decodes every packet in a log file or radio capture. The file is mapped
+ *   into memory and decoded in place. Log segments are recognized by their
+ *   header and older framed log files by their leading sync word; anything
+ *   else is read as back to back radio packets, rebuilding lost ones from
+ *   the parity packets between them. Compressed log frames are decompressed
+ *   and decoded like the packets they hold. When only a time range is
+ *   decoded, finished segments are entered through their time index and
+ *   left at the first packet past the range.
+ ****************************************************************************/
+
+static int decode_file(const char *path, unsigned long *bad)
+{
+  int fd;
+  int err;
+  struct stat st;
+  void *buf;
+  size_t skipped;
+  struct packet_iter_s pkts;
+  struct packet_view_s pkt;
+  struct frame_iter_s frames;
+  struct frame_view_s frame;
+  size_t start = 0;
+  struct logseg_hdr_s seg;
+  struct frame_lz_s lz;
+  const uint16_t sync = FRAME_SYNC;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    {
+      err = errno;
+      fprintf(stderr, "Couldn't open '%s': %d\n", path, err);
+      return err;
+    }
+
+  if (fstat(fd, &st) < 0)
+    {
+      err = errno;
+      close(fd);
+      return err;
+    }
+
+  if (st.st_size == 0)
+    {
+      close(fd);
+      return 0;
+    }
+
+  buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (buf == MAP_FAILED)
+    {
+      err = errno;
+      fprintf(stderr, "Couldn't map '%s': %d\n", path, err);
+      return err;
+    }
+
+  madvise(buf, st.st_size, MADV_SEQUENTIAL);
+
+  if (logseg_parse(buf, st.st_size, &seg) == 0)
+    {
+      start = seg.hdrlen;
+      if (seg.version != LOGSEG_VERSION)
+        {
+          fprintf(stderr, "'%s' has unknown log segment version %u.\n", path,
+                  seg.version);
+        }
+    }
+
+  /* Skip straight to the requested time in finished segments */
+
+  if (start > 0 && range_from > 0 &&
+      logseg_marks(buf, st.st_size, &frame) == 0)
+    {
+      start = seek_marks(&frame, start);
+    }
+
+  if (start > 0 ||
+      (st.st_size >= (off_t)sizeof(sync) && memcmp(buf, &sync, sizeof(sync)) == 0))
+    {
+      frame_iter_init(&frames, (uint8_t *)buf + start, st.st_size - start);
+      while (frame_iter_next(&frames, &frame) == 0)
+        {
+          if (frame.type == FRAME_LZ)
+            {
+              if (frame.len >= sizeof(lz))
+                {
+                  memcpy(&lz, frame.payload, sizeof(lz));
+                  if (lz.first > range_to)
+                    {
+                      break; /* Past the requested time */
+                    }
+
+                  if (lz.last < range_from)
+                    {
+                      continue;
+                    }
+                }
+
+              if (decode_lz(&frame, bad))
+                {
+                  fprintf(stderr, "Bad compressed frame in '%s'.\n", path);
+                }
+
+              continue;
+            }
+
+          if (frame.type != FRAME_PACKET)
+            {
+              continue;
+            }
+
+          if (packet_parse(frame.payload, frame.len, &pkt))
+            {
+              (*bad)++;
+              continue;
+            }
+
+          if (pkt.time > range_to)
+            {
+              break; /* Past the requested time */
+            }
+
+          decode_packet(&pkt, bad);
+        }
+
+      skipped = frames.skipped;
+    }
+  else
+    {
+      fec_dec_init(&fec);
+      packet_iter_init(&pkts, buf, st.st_size);
+      while (packet_iter_next(&pkts, &pkt) == 0)
+        {
+          decode_radio(&pkt, bad);
+        }
+
+      skipped = pkts.skipped;
+    }
+
+  if (skipped)
+    {
+      fprintf(stderr, "Skipped %zu undecodable bytes in '%s'.\n", skipped,
+              path);
+    }
+
+  munmap(buf, st.st_size);
+  return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+  int c;
+  int err;
+  uint64_t start;
+  uint64_t elapsed;
+  uint64_t bytes = 0;
+  unsigned long bad = 0;
+  struct stat st;
+  const char *outdir = NULL;
+  char **paths;
+
+  while ((c = getopt(argc, argv, "hf:o:t:")) != -1)
+    {
+      switch (c)
+        {
+        case 'f':
+          if (strcmp(optarg, "csv") == 0)
+            {
+              format = FORMAT_CSV;
+            }
+          else if (strcmp(optarg, "columns") == 0)
+            {
+              format = FORMAT_COLUMNS;
+            }
+          else
+            {
+              usage(stderr, argv[0]);
+              return EXIT_FAILURE;
+            }
+          break;
+        case 'o':
+          outdir = optarg;
+          break;
+        case 't':
+          if (sscanf(optarg, "%" SCNu32 ",%" SCNu32, &range_from,
+                     &range_to) != 2 ||
+              range_from > range_to)
+            {
+              usage(stderr, argv[0]);
+              return EXIT_FAILURE;
+            }
+          break;
+        case 'h':
+          usage(stdout, argv[0]);
+          return EXIT_SUCCESS;
+        default:
+          usage(stderr, argv[0]);
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (optind >= argc)
+    {
+      usage(stderr, argv[0]);
+      return EXIT_FAILURE;
+    }
+
+  /* Resolve inputs before moving into the output directory */
+
+  paths = calloc(argc - optind, sizeof(*paths));
+  if (paths == NULL)
+    {
+      return EXIT_FAILURE;
+    }
+
+  for (int i = optind; i < argc; i++)
+    {
+      paths[i - optind] = realpath(argv[i], NULL);
+      if (paths[i - optind] == NULL)
+        {
+          fprintf(stderr, "Couldn't find '%s': %d\n", argv[i], errno);
+          return EXIT_FAILURE;
+        }
+    }
+
+  if (outdir != NULL && chdir(outdir) < 0)
+    {
+      fprintf(stderr, "Couldn't enter output directory '%s': %d\n", outdir,
+              errno);
+      return EXIT_FAILURE;
+    }
+
+  frame_crc_init();
+
+  if (tables_open())
+    {
+      tables_close();
+      return EXIT_FAILURE;
+    }
+
+  start = now_ns();
+
+  for (int i = 0; i < argc - optind; i++)
+    {
+      err = decode_file(paths[i], &bad);
+      if (err)
+        {
+          tables_close();
+          return EXIT_FAILURE;
+        }
+
+      if (stat(paths[i], &st) == 0)
+        {
+          bytes += st.st_size;
+        }
+
+      free(paths[i]);
+    }
+
+  tables_close();
+  elapsed = now_ns() - start;
+  free(paths);
+
+  fprintf(stderr, "Decoded %lu packets (%llu bytes) in %.3f s, %.1f MB/s.\n",
+          tables[TABLE_PACKETS].rows, (unsigned long long)bytes,
+          elapsed / 1e9, elapsed ? bytes * 1e3 / elapsed : 0.0);
+
+  if (parity_packets)
+    {
+      fprintf(stderr, "Rebuilt %lu lost packets from %lu parity packets.\n",
+              rebuilt_packets, parity_packets);
+    }
+
+  if (bad)
+    {
+      fprintf(stderr, "%lu malformed blocks were left out.\n", bad);
+    }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,64 @@
+#ifndef _PYGMY_HOST_CONFIG_H_
+#define _PYGMY_HOST_CONFIG_H_
+
+/****************************************************************************
+ * Host build configuration. Stands in for the Kconfig generated
+ * `nuttx/config.h` so the telemetry sources can be compiled for the host.
+ * Values match the Kconfig defaults unless noted.
+ ****************************************************************************/
+
+/* Sensors simulated by the mock uORB */
+
+#define CONFIG_SENSORS_MS56XX 1
+#define CONFIG_SENSORS_LSM6DSO32 1
+#define CONFIG_SENSORS_LIS2MDL 1
+#define CONFIG_SENSORS_L86_XXX 1
+
+/* Device paths, relative to the host program's output directory */
+
+#define CONFIG_PYGMY_TELEM_RADIOPATH "radio.bin"
+#define CONFIG_PYGMY_TELEM_PWRFS "pwrfs"
+#define CONFIG_PYGMY_TELEM_USRFS "usrfs"
+#define CONFIG_PYGMY_TELEM_CONFIGFILE "eeprom.bin"
+
+/* Packet options */
+
+#define CONFIG_PYGMY_CALLSIGN_LEN 6
+#define CONFIG_PYGMY_PACKET_MAXLEN 255
+#define CONFIG_PYGMY_ALT_REFPRESS 101325
+#define CONFIG_PYGMY_FIXED_CONVERSION 1
+#define CONFIG_PYGMY_BATCH_IMU 1
+#define CONFIG_PYGMY_BATCH_NSAMPLES 16
+#define CONFIG_PYGMY_SYNCRO_NSLOTS 8
+#define CONFIG_PYGMY_CRC_SLICE8 1 /* Not the default, RAM is plentiful here */
+#define CONFIG_PYGMY_LOG_BUFSIZE 4096
+#define CONFIG_PYGMY_LOG_BACKLOG 32768
+#define CONFIG_PYGMY_LOG_SEGSIZE 1048576
+#define CONFIG_PYGMY_LOG_INDEX_NENTRIES 32
+#define CONFIG_PYGMY_LOG_FLUSH_MS 1000
+#define CONFIG_PYGMY_LOGSYNC_BYTES 16384
+#define CONFIG_PYGMY_LOGSYNC_MS 2000
+#define CONFIG_PYGMY_LOGSYNC_CRIT_MS 250
+#define CONFIG_PYGMY_PHASE_LAUNCH_ALT 2000
+#define CONFIG_PYGMY_PHASE_APOGEE_DROP 500
+#define CONFIG_PYGMY_PHASE_LANDED_MS 5000
+
+/* Sampling options */
+
+#define CONFIG_PYGMY_BARO_FREQ 25
+#define CONFIG_PYGMY_ACCEL_FREQ 50
+#define CONFIG_PYGMY_GYRO_FREQ 50
+#define CONFIG_PYGMY_MAG_FREQ 50
+#define CONFIG_PYGMY_GPS_FREQ 10
+
+/* Syslog options (debug output is too noisy at high simulation rates) */
+
+#define CONFIG_PYGMY_SYSLOG_ERR 1
+#define CONFIG_PYGMY_SYSLOG_WARN 1
+#define CONFIG_PYGMY_SYSLOG_INFO 1
+
+/* NuttX specific qualifiers */
+
+#define FAR
+
+#endif /* _PYGMY_HOST_CONFIG_H_ */
@@ -0,0 +1,12 @@
+#ifndef _PYGMY_HOST_SENSORS_IOCTL_H_
+#define _PYGMY_HOST_SENSORS_IOCTL_H_
+
+/****************************************************************************
+ * Sensor ioctl commands used by the telemetry application. The mock uORB
+ * accepts and ignores them.
+ ****************************************************************************/
+
+#define SNIOC_SETFULLSCALE 0x0001
+#define SNIOC_SET_CALIBVALUE 0x0002
+
+#endif /* _PYGMY_HOST_SENSORS_IOCTL_H_ */
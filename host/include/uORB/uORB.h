@@ -0,0 +1,94 @@
+#ifndef _PYGMY_HOST_UORB_H_
+#define _PYGMY_HOST_UORB_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <time.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define ORB_DECLARE(name) extern const struct orb_metadata g_orb_##name
+#define ORB_ID(name) (&g_orb_##name)
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Topic metadata */
+
+struct orb_metadata
+{
+  const char *o_name; /* Unique object name */
+  uint16_t o_size;    /* Object size */
+};
+
+/* Sensor topics, with the same layout as NuttX's `nuttx/uorb.h` */
+
+struct sensor_baro
+{
+  uint64_t timestamp; /* Units is microseconds */
+  float pressure;     /* Pressure measurement in millibar or hPa */
+  float temperature;  /* Temperature in degrees Celsius */
+};
+
+struct sensor_accel
+{
+  uint64_t timestamp; /* Units is microseconds */
+  float x;            /* Axis X in m/s^2 */
+  float y;            /* Axis Y in m/s^2 */
+  float z;            /* Axis Z in m/s^2 */
+  float temperature;  /* Temperature in degrees Celsius */
+};
+
+struct sensor_gyro
+{
+  uint64_t timestamp; /* Units is microseconds */
+  float x;            /* Axis X in rad/s */
+  float y;            /* Axis Y in rad/s */
+  float z;            /* Axis Z in rad/s */
+  float temperature;  /* Temperature in degrees Celsius */
+};
+
+struct sensor_mag
+{
+  uint64_t timestamp; /* Units is microseconds */
+  float x;            /* Axis X in micro Tesla (uT) */
+  float y;            /* Axis Y in micro Tesla (uT) */
+  float z;            /* Axis Z in micro Tesla (uT) */
+  float temperature;  /* Temperature in degrees Celsius */
+  int32_t status;     /* Status of calibration */
+};
+
+struct sensor_gnss
+{
+  uint64_t timestamp;       /* Units is microseconds */
+  time_t time_utc;          /* Seconds since epoch */
+  double latitude;          /* Unit is degrees */
+  double longitude;         /* Unit is degrees */
+  float altitude;           /* Altitude above MSL in meters */
+  float altitude_ellipsoid; /* Altitude above ellipsoid in meters */
+  float eph;                /* GPS horizontal position accuracy in meters */
+  float epv;                /* GPS vertical position accuracy in meters */
+  float hdop;               /* Horizontal dilution of precision */
+  float pdop;               /* Position dilution of precision */
+  float vdop;               /* Vertical dilution of precision */
+  float ground_speed;       /* GPS ground speed in meters/sec */
+  float course;             /* Course over ground in degrees */
+  uint32_t satellites_used; /* Number of satellites used */
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+int orb_subscribe(const struct orb_metadata *meta);
+int orb_copy(const struct orb_metadata *meta, int fd, void *buffer);
+int orb_set_frequency(int fd, unsigned frequency);
+int orb_ioctl(int fd, int cmd, unsigned long arg);
+
+#endif /* _PYGMY_HOST_UORB_H_ */
@@ -0,0 +1,266 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <syslog.h>
+#include <unistd.h>
+
+#include "../common/configuration.h"
+#include "../packets/frame.h"
+#include "../telemetry/arguments.h"
+#include "../telemetry/backlog.h"
+#include "../telemetry/logsync.h"
+#include "../telemetry/radiosched.h"
+#include "../telemetry/syncro.h"
+#include "uorb_mock.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define DEFAULT_DURATION 10 /* Seconds */
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static pthread_t radio_pid;
+static pthread_t log_pid;
+static pthread_t log_writer_pid;
+static pthread_t packet_pid;
+
+/* Default configuration, as if read from a freshly programmed EEPROM */
+
+static struct configuration_s config = {
+    .radio =
+        {
+            .callsign = "HOST",
+            .frequency = 902000000,
+            .bandwidth = 125,
+            .prlen = 8,
+            .spread = 9,
+            .mod = 0,
+            .txpower = 12.0f,
+        },
+    .imu =
+        {
+            .xl_fsr = 32,
+            .gyro_fsr = 2000,
+        },
+};
+
+static syncro_t syncro;
+static syncro_t radio_syncro;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+static void usage(FILE *stream, const char *name)
+{
+  fprintf(stream,
+          "Usage: %s [-t seconds] [-s speedup] [-r replay_dir] [-c callsign] "
+          "[output_dir]\n\n"
+          "Runs the telemetry pipeline on the host with simulated sensors.\n"
+          "Logs are written to <output_dir>/" CONFIG_PYGMY_TELEM_PWRFS
+          " and radio frames to <output_dir>/" CONFIG_PYGMY_TELEM_RADIOPATH
+          ".\n\n"
+          "  -t  Wall clock run time in seconds (default %d)\n"
+          "  -s  Factor to speed up all sensor rates by (default 1)\n"
+          "  -r  Directory of recorded <topic>.bin sensor streams to replay\n"
+          "  -c  Call sign to sign packets with (default %s)\n",
+          name, DEFAULT_DURATION, config.radio.callsign);
+}
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void *log_thread(void *arg);
+void *log_writer_thread(void *arg);
+void *radio_thread(void *arg);
+void *packet_thread(void *arg);
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(int argc, char *argv[])
+{
+  int c;
+  int err;
+  int radio;
+  unsigned duration = DEFAULT_DURATION;
+  unsigned speedup = 1;
+  const char *replay_dir = NULL;
+  uint32_t published;
+  struct logsync_stats_s sync;
+  struct backlog_stats_s backlog;
+  struct radiosched_stats_s link;
+  const struct thread_args_t args = {
+      .syncro = &syncro,
+      .radio = &radio_syncro,
+      .config = &config,
+  };
+
+  while ((c = getopt(argc, argv, "ht:s:r:c:")) != -1)
+    {
+      switch (c)
+        {
+        case 't':
+          duration = strtoul(optarg, NULL, 10);
+          break;
+        case 's':
+          speedup = strtoul(optarg, NULL, 10);
+          break;
+        case 'r':
+          replay_dir = realpath(optarg, NULL);
+          if (replay_dir == NULL)
+            {
+              fprintf(stderr, "Couldn't find replay directory '%s': %d\n",
+                      optarg, errno);
+              return EXIT_FAILURE;
+            }
+          break;
+        case 'c':
+          strncpy(config.radio.callsign, optarg, CONFIG_PYGMY_CALLSIGN_LEN);
+          break;
+        case 'h':
+          usage(stdout, argv[0]);
+          return EXIT_SUCCESS;
+        default:
+          usage(stderr, argv[0]);
+          return EXIT_FAILURE;
+        }
+    }
+
+  /* Work inside the output directory so the configured device paths map to
+   * ordinary files there.
+   */
+
+  if (optind < argc && chdir(argv[optind]) < 0)
+    {
+      fprintf(stderr, "Couldn't enter output directory '%s': %d\n",
+              argv[optind], errno);
+      return EXIT_FAILURE;
+    }
+
+  if (mkdir(CONFIG_PYGMY_TELEM_PWRFS, 0777) < 0 && errno != EEXIST)
+    {
+      fprintf(stderr, "Couldn't create log directory: %d\n", errno);
+      return EXIT_FAILURE;
+    }
+
+  radio = open(CONFIG_PYGMY_TELEM_RADIOPATH, O_WRONLY | O_CREAT | O_TRUNC,
+               0666);
+  if (radio < 0)
+    {
+      fprintf(stderr, "Couldn't create radio output file: %d\n", errno);
+      return EXIT_FAILURE;
+    }
+
+  close(radio);
+
+  openlog("pygmy", LOG_PERROR, LOG_USER);
+  uorb_mock_init(speedup, replay_dir);
+
+  err = syncro_init(&syncro);
+  if (err == 0) err = syncro_init(&radio_syncro);
+  if (err)
+    {
+      fprintf(stderr, "Could not initialize synchronization object: %d\n",
+              err);
+      return EXIT_FAILURE;
+    }
+
+  /* Build the CRC tables before any thread frames or parses data */
+
+  frame_crc_init();
+
+  err = backlog_init();
+  if (err)
+    {
+      fprintf(stderr, "Could not initialize log backlog: %d\n", err);
+      return EXIT_FAILURE;
+    }
+
+  /* Thread priorities are left alone, since changing them usually requires
+   * privileges on the host.
+   */
+
+  err = pthread_create(&packet_pid, NULL, packet_thread, (void *)&args);
+  if (err)
+    {
+      fprintf(stderr, "Failed to start packet thread: %d\n", err);
+      return EXIT_FAILURE;
+    }
+
+  err = pthread_create(&log_pid, NULL, log_thread, (void *)&args);
+  if (err)
+    {
+      fprintf(stderr, "Failed to start logging thread: %d\n", err);
+      return EXIT_FAILURE;
+    }
+
+  err = pthread_create(&log_writer_pid, NULL, log_writer_thread,
+                       (void *)&args);
+  if (err)
+    {
+      fprintf(stderr, "Failed to start log writer thread: %d\n", err);
+      return EXIT_FAILURE;
+    }
+
+  err = pthread_create(&radio_pid, NULL, radio_thread, (void *)&args);
+  if (err)
+    {
+      fprintf(stderr, "Failed to start radio thread: %d\n", err);
+      return EXIT_FAILURE;
+    }
+
+  sleep(duration);
+
+  /* The pipeline threads run forever, so report and leave */
+
+  printf("Ran for %u s at %ux sensor rates.\n", duration, speedup);
+  published = atomic_load(&syncro.head);
+  printf("Published %u log packets (%.1f/s).\n", published,
+         (double)published / (duration > 0 ? duration : 1));
+  published = atomic_load(&radio_syncro.head);
+  printf("Published %u radio packets (%.1f/s).\n", published,
+         (double)published / (duration > 0 ? duration : 1));
+  printf("Log thread dropped %u packets.\n",
+         syncro_drops(&syncro, SYNCRO_LOGGER));
+  printf("Radio thread skipped %u packets.\n",
+         syncro_drops(&radio_syncro, SYNCRO_RADIO));
+
+  backlog_stats(&backlog);
+  printf("Log backlog peaked at %zu of %zu bytes, dropped %u packets.\n",
+         backlog.highwater, backlog.size, backlog.drops);
+
+  logsync_stats(&sync);
+  printf("Synced log %u times (%u failed), %llu bytes, "
+         "%.1f ms max, %.1f ms mean.\n",
+         sync.syncs, sync.failures, (unsigned long long)sync.bytes,
+         sync.max_us / 1000.0,
+         sync.syncs + sync.failures > 0
+             ? sync.total_us / 1000.0 / (sync.syncs + sync.failures)
+             : 0.0);
+
+  radiosched_stats(&link);
+  printf("Radio sent %u packets, %llu bytes, replaced %u stale packets.\n",
+         link.sent, (unsigned long long)link.bytes, link.replaced);
+  printf("Radio was on air %.1f s (%.0f%% of the time), waited %.1f s for "
+         "airtime, %.0f ms per full packet.\n",
+         link.airtime_us / 1e6,
+         100.0 * link.airtime_us / 1e6 / (duration > 0 ? duration : 1),
+         link.waited_us / 1e6, link.full_us / 1000.0);
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,406 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <syslog.h>
+#include <time.h>
+
+#include <uORB/uORB.h>
+
+#include "../common/configuration.h"
+#include "../packets/decoder.h"
+#include "../packets/packets.h"
+#include "../telemetry/arguments.h"
+#include "../telemetry/packager.h"
+#include "../telemetry/snapshot.h"
+#include "../telemetry/syncro.h"
+#include "uorb_mock.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Wall clock time the pipeline runs for, and the factor its sensor rates
+ * are sped up by
+ */
+
+#define PIPELINE_SECONDS 3
+#define PIPELINE_SPEEDUP 20
+
+/* Time between barometer samples in milliseconds */
+
+#define BARO_PERIOD (1000 / CONFIG_PYGMY_BARO_FREQ)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct configuration_s config = {
+    .radio =
+        {
+            .callsign = "TEST",
+        },
+    .imu =
+        {
+            .xl_fsr = 32,
+            .gyro_fsr = 2000,
+        },
+};
+
+static syncro_t syncro;
+static syncro_t radio_syncro;
+
+static uint8_t pkt_buf[CONFIG_PYGMY_PACKET_MAXLEN];
+static uint8_t block_buf[32];
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void *packet_thread(void *arg);
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: count_blocks
+ *
+ * Description:
+ *   Counts the blocks of one kind in a packet, and the samples in them.
+ *   Batch blocks count all their samples, other blocks count as one.
+ *
+ * Returns:
+ *   The number of samples, or -1 if the packet is invalid
+ *
+ ****************************************************************************/
+
+static int count_blocks(const struct packet_s *pkt, uint8_t kind)
+{
+  int count = 0;
+  struct packet_view_s view;
+  struct block_iter_s it;
+  struct block_view_s blk;
+  struct batch_iter_s bit;
+  struct batch_sample_s sample;
+
+  if (packet_parse(pkt->contents, pkt->len, &view))
+    {
+      return -1;
+    }
+
+  block_iter_init(&it, &view);
+  while (block_iter_next(&it, &blk) == 0)
+    {
+      if (blk.kind != kind)
+        {
+          continue;
+        }
+
+      if (kind != PACKET_BATCH)
+        {
+          count++;
+          continue;
+        }
+
+      batch_iter_init(&bit, &blk);
+      while (batch_iter_next(&bit, &sample) == 0)
+        {
+          count++;
+        }
+    }
+
+  return count;
+}
+
+/****************************************************************************
+ * Name: test_offset_range
+ *
+ * Description:
+ *   Packages samples more than `BLOCK_OFFSET_MAX` milliseconds after the
+ *   packet's base time. A barometer sample and an IMU sample behind a full
+ *   batch must both leave the packet untouched and fit whole into the next
+ *   packet, without losing the sample or the batch.
+ *
+ * Returns:
+ *   0 if the test passed, 1 if it failed
+ *
+ ****************************************************************************/
+
+static int test_offset_range(void)
+{
+  int err;
+  size_t len;
+  struct packager_s pkgr;
+  struct packet_s pkt;
+  struct packet_hdr_s hdr;
+  struct sensor_baro baro;
+  struct sensor_accel accel;
+  const uint64_t late = (BLOCK_OFFSET_MAX + 1000) * 1000ull;
+
+  memset(&baro, 0, sizeof(baro));
+  memset(&accel, 0, sizeof(accel));
+  baro.pressure = 1013.25f;
+  baro.temperature = 15.0f;
+
+  packager_init();
+  package_init(&pkgr, PACKAGE_LOG);
+  packet_header_init(&hdr, config.radio.callsign, 0);
+  packet_init(&pkt, pkt_buf);
+  packet_push(&pkt, &hdr, sizeof(hdr));
+
+  /* The first sample sets the packet's base time to 0 */
+
+  baro.timestamp = 0;
+  err = package_uorb(&pkgr, &pkt, SENSOR_BARO, &baro, block_buf);
+  if (err)
+    {
+      printf("FAIL offset_range: first sample: %d\n", err);
+      return 1;
+    }
+
+  /* A barometer sample out of range is taken back whole */
+
+  len = pkt.len;
+  baro.timestamp = late;
+  err = package_uorb(&pkgr, &pkt, SENSOR_BARO, &baro, block_buf);
+  if (err != ERANGE || pkt.len != len)
+    {
+      printf("FAIL offset_range: late sample returned %d, %zu of %zu bytes "
+             "kept\n",
+             err, pkt.len, len);
+      return 1;
+    }
+
+#ifdef CONFIG_PYGMY_BATCH_IMU
+  /* Fill a batch that is too new for the packet. It waits for the next
+   * packet, and so does the sample behind it.
+   */
+
+  for (int i = 0; i <= CONFIG_PYGMY_BATCH_NSAMPLES; i++)
+    {
+      accel.timestamp = late + i * 1000;
+      err = package_uorb(&pkgr, &pkt, SENSOR_ACCEL, &accel, block_buf);
+    }
+
+  if (err != ERANGE || pkt.len != len)
+    {
+      printf("FAIL offset_range: sample behind late batch returned %d, %zu "
+             "of %zu bytes kept\n",
+             err, pkt.len, len);
+      return 1;
+    }
+#endif
+
+  /* Both samples fit the next packet */
+
+  packet_reset(&pkt);
+  packet_push(&pkt, &hdr, sizeof(hdr));
+
+  err = package_uorb(&pkgr, &pkt, SENSOR_BARO, &baro, block_buf);
+  if (err == 0)
+    {
+      err = package_uorb(&pkgr, &pkt, SENSOR_ACCEL, &accel, block_buf);
+    }
+
+  if (err)
+    {
+      printf("FAIL offset_range: next packet: %d\n", err);
+      return 1;
+    }
+
+  if (count_blocks(&pkt, PACKET_PRESS) != 1 ||
+      count_blocks(&pkt, PACKET_TEMP) != 1 ||
+      count_blocks(&pkt, PACKET_ALT) != 1)
+    {
+      printf("FAIL offset_range: barometer sample missing from next "
+             "packet\n");
+      return 1;
+    }
+
+#ifdef CONFIG_PYGMY_BATCH_IMU
+  if (count_blocks(&pkt, PACKET_BATCH) != CONFIG_PYGMY_BATCH_NSAMPLES)
+    {
+      printf("FAIL offset_range: %d of %d batched samples in next packet\n",
+             count_blocks(&pkt, PACKET_BATCH), CONFIG_PYGMY_BATCH_NSAMPLES);
+      return 1;
+    }
+#endif
+
+  printf("PASS offset_range\n");
+  return 0;
+}
+
+/****************************************************************************
+ * Name: test_snapshot_stale
+ *
+ * Description:
+ *   Assembles a latest value packet after the GPS fix was lost long ago.
+ *   The stale coordinates must be left out rather than keep the fresh
+ *   pressure value out of the packet.
+ *
+ * Returns:
+ *   0 if the test passed, 1 if it failed
+ *
+ ****************************************************************************/
+
+static int test_snapshot_stale(void)
+{
+  struct packet_s pkt;
+  struct packet_hdr_s hdr;
+  coord_p coord = {0};
+  press_p press = {0};
+
+  snapshot_update(PACKET_COORD, 0, &coord, sizeof(coord));
+  snapshot_update(PACKET_PRESS, BLOCK_OFFSET_MAX + 1000, &press,
+                  sizeof(press));
+
+  packet_header_init(&hdr, config.radio.callsign, 0);
+  packet_init(&pkt, pkt_buf);
+  snapshot_packet(&pkt, &hdr);
+
+  if (count_blocks(&pkt, PACKET_PRESS) != 1 ||
+      count_blocks(&pkt, PACKET_COORD) != 0)
+    {
+      printf("FAIL snapshot_stale: %d pressure and %d coordinate blocks\n",
+             count_blocks(&pkt, PACKET_PRESS),
+             count_blocks(&pkt, PACKET_COORD));
+      return 1;
+    }
+
+  printf("PASS snapshot_stale\n");
+  return 0;
+}
+
+/****************************************************************************
+ * Name: test_log_baro
+ *
+ * Description:
+ *   Runs the packet thread on simulated sensors and checks that the log
+ *   stream carries every barometer sample, even while IMU batches left over
+ *   from full packets compete with them for space in the next packet.
+ *
+ * Returns:
+ *   0 if the test passed, 1 if it failed
+ *
+ ****************************************************************************/
+
+static int test_log_baro(void)
+{
+  int err;
+  pthread_t pid;
+  struct timespec until;
+  struct packet_s pkt;
+  struct packet_view_s view;
+  struct block_iter_s it;
+  struct block_view_s blk;
+  pkt_time_t last = 0;
+  unsigned samples = 0;
+  unsigned missing = 0;
+  unsigned gap;
+  const struct thread_args_t args = {
+      .syncro = &syncro,
+      .radio = &radio_syncro,
+      .config = &config,
+  };
+
+  uorb_mock_init(PIPELINE_SPEEDUP, NULL);
+
+  err = syncro_init(&syncro);
+  if (err == 0) err = syncro_init(&radio_syncro);
+  if (err == 0)
+    {
+      err = pthread_create(&pid, NULL, packet_thread, (void *)&args);
+    }
+
+  if (err)
+    {
+      printf("FAIL log_baro: couldn't start packet thread: %d\n", err);
+      return 1;
+    }
+
+  /* Read the log stream as the log thread would, counting the gaps between
+   * consecutive pressure blocks
+   */
+
+  packet_init(&pkt, pkt_buf);
+  clock_gettime(CLOCK_MONOTONIC, &until);
+  until.tv_sec += PIPELINE_SECONDS;
+
+  while ((err = syncro_consume_until(&syncro, SYNCRO_LOGGER, &pkt, &until)) ==
+         0)
+    {
+      if (packet_parse(pkt.contents, pkt.len, &view))
+        {
+          printf("FAIL log_baro: invalid packet\n");
+          return 1;
+        }
+
+      block_iter_init(&it, &view);
+      while (block_iter_next(&it, &blk) == 0)
+        {
+          if (blk.kind != PACKET_PRESS)
+            {
+              continue;
+            }
+
+          if (samples > 0)
+            {
+              gap = (blk.time - last + BARO_PERIOD / 2) / BARO_PERIOD;
+              missing += gap - 1;
+            }
+
+          last = blk.time;
+          samples++;
+        }
+    }
+
+  if (err != ETIMEDOUT)
+    {
+      printf("FAIL log_baro: couldn't read log stream: %d\n", err);
+      return 1;
+    }
+
+  if (syncro_drops(&syncro, SYNCRO_LOGGER) > 0)
+    {
+      printf("FAIL log_baro: fell behind the log stream\n");
+      return 1;
+    }
+
+  if (samples < PIPELINE_SECONDS * PIPELINE_SPEEDUP * CONFIG_PYGMY_BARO_FREQ /
+                    2 ||
+      missing > 0)
+    {
+      printf("FAIL log_baro: %u pressure samples logged, %u missing\n",
+             samples, missing);
+      return 1;
+    }
+
+  printf("PASS log_baro: %u pressure samples logged\n", samples);
+  return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+int main(void)
+{
+  int failed = 0;
+
+  openlog("pygmy", LOG_PERROR, LOG_USER);
+
+  /* The packet thread keeps running once started, so its test goes last */
+
+  failed += test_offset_range();
+  failed += test_snapshot_stale();
+  failed += test_log_baro();
+
+  printf("%d test%s failed\n", failed, failed == 1 ? "" : "s");
+  return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
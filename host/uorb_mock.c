@@ -0,0 +1,439 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <uORB/uORB.h>
+
+#include "uorb_mock.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Maximum number of simultaneous subscriptions */
+
+#define MOCK_MAXSUBS 16
+
+/* Largest sample size of any topic */
+
+#define MOCK_MAXSIZE sizeof(struct sensor_gnss)
+
+#define ORB_DEFINE(name)                                                     \
+  const struct orb_metadata g_orb_##name = {                                 \
+      .o_name = #name,                                                       \
+      .o_size = sizeof(struct name),                                         \
+  }
+
+/* Synthetic flight profile */
+
+#define FLIGHT_LAUNCH 5.0   /* Time of launch in seconds */
+#define FLIGHT_BURN 2.0     /* Motor burn time in seconds */
+#define FLIGHT_THRUST 100.0 /* Net acceleration during burn in m/s^2 */
+#define FLIGHT_DESCENT 10.0 /* Descent rate under parachute in m/s */
+#define GRAVITY 9.80665     /* Standard gravity in m/s^2 */
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* A subscription to a topic. Samples are delivered through a pipe so the
+ * subscriber can `poll` the read end like a real uORB file descriptor.
+ */
+
+struct mock_sub_s
+{
+  const struct orb_metadata *meta; /* Topic of this subscription */
+  int rfd;                         /* Read end, given to the subscriber */
+  int wfd;                         /* Write end, fed by the generator */
+  atomic_uint freq;                /* Sampling frequency in Hz */
+  FILE *replay;                    /* Recorded samples, or NULL */
+  pthread_t thread;                /* Sample generator thread */
+};
+
+/* State of the simulated flight at a point in time */
+
+struct flight_s
+{
+  double alt;   /* Altitude above ground in metres */
+  double accel; /* Vertical acceleration felt by the IMU in m/s^2 */
+};
+
+/****************************************************************************
+ * Public Data
+ ****************************************************************************/
+
+ORB_DEFINE(sensor_baro);
+ORB_DEFINE(sensor_accel);
+ORB_DEFINE(sensor_gyro);
+ORB_DEFINE(sensor_mag);
+ORB_DEFINE(sensor_gnss);
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static struct mock_sub_s subs[MOCK_MAXSUBS];
+static int nsubs;
+
+static unsigned mock_speedup = 1;
+static const char *mock_replay_dir;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: find_sub
+ *
+ * Description:
+ *   Finds the subscription that owns file descriptor `fd`.
+ ****************************************************************************/
+
+static struct mock_sub_s *find_sub(int fd)
+{
+  for (int i = 0; i < nsubs; i++)
+    {
+      if (subs[i].rfd == fd)
+        {
+          return &subs[i];
+        }
+    }
+
+  return NULL;
+}
+
+/****************************************************************************
+ * Name: noise
+ *
+ * Description:
+ *   Deterministic pseudo-random noise in [-1, 1).
+ ****************************************************************************/
+
+static float noise(uint32_t *state)
+{
+  *state = *state * 1664525u + 1013904223u;
+  return (float)(int32_t)*state / 2147483648.0f;
+}
+
+/****************************************************************************
+ * Name: flight_at
+ *
+ * Description:
+ *   Computes the simulated flight state `t` seconds after boot: a pad wait,
+ *   a constant thrust burn, a ballistic coast to apogee and a constant rate
+ *   descent under parachute.
+ ****************************************************************************/
+
+static void flight_at(double t, struct flight_s *state)
+{
+  const double vburn = FLIGHT_THRUST * FLIGHT_BURN;
+  const double hburn = 0.5 * FLIGHT_THRUST * FLIGHT_BURN * FLIGHT_BURN;
+  const double tcoast = vburn / GRAVITY;
+  const double apogee = hburn + vburn * tcoast / 2;
+  double tau = t - FLIGHT_LAUNCH;
+
+  state->accel = GRAVITY;
+
+  if (tau < 0)
+    {
+      state->alt = 0;
+    }
+  else if (tau < FLIGHT_BURN)
+    {
+      state->alt = 0.5 * FLIGHT_THRUST * tau * tau;
+      state->accel = FLIGHT_THRUST + GRAVITY;
+    }
+  else if ((tau -= FLIGHT_BURN) < tcoast)
+    {
+      state->alt = hburn + vburn * tau - 0.5 * GRAVITY * tau * tau;
+      state->accel = 0;
+    }
+  else
+    {
+      state->alt = fmax(apogee - FLIGHT_DESCENT * (tau - tcoast), 0);
+    }
+}
+
+/****************************************************************************
+ * Name: synthesize
+ *
+ * Description:
+ *   Creates a synthetic sample of topic `meta` at time `t_us`.
+ ****************************************************************************/
+
+static void synthesize(const struct orb_metadata *meta, uint64_t t_us,
+                       uint32_t *seed, void *buf)
+{
+  struct flight_s state;
+  double t = t_us / 1e6;
+
+  flight_at(t, &state);
+  memset(buf, 0, meta->o_size);
+
+  if (meta == ORB_ID(sensor_baro))
+    {
+      struct sensor_baro *baro = buf;
+      baro->timestamp = t_us;
+      baro->pressure =
+          1013.25f * powf(1.0f - 2.25577e-5f * state.alt, 5.25588f) +
+          0.02f * noise(seed);
+      baro->temperature = 15.0f - 0.0065f * state.alt + 0.01f * noise(seed);
+    }
+  else if (meta == ORB_ID(sensor_accel))
+    {
+      struct sensor_accel *accel = buf;
+      accel->timestamp = t_us;
+      accel->x = 0.05f * noise(seed);
+      accel->y = 0.05f * noise(seed);
+      accel->z = state.accel + 0.05f * noise(seed);
+    }
+  else if (meta == ORB_ID(sensor_gyro))
+    {
+      struct sensor_gyro *gyro = buf;
+      gyro->timestamp = t_us;
+      gyro->x = 0.01f * noise(seed);
+      gyro->y = 0.01f * noise(seed);
+      gyro->z = state.alt > 0 ? 2.0f * sinf(t) : 0.01f * noise(seed);
+    }
+  else if (meta == ORB_ID(sensor_mag))
+    {
+      struct sensor_mag *mag = buf;
+      mag->timestamp = t_us;
+      mag->x = 20.0f + 0.1f * noise(seed);
+      mag->y = 0.1f * noise(seed);
+      mag->z = -40.0f + 0.1f * noise(seed);
+    }
+  else if (meta == ORB_ID(sensor_gnss))
+    {
+      struct sensor_gnss *gnss = buf;
+      gnss->timestamp = t_us;
+      gnss->latitude = 45.4215 + 1e-6 * state.alt;
+      gnss->longitude = -75.6972;
+      gnss->altitude = state.alt;
+      gnss->satellites_used = 8;
+    }
+}
+
+/****************************************************************************
+ * Name: generator
+ *
+ * Description:
+ *   Feeds samples into a subscription at its sampling frequency, sped up by
+ *   the simulation speedup. Samples are synthesized unless a recording of the
+ *   topic was provided, in which case the recording is played back until it
+ *   runs out.
+ ****************************************************************************/
+
+static void *generator(void *arg)
+{
+  struct mock_sub_s *sub = arg;
+  uint8_t sample[MOCK_MAXSIZE];
+  uint32_t seed = (uint32_t)(sub - subs) + 1;
+  uint64_t n = 0;
+  unsigned freq;
+  struct timespec next;
+
+  clock_gettime(CLOCK_MONOTONIC, &next);
+
+  for (;;)
+    {
+      freq = atomic_load(&sub->freq);
+
+      /* Not sampling yet */
+
+      if (freq == 0)
+        {
+          usleep(10000);
+          clock_gettime(CLOCK_MONOTONIC, &next);
+          continue;
+        }
+
+      if (sub->replay != NULL)
+        {
+          if (fread(sample, sub->meta->o_size, 1, sub->replay) != 1)
+            {
+              return NULL; /* End of recording */
+            }
+        }
+      else
+        {
+          synthesize(sub->meta, n * 1000000 / freq, &seed, sample);
+        }
+
+      /* A full pipe means the subscriber is behind; like uORB, the sample is
+       * lost.
+       */
+
+      write(sub->wfd, sample, sub->meta->o_size);
+      n++;
+
+      /* Sleep until the next sample is due */
+
+      next.tv_nsec += 1000000000L / ((long)freq * mock_speedup);
+      while (next.tv_nsec >= 1000000000L)
+        {
+          next.tv_nsec -= 1000000000L;
+          next.tv_sec++;
+        }
+
+      clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: uorb_mock_init
+ *
+ * Description:
+ *   Configures the mock uORB before any subscriptions are made.
+ *
+ * Arguments:
+ *   speedup - Factor to speed up all sensor frequencies by
+ *   replay_dir - Directory of recorded sensor streams named
+ *                `<topic name>.bin`, each a sequence of raw topic structs. May
+ *                be NULL to synthesize all topics.
+ *
+ ****************************************************************************/
+
+void uorb_mock_init(unsigned speedup, const char *replay_dir)
+{
+  mock_speedup = speedup > 0 ? speedup : 1;
+  mock_replay_dir = replay_dir;
+}
+
+/****************************************************************************
+ * Name: orb_subscribe
+ *
+ * Description:
+ *   Subscribes to a topic. Returns a file descriptor that can be polled for
+ *   new samples, or -1 with `errno` set on failure.
+ *
+ ****************************************************************************/
+
+int orb_subscribe(const struct orb_metadata *meta)
+{
+  int fds[2];
+  char path[256];
+  struct mock_sub_s *sub;
+
+  if (nsubs >= MOCK_MAXSUBS)
+    {
+      errno = ENFILE;
+      return -1;
+    }
+
+  if (pipe(fds) < 0)
+    {
+      return -1;
+    }
+
+  fcntl(fds[1], F_SETFL, O_NONBLOCK);
+
+  sub = &subs[nsubs];
+  sub->meta = meta;
+  sub->rfd = fds[0];
+  sub->wfd = fds[1];
+  sub->replay = NULL;
+  atomic_init(&sub->freq, 0);
+
+  if (mock_replay_dir != NULL)
+    {
+      snprintf(path, sizeof(path), "%s/%s.bin", mock_replay_dir,
+               meta->o_name);
+      sub->replay = fopen(path, "rb");
+    }
+
+  errno = pthread_create(&sub->thread, NULL, generator, sub);
+  if (errno)
+    {
+      close(fds[0]);
+      close(fds[1]);
+      return -1;
+    }
+
+  nsubs++;
+  return sub->rfd;
+}
+
+/****************************************************************************
+ * Name: orb_copy
+ *
+ * Description:
+ *   Copies the oldest unread sample of a subscription. Returns 0 on success
+ *   and -1 with `errno` set on failure.
+ *
+ ****************************************************************************/
+
+int orb_copy(const struct orb_metadata *meta, int fd, void *buffer)
+{
+  ssize_t b_read = read(fd, buffer, meta->o_size);
+
+  if (b_read < 0)
+    {
+      return -1;
+    }
+  else if (b_read < meta->o_size)
+    {
+      errno = EIO;
+      return -1;
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: orb_set_frequency
+ *
+ * Description:
+ *   Sets the sampling frequency of a subscription in Hz.
+ *
+ ****************************************************************************/
+
+int orb_set_frequency(int fd, unsigned frequency)
+{
+  struct mock_sub_s *sub = find_sub(fd);
+
+  if (sub == NULL)
+    {
+      errno = EBADF;
+      return -1;
+    }
+
+  atomic_store(&sub->freq, frequency);
+  return 0;
+}
+
+/****************************************************************************
+ * Name: orb_ioctl
+ *
+ * Description:
+ *   Sensor control commands have no effect on simulated sensors.
+ *
+ ****************************************************************************/
+
+int orb_ioctl(int fd, int cmd, unsigned long arg)
+{
+  (void)cmd;
+  (void)arg;
+
+  if (find_sub(fd) == NULL)
+    {
+      errno = EBADF;
+      return -1;
+    }
+
+  return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef _PYGMY_HOST_UORB_MOCK_H_
+#define _PYGMY_HOST_UORB_MOCK_H_
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void uorb_mock_init(unsigned speedup, const char *replay_dir);
+
+#endif // _PYGMY_HOST_UORB_MOCK_H_
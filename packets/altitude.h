@@ -0,0 +1,35 @@
+#ifndef _PYGMY_ALTITUDE_H_
+#define _PYGMY_ALTITUDE_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* Default reference pressure for altitude calculations in Pa (sea level) */
+
+#ifndef CONFIG_PYGMY_ALT_REFPRESS
+#define CONFIG_PYGMY_ALT_REFPRESS 101325
+#endif
+
+/* Fractional bits of pressures given to `altitude_cm` */
+
+#define ALT_PRESS_FRACBITS 4
+
+/* Convert a pressure in Pa to the fixed point format of `altitude_cm` */
+
+#define alt_press_fixed(pa) ((uint32_t)(pa) << ALT_PRESS_FRACBITS)
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void altitude_init(uint32_t ref_press);
+int32_t altitude_cm(uint32_t press);
+
+#endif /* _PYGMY_ALTITUDE_H_ */
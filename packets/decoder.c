@@ -0,0 +1,458 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+
+#include "decoder.h"
+#include "packets.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* Version 1 blocks are the kind, a 32 bit time and the contents */
+
+#define V1_BLOCK_HDRLEN (1 + sizeof(pkt_time_t))
+
+/* Packets start with a printable call sign character, which can't be
+ * mistaken for a block kind. This is what delimits packets in a stream.
+ */
+
+#define is_callsign_start(c) ((c) >= 0x20 && (c) < 0x7f)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Length of the contents of fixed size blocks, indexed by kind */
+
+static const uint8_t block_sizes[] = {
+    [PACKET_PRESS] = sizeof(press_p), [PACKET_TEMP] = sizeof(temp_p),
+    [PACKET_ALT] = sizeof(alt_p),     [PACKET_COORD] = sizeof(coord_p),
+    [PACKET_ACCEL] = sizeof(accel_p), [PACKET_GYRO] = sizeof(gyro_p),
+    [PACKET_MAG] = sizeof(mag_p),     [PACKET_VOLT] = sizeof(volt_p),
+    [PACKET_PROFILE] = sizeof(profile_p),
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: varint_get
+ *
+ * Description:
+ *   Decodes an unsigned LEB128 varint written by the batch encoder.
+ *
+ * Returns:
+ *   The number of bytes read, or 0 if the varint runs past `end` or is
+ *   longer than 5 bytes.
+ *
+ ****************************************************************************/
+
+static size_t varint_get(const uint8_t *buf, const uint8_t *end,
+                         uint32_t *value)
+{
+  size_t len = 0;
+
+  *value = 0;
+
+  while (buf + len < end && len < 5)
+    {
+      *value |= (uint32_t)(buf[len] & 0x7f) << (7 * len);
+      if ((buf[len++] & 0x80) == 0)
+        {
+          return len;
+        }
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: unzigzag
+ *
+ * Description:
+ *   Undoes the zig-zag mapping of signed integers used by the batch encoder.
+ *
+ ****************************************************************************/
+
+static int32_t unzigzag(uint32_t value)
+{
+  return (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+}
+
+/****************************************************************************
+ * Name: block_len
+ *
+ * Description:
+ *   Gets the length of the block contents starting at `data`.
+ *
+ * Returns:
+ *   The length in bytes, or 0 if the kind is unknown or the contents run
+ *   past `end`.
+ *
+ ****************************************************************************/
+
+static size_t block_len(uint8_t kind, const uint8_t *data, const uint8_t *end)
+{
+  size_t len;
+
+  if (kind == PACKET_BATCH)
+    {
+      if (end - data < (ptrdiff_t)sizeof(batch_p))
+        {
+          return 0;
+        }
+
+      len = sizeof(batch_p) + ((const batch_p *)data)->len;
+    }
+  else if (kind == PACKET_PARITY)
+    {
+      if (end - data < (ptrdiff_t)sizeof(parity_p))
+        {
+          return 0;
+        }
+
+      len = sizeof(parity_p) + ((const parity_p *)data)->size;
+    }
+  else if (kind < sizeof(block_sizes))
+    {
+      len = block_sizes[kind];
+    }
+  else
+    {
+      return 0;
+    }
+
+  return end - data < (ptrdiff_t)len ? 0 : len;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: packet_parse
+ *
+ * Description:
+ *   Parses the packet at the start of `buf`. Version 1 and version 2
+ *   packets are both understood. Packets carry no length, so the packet is
+ *   taken to end at the first byte that can't start a block, at the end of
+ *   the buffer or at `CONFIG_PYGMY_PACKET_MAXLEN` bytes, whichever is first.
+ *
+ * Arguments:
+ *  buf - The buffer holding the packet
+ *  len - The length of the buffer in bytes
+ *  pkt - Where to describe the packet
+ *
+ * Returns:
+ *  0 on success, ENODATA if `buf` is empty, EBADMSG if `buf` doesn't start
+ *  with a packet header.
+ *
+ ****************************************************************************/
+
+int packet_parse(const uint8_t *buf, size_t len, struct packet_view_s *pkt)
+{
+  const uint8_t *end;
+  const uint8_t *pos;
+  const uint8_t *data;
+  size_t blk_hdrlen;
+  size_t blk_len;
+
+  if (len == 0)
+    {
+      return ENODATA;
+    }
+
+  if (len < PACKET_V1_HDRLEN || !is_callsign_start(buf[0]))
+    {
+      return EBADMSG;
+    }
+
+  if (len > CONFIG_PYGMY_PACKET_MAXLEN)
+    {
+      len = CONFIG_PYGMY_PACKET_MAXLEN;
+    }
+
+  end = buf + len;
+
+  pkt->contents = buf;
+  pkt->callsign = (const char *)buf;
+  pkt->num = buf[CONFIG_PYGMY_CALLSIGN_LEN];
+
+  /* Version 2 onwards flag the byte after the rolling counter */
+
+  if (len > PACKET_V1_HDRLEN && buf[PACKET_V1_HDRLEN] & PACKET_VERSION_FLAG)
+    {
+      pkt->version = buf[PACKET_V1_HDRLEN] & ~PACKET_VERSION_FLAG;
+      if (pkt->version != PACKET_VERSION ||
+          len < sizeof(struct packet_hdr_s))
+        {
+          return EBADMSG;
+        }
+
+      pkt->hdrlen = sizeof(struct packet_hdr_s);
+      pkt->time = get_u32(&buf[PACKET_V1_HDRLEN + 1]);
+      blk_hdrlen = sizeof(struct block_hdr_s);
+    }
+  else
+    {
+      pkt->version = 1;
+      pkt->hdrlen = PACKET_V1_HDRLEN;
+      pkt->time = 0;
+      blk_hdrlen = V1_BLOCK_HDRLEN;
+    }
+
+  /* Walk the blocks to find the end of the packet */
+
+  pos = buf + pkt->hdrlen;
+  while (end - pos > (ptrdiff_t)blk_hdrlen)
+    {
+      data = pos + blk_hdrlen;
+      blk_len = block_len(pos[0], data, end);
+      if (blk_len == 0)
+        {
+          break;
+        }
+
+      pos = data + blk_len;
+    }
+
+  pkt->len = pos - buf;
+  return 0;
+}
+
+/****************************************************************************
+ * Name: packet_iter_init
+ *
+ * Description:
+ *   Prepares to iterate over the packets in a buffer.
+ *
+ * Arguments:
+ *  it - The iterator to initialize
+ *  buf - The buffer of back to back packets
+ *  len - The length of the buffer in bytes
+ *
+ ****************************************************************************/
+
+void packet_iter_init(struct packet_iter_s *it, const void *buf, size_t len)
+{
+  it->pos = buf;
+  it->end = it->pos + len;
+  it->skipped = 0;
+}
+
+/****************************************************************************
+ * Name: packet_iter_next
+ *
+ * Description:
+ *   Gets the next packet in the buffer. Bytes that don't start a packet are
+ *   skipped and counted in `it->skipped`.
+ *
+ * Arguments:
+ *  it - The packet iterator
+ *  pkt - Where to describe the packet
+ *
+ * Returns:
+ *  0 on success, ENODATA once the buffer is exhausted.
+ *
+ ****************************************************************************/
+
+int packet_iter_next(struct packet_iter_s *it, struct packet_view_s *pkt)
+{
+  int err;
+
+  for (;;)
+    {
+      err = packet_parse(it->pos, it->end - it->pos, pkt);
+      if (err == 0)
+        {
+          it->pos += pkt->len;
+          return 0;
+        }
+      else if (err == ENODATA)
+        {
+          return err;
+        }
+
+      it->pos++;
+      it->skipped++;
+    }
+}
+
+/****************************************************************************
+ * Name: block_iter_init
+ *
+ * Description:
+ *   Prepares to iterate over the blocks of a packet.
+ *
+ * Arguments:
+ *  it - The iterator to initialize
+ *  pkt - A packet from `packet_parse` or `packet_iter_next`
+ *
+ ****************************************************************************/
+
+void block_iter_init(struct block_iter_s *it, const struct packet_view_s *pkt)
+{
+  it->pos = pkt->contents + pkt->hdrlen;
+  it->end = pkt->contents + pkt->len;
+  it->version = pkt->version;
+  it->time = pkt->time;
+}
+
+/****************************************************************************
+ * Name: block_iter_next
+ *
+ * Description:
+ *   Gets the next block of the packet. Block times are resolved to mission
+ *   times, whatever the packet version.
+ *
+ * Arguments:
+ *  it - The block iterator
+ *  blk - Where to describe the block
+ *
+ * Returns:
+ *  0 on success, ENODATA once all blocks have been read, EBADMSG if the
+ *  rest of the packet isn't a valid block.
+ *
+ ****************************************************************************/
+
+int block_iter_next(struct block_iter_s *it, struct block_view_s *blk)
+{
+  const uint8_t *data;
+  int16_t offset;
+
+  if (it->pos >= it->end)
+    {
+      return ENODATA;
+    }
+
+  blk->kind = it->pos[0];
+
+  if (it->version == 1)
+    {
+      if (it->end - it->pos < (ptrdiff_t)V1_BLOCK_HDRLEN)
+        {
+          return EBADMSG;
+        }
+
+      blk->time = get_u32(&it->pos[1]);
+      data = it->pos + V1_BLOCK_HDRLEN;
+    }
+  else
+    {
+      if (it->end - it->pos < (ptrdiff_t)sizeof(struct block_hdr_s))
+        {
+          return EBADMSG;
+        }
+
+      memcpy(&offset, &it->pos[1], sizeof(offset));
+      blk->time = it->time + offset;
+      data = it->pos + sizeof(struct block_hdr_s);
+    }
+
+  blk->len = block_len(blk->kind, data, it->end);
+  if (blk->len == 0)
+    {
+      return EBADMSG;
+    }
+
+  blk->data = data;
+  it->pos = data + blk->len;
+  return 0;
+}
+
+/****************************************************************************
+ * Name: batch_iter_init
+ *
+ * Description:
+ *   Prepares to expand the samples of a batch block.
+ *
+ * Arguments:
+ *  it - The iterator to initialize
+ *  blk - A PACKET_BATCH block from `block_iter_next`
+ *
+ * Returns:
+ *  0 on success, EINVAL if the block isn't a batch.
+ *
+ ****************************************************************************/
+
+int batch_iter_init(struct batch_iter_s *it, const struct block_view_s *blk)
+{
+  const batch_p *batch = blk->data;
+
+  if (blk->kind != PACKET_BATCH)
+    {
+      return EINVAL;
+    }
+
+  it->pos = (const uint8_t *)blk->data + sizeof(batch_p);
+  it->end = (const uint8_t *)blk->data + blk->len;
+  it->remaining = batch->count;
+  it->first = true;
+  it->sample.time = blk->time;
+  it->sample.x = batch->x;
+  it->sample.y = batch->y;
+  it->sample.z = batch->z;
+  return 0;
+}
+
+/****************************************************************************
+ * Name: batch_iter_next
+ *
+ * Description:
+ *   Gets the next sample of a batch block.
+ *
+ * Arguments:
+ *  it - The batch iterator
+ *  sample - Where to store the sample
+ *
+ * Returns:
+ *  0 on success, ENODATA once all samples have been read, EBADMSG if the
+ *  encoded samples are truncated.
+ *
+ ****************************************************************************/
+
+int batch_iter_next(struct batch_iter_s *it, struct batch_sample_s *sample)
+{
+  uint32_t delta[4];
+  size_t n;
+
+  if (it->remaining == 0)
+    {
+      return ENODATA;
+    }
+
+  /* The first sample is stored in full, the others as differences */
+
+  if (it->first)
+    {
+      it->first = false;
+    }
+  else
+    {
+      for (int i = 0; i < 4; i++)
+        {
+          n = varint_get(it->pos, it->end, &delta[i]);
+          if (n == 0)
+            {
+              it->remaining = 0;
+              return EBADMSG;
+            }
+
+          it->pos += n;
+        }
+
+      it->sample.time += unzigzag(delta[0]);
+      it->sample.x += unzigzag(delta[1]);
+      it->sample.y += unzigzag(delta[2]);
+      it->sample.z += unzigzag(delta[3]);
+    }
+
+  *sample = it->sample;
+  it->remaining--;
+  return 0;
+}
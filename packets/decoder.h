@@ -0,0 +1,112 @@
+#ifndef _PYGMY_DECODER_H_
+#define _PYGMY_DECODER_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packets.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* Length of a version 1 packet header: call sign and rolling counter */
+
+#define PACKET_V1_HDRLEN (CONFIG_PYGMY_CALLSIGN_LEN + 1)
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* A packet found in a buffer. Nothing is copied: `contents` points into the
+ * buffer being decoded.
+ */
+
+struct packet_view_s
+{
+  const uint8_t *contents; /* Start of the packet header */
+  size_t len;              /* Packet length in bytes, including header */
+  const char *callsign;    /* Call sign, not null terminated */
+  uint8_t num;             /* Rolling counter */
+  uint8_t version;         /* Format version (1 has no version field) */
+  pkt_time_t time;         /* Base mission time (0 for version 1) */
+  size_t hdrlen;           /* Length of the header in bytes */
+};
+
+/* A block in a packet. `data` points into the packet and has the layout of
+ * the current block structs (press_p, accel_p, batch_p, ...) for every
+ * version, so it can be cast directly.
+ */
+
+struct block_view_s
+{
+  uint8_t kind;      /* Block type */
+  pkt_time_t time;   /* Mission time of the block */
+  const void *data;  /* Block contents */
+  size_t len;        /* Length of the block contents in bytes */
+};
+
+/* Iterator over consecutive packets in a buffer, such as a log file or a
+ * radio capture.
+ */
+
+struct packet_iter_s
+{
+  const uint8_t *pos;  /* Next byte to decode */
+  const uint8_t *end;  /* End of the buffer */
+  size_t skipped;      /* Bytes skipped while looking for a packet */
+};
+
+/* Iterator over the blocks of one packet */
+
+struct block_iter_s
+{
+  const uint8_t *pos; /* Next block */
+  const uint8_t *end; /* End of the packet */
+  uint8_t version;    /* Packet format version */
+  pkt_time_t time;    /* Packet base time */
+};
+
+/* An IMU sample expanded from a batch block */
+
+struct batch_sample_s
+{
+  pkt_time_t time; /* Mission time of the sample */
+  int16_t x;       /* Sample x */
+  int16_t y;       /* Sample y */
+  int16_t z;       /* Sample z */
+};
+
+/* Iterator over the samples of a batch block */
+
+struct batch_iter_s
+{
+  const uint8_t *pos;           /* Next encoded sample */
+  const uint8_t *end;           /* End of the encoded samples */
+  unsigned remaining;           /* Samples left to decode */
+  bool first;                   /* Next sample is the first */
+  struct batch_sample_s sample; /* Last decoded sample */
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+int packet_parse(const uint8_t *buf, size_t len, struct packet_view_s *pkt);
+
+void packet_iter_init(struct packet_iter_s *it, const void *buf, size_t len);
+int packet_iter_next(struct packet_iter_s *it, struct packet_view_s *pkt);
+
+void block_iter_init(struct block_iter_s *it,
+                     const struct packet_view_s *pkt);
+int block_iter_next(struct block_iter_s *it, struct block_view_s *blk);
+
+int batch_iter_init(struct batch_iter_s *it, const struct block_view_s *blk);
+int batch_iter_next(struct batch_iter_s *it, struct batch_sample_s *sample);
+
+#endif /* _PYGMY_DECODER_H_ */
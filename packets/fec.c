@@ -0,0 +1,396 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <string.h>
+
+#include "fec.h"
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: fec_slot
+ *
+ * Description:
+ *   Gets the decoder's copy of the packet with unwrapped number `seq`.
+ *
+ * Returns:
+ *   The packet, or NULL if it wasn't received.
+ *
+ ****************************************************************************/
+
+static struct fec_slot_s *fec_slot(struct fec_dec_s *dec, uint32_t seq)
+{
+  struct fec_slot_s *slot = &dec->slots[seq % FEC_WINDOW];
+
+  return slot->valid && slot->seq == seq ? slot : NULL;
+}
+
+/****************************************************************************
+ * Name: fec_recover
+ *
+ * Description:
+ *   Rebuilds the lost packet of the group a parity packet protects, if
+ *   exactly one of them was lost.
+ *
+ * Arguments:
+ *  dec - The decoder
+ *  pkt - The parity packet
+ *  lost - Where to rebuild the lost packet
+ *
+ * Returns:
+ *  0 if a packet was rebuilt, ENODATA if none or more than one of the
+ *  group's packets were lost, EBADMSG if the parity is malformed.
+ *
+ ****************************************************************************/
+
+static int fec_recover(struct fec_dec_s *dec, const struct packet_view_s *pkt,
+                       struct packet_s *lost)
+{
+  const uint8_t *data;
+  const uint8_t *parity;
+  const struct fec_slot_s *member;
+  struct fec_slot_s *slot;
+  parity_p p;
+  uint32_t last;
+  uint32_t seq;
+  uint32_t missing = 0;
+  unsigned nmissing = 0;
+  uint8_t len;
+
+  if (pkt->len < pkt->hdrlen + sizeof(struct block_hdr_s) + sizeof(p))
+    {
+      return EBADMSG;
+    }
+
+  data = pkt->contents + pkt->hdrlen + sizeof(struct block_hdr_s);
+  parity = data + sizeof(p);
+  memcpy(&p, data, sizeof(p));
+  if (p.count == 0 || p.stride == 0 ||
+      (p.count - 1) * p.stride >= FEC_SPAN_MAX ||
+      p.size > FEC_PARITY_MAXLEN ||
+      parity + p.size > pkt->contents + pkt->len)
+    {
+      return EBADMSG;
+    }
+
+  if (!dec->started)
+    {
+      return ENODATA;
+    }
+
+  /* Parity packets are numbered like the last packet of their group */
+
+  last = dec->seq + (int8_t)(pkt->num - (uint8_t)dec->seq);
+
+  for (unsigned i = 0; i < p.count; i++)
+    {
+      seq = last - i * p.stride;
+      if (fec_slot(dec, seq) == NULL)
+        {
+          missing = seq;
+          nmissing++;
+        }
+    }
+
+  if (nmissing != 1)
+    {
+      return ENODATA;
+    }
+
+  /* XOR the parity with every packet that arrived */
+
+  slot = &dec->slots[missing % FEC_WINDOW];
+  slot->valid = false;
+  memcpy(slot->contents, parity, p.size);
+  len = p.len;
+
+  for (unsigned i = 0; i < p.count; i++)
+    {
+      seq = last - i * p.stride;
+      member = fec_slot(dec, seq);
+      if (member == NULL)
+        {
+          continue;
+        }
+
+      if (member->len > p.size)
+        {
+          return EBADMSG;
+        }
+
+      for (unsigned j = 0; j < member->len; j++)
+        {
+          slot->contents[j] ^= member->contents[j];
+        }
+
+      len ^= member->len;
+    }
+
+  /* The rebuilt packet must be the one that was lost */
+
+  if (len > p.size ||
+      len < sizeof(struct packet_hdr_s) - CONFIG_PYGMY_CALLSIGN_LEN ||
+      slot->contents[0] != (uint8_t)missing)
+    {
+      return EBADMSG;
+    }
+
+  slot->seq = missing;
+  slot->len = len;
+  slot->valid = true;
+
+  packet_reset(lost);
+  packet_push(lost, pkt->callsign, CONFIG_PYGMY_CALLSIGN_LEN);
+  packet_push(lost, slot->contents, len);
+  return 0;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: fec_enc_init
+ *
+ * Description:
+ *   Prepares to protect packets with parity. Every `depth` * `count`
+ *   packets make up `depth` interleaved groups of `count` packets, and each
+ *   group is followed by a parity packet.
+ *
+ * Arguments:
+ *  enc - The encoder to initialize
+ *  groups - Parity of the groups, `depth` of them
+ *  depth - The number of interleaved groups
+ *  count - The number of packets in each group, at least 1. At most
+ *          `FEC_SPAN_MAX` packet numbers may be spanned by a group.
+ *
+ ****************************************************************************/
+
+void fec_enc_init(struct fec_enc_s *enc, struct fec_group_s *groups,
+                  uint8_t depth, uint8_t count)
+{
+  enc->groups = groups;
+  enc->depth = depth;
+  enc->count = count;
+  enc->num = 0;
+  enc->next = 0;
+  enc->ready = NULL;
+
+  for (int i = 0; i < depth; i++)
+    {
+      memset(groups[i].blk, 0, sizeof(parity_p));
+    }
+}
+
+/****************************************************************************
+ * Name: fec_enc_push
+ *
+ * Description:
+ *   Adds a packet about to be sent to the parity of its group. The packet
+ *   is renumbered in sending order, so the ground can tell which packets of
+ *   a group never arrived. Once the packet completes its group,
+ *   `fec_enc_parity` gets the parity packet to send after it.
+ *
+ * Arguments:
+ *  enc - The encoder
+ *  pkt - The packet, with a version 2 header
+ *
+ * Returns:
+ *  0 on success, EMSGSIZE if the packet is longer than `FEC_DATA_MAXLEN`.
+ *  Such a packet can still be sent, but isn't protected. It shares its
+ *  number with the next packet, so the ground doesn't count it as part of
+ *  a group.
+ *
+ ****************************************************************************/
+
+int fec_enc_push(struct fec_enc_s *enc, struct packet_s *pkt)
+{
+  struct packet_hdr_s *hdr = (struct packet_hdr_s *)pkt->contents;
+  struct fec_group_s *group = &enc->groups[enc->next];
+  parity_p *p = (parity_p *)group->blk;
+  uint8_t *parity = group->blk + sizeof(parity_p);
+  const uint8_t *data = pkt->contents + CONFIG_PYGMY_CALLSIGN_LEN;
+  size_t len = pkt->len - CONFIG_PYGMY_CALLSIGN_LEN;
+  size_t i;
+
+  if (pkt->len < sizeof(*hdr))
+    {
+      return EMSGSIZE;
+    }
+
+  if (pkt->len > FEC_DATA_MAXLEN)
+    {
+      hdr->num = enc->num;
+      return EMSGSIZE;
+    }
+
+  hdr->num = enc->num++;
+
+  if (p->count == 0)
+    {
+      group->time = hdr->time;
+      memcpy(enc->callsign, hdr->callsign, CONFIG_PYGMY_CALLSIGN_LEN);
+    }
+
+  /* Parity past the longest packet so far is the new packet itself */
+
+  for (i = 0; i < len && i < p->size; i++)
+    {
+      parity[i] ^= data[i];
+    }
+
+  if (len > p->size)
+    {
+      memcpy(&parity[i], &data[i], len - i);
+      p->size = len;
+    }
+
+  p->len ^= len;
+  p->stride = enc->depth;
+  group->last = hdr->num;
+
+  if (++p->count == enc->count)
+    {
+      enc->ready = group;
+    }
+
+  enc->next = (enc->next + 1) % enc->depth;
+  return 0;
+}
+
+/****************************************************************************
+ * Name: fec_enc_parity
+ *
+ * Description:
+ *   Gets the parity packet of the group the last packet pushed completed,
+ *   and starts the group over. Call it after every `fec_enc_push`.
+ *
+ * Arguments:
+ *  enc - The encoder
+ *  parity - Where to assemble the parity packet
+ *
+ * Returns:
+ *  0 on success, ENODATA if the last packet didn't complete its group.
+ *
+ ****************************************************************************/
+
+int fec_enc_parity(struct fec_enc_s *enc, struct packet_s *parity)
+{
+  struct fec_group_s *group = enc->ready;
+  parity_p *p;
+  struct packet_hdr_s hdr;
+
+  if (group == NULL)
+    {
+      return ENODATA;
+    }
+
+  enc->ready = NULL;
+  p = (parity_p *)group->blk;
+
+  packet_header_init(&hdr, enc->callsign, group->last);
+  packet_reset(parity);
+  packet_push(parity, &hdr, sizeof(hdr));
+  packet_push_block(parity, PACKET_PARITY, group->time, group->blk,
+                    sizeof(*p) + p->size);
+
+  memset(p, 0, sizeof(*p));
+  return 0;
+}
+
+/****************************************************************************
+ * Name: fec_is_parity
+ *
+ * Description:
+ *   Checks if a received packet is a parity packet.
+ *
+ ****************************************************************************/
+
+bool fec_is_parity(const struct packet_view_s *pkt)
+{
+  return pkt->version >= 2 && pkt->len > pkt->hdrlen &&
+         pkt->contents[pkt->hdrlen] == PACKET_PARITY;
+}
+
+/****************************************************************************
+ * Name: fec_dec_init
+ *
+ * Description:
+ *   Prepares to rebuild lost packets of a radio capture from its parity.
+ *
+ ****************************************************************************/
+
+void fec_dec_init(struct fec_dec_s *dec)
+{
+  for (int i = 0; i < FEC_WINDOW; i++)
+    {
+      dec->slots[i].valid = false;
+    }
+
+  dec->seq = 0;
+  dec->started = false;
+}
+
+/****************************************************************************
+ * Name: fec_dec_push
+ *
+ * Description:
+ *   Feeds the decoder every received packet in order. Packets are
+ *   remembered until parity arrives for their group; a parity packet
+ *   rebuilds the one packet of its group that never arrived.
+ *
+ * Arguments:
+ *  dec - The decoder
+ *  pkt - The received packet
+ *  lost - Where to rebuild a lost packet, a buffer of at least
+ *         `CONFIG_PYGMY_PACKET_MAXLEN` bytes
+ *
+ * Returns:
+ *  0 if a lost packet was rebuilt, ENODATA if not, EBADMSG if `pkt` is a
+ *  malformed parity packet.
+ *
+ ****************************************************************************/
+
+int fec_dec_push(struct fec_dec_s *dec, const struct packet_view_s *pkt,
+                 struct packet_s *lost)
+{
+  struct fec_slot_s *slot;
+  size_t len = pkt->len - CONFIG_PYGMY_CALLSIGN_LEN;
+
+  if (pkt->version < 2)
+    {
+      return ENODATA;
+    }
+
+  if (fec_is_parity(pkt))
+    {
+      return fec_recover(dec, pkt, lost);
+    }
+
+  /* Packet numbers wrap around; count on from the last packet */
+
+  if (!dec->started)
+    {
+      dec->seq = pkt->num;
+      dec->started = true;
+    }
+  else
+    {
+      dec->seq += (uint8_t)(pkt->num - (uint8_t)dec->seq);
+    }
+
+  slot = &dec->slots[pkt->num];
+  slot->valid = len <= FEC_PARITY_MAXLEN;
+  if (slot->valid)
+    {
+      slot->seq = dec->seq;
+      slot->len = len;
+      memcpy(slot->contents, pkt->contents + CONFIG_PYGMY_CALLSIGN_LEN, len);
+    }
+
+  return ENODATA;
+}
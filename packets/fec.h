@@ -0,0 +1,111 @@
+#ifndef _PYGMY_FEC_H_
+#define _PYGMY_FEC_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "decoder.h"
+#include "packets.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* Bytes a parity packet adds to the longest packet of its group: the
+ * header and the parity block header, less the call sign it leaves out
+ */
+
+#define FEC_OVERHEAD                                                         \
+  (sizeof(struct packet_hdr_s) + sizeof(struct block_hdr_s) +               \
+   sizeof(parity_p) - CONFIG_PYGMY_CALLSIGN_LEN)
+
+/* Longest packet a parity packet can protect */
+
+#define FEC_DATA_MAXLEN (CONFIG_PYGMY_PACKET_MAXLEN - FEC_OVERHEAD)
+
+/* Longest parity, and the parity block it is sent in */
+
+#define FEC_PARITY_MAXLEN (FEC_DATA_MAXLEN - CONFIG_PYGMY_CALLSIGN_LEN)
+#define FEC_BLOCK_MAXLEN (sizeof(parity_p) + FEC_PARITY_MAXLEN)
+
+/* Most packet numbers a group may span, so the decoder can't mistake a
+ * packet for one 256 numbers older
+ */
+
+#define FEC_SPAN_MAX 128
+
+/* Packets the decoder remembers, one for every packet number */
+
+#define FEC_WINDOW 256
+
+#if CONFIG_PYGMY_PACKET_MAXLEN > 255
+#error "Parity blocks only support packets of up to 255 bytes"
+#endif
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Parity of one group of packets being sent */
+
+struct fec_group_s
+{
+  uint8_t blk[FEC_BLOCK_MAXLEN]; /* parity_p followed by the parity */
+  pkt_time_t time;               /* Base time of the first packet */
+  uint8_t last;                  /* Number of the last packet */
+};
+
+/* Parity encoder. Consecutive packets go to `depth` interleaved groups in
+ * turn, so a burst of up to `depth` lost packets costs each group one.
+ */
+
+struct fec_enc_s
+{
+  struct fec_group_s *groups;               /* `depth` groups */
+  uint8_t depth;                            /* Interleaved groups */
+  uint8_t count;                            /* Packets in each group */
+  uint8_t num;                              /* Number of the next packet */
+  uint8_t next;                             /* Group of the next packet */
+  struct fec_group_s *ready;                /* Group with parity to send */
+  char callsign[CONFIG_PYGMY_CALLSIGN_LEN]; /* Call sign of the packets */
+};
+
+/* A packet remembered by the decoder */
+
+struct fec_slot_s
+{
+  uint32_t seq;                        /* Unwrapped packet number */
+  bool valid;                          /* The slot holds a packet */
+  uint8_t len;                         /* Length without call sign */
+  uint8_t contents[FEC_PARITY_MAXLEN]; /* Packet without call sign */
+};
+
+/* Parity decoder */
+
+struct fec_dec_s
+{
+  struct fec_slot_s slots[FEC_WINDOW]; /* Recent packets by number */
+  uint32_t seq;                        /* Unwrapped number of the last */
+  bool started;                        /* A packet has been received */
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void fec_enc_init(struct fec_enc_s *enc, struct fec_group_s *groups,
+                  uint8_t depth, uint8_t count);
+int fec_enc_push(struct fec_enc_s *enc, struct packet_s *pkt);
+int fec_enc_parity(struct fec_enc_s *enc, struct packet_s *parity);
+
+bool fec_is_parity(const struct packet_view_s *pkt);
+void fec_dec_init(struct fec_dec_s *dec);
+int fec_dec_push(struct fec_dec_s *dec, const struct packet_view_s *pkt,
+                 struct packet_s *lost);
+
+#endif /* _PYGMY_FEC_H_ */
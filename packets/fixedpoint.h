@@ -0,0 +1,143 @@
+#ifndef _PYGMY_FIXEDPOINT_H_
+#define _PYGMY_FIXEDPOINT_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+#include <string.h>
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* Fractional bits of fixed point scale factors */
+
+#define FIXED_SCALE_BITS 16
+
+/* Converts a constant scale factor to fixed point. Meant to be used on
+ * compile time constants so that no floating point maths is left in the
+ * program.
+ */
+
+#define fixed_scale(x) ((uint32_t)((x) * (1 << FIXED_SCALE_BITS) + 0.5))
+
+/* Float layout */
+
+#define FLOAT_MANT_BITS 23
+#define FLOAT_EXP_BIAS 127
+#define FLOAT_EXP_MAX 0xff
+
+/****************************************************************************
+ * Inline Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: sat16
+ *
+ * Description:
+ *   Saturates a 32 bit integer to the int16_t range.
+ *
+ ****************************************************************************/
+
+static inline int16_t sat16(int32_t value)
+{
+  if (value > INT16_MAX) return INT16_MAX;
+  if (value < INT16_MIN) return INT16_MIN;
+  return value;
+}
+
+/****************************************************************************
+ * Name: fixed_convert16
+ *
+ * Description:
+ *   Multiplies a float by a fixed point scale factor and rounds the result
+ *   to the nearest int16_t, saturating on overflow. Only integer operations
+ *   are used: the float's mantissa is multiplied by the scale and shifted
+ *   according to its exponent. This avoids software floating point on cores
+ *   without an FPU.
+ *
+ * Arguments:
+ *   value - The value to scale
+ *   scale - The scale factor, from `fixed_scale`
+ *
+ * Returns:
+ *   The scaled value. NaN converts to 0.
+ *
+ ****************************************************************************/
+
+static inline int16_t fixed_convert16(float value, uint32_t scale)
+{
+  uint32_t bits;
+  uint32_t mant;
+  uint32_t limit;
+  uint64_t mag;
+  int exp;
+  int shift;
+
+  memcpy(&bits, &value, sizeof(bits));
+
+  exp = (bits >> FLOAT_MANT_BITS) & FLOAT_EXP_MAX;
+  mant = (bits & ((1u << FLOAT_MANT_BITS) - 1)) | (1u << FLOAT_MANT_BITS);
+  limit = bits >> 31 ? -(int32_t)INT16_MIN : INT16_MAX;
+
+  if (exp == 0)
+    {
+      return 0; /* Zero, or too small to matter */
+    }
+  else if (exp == FLOAT_EXP_MAX)
+    {
+      if (mant != (1u << FLOAT_MANT_BITS)) return 0; /* NaN */
+      mag = limit;                                   /* Infinity */
+    }
+  else
+    {
+      /* value * scale = mant * scale * 2^(exp - bias - mantissa bits -
+       * scale bits)
+       */
+
+      shift = FLOAT_EXP_BIAS + FLOAT_MANT_BITS + FIXED_SCALE_BITS - exp;
+
+      if (shift <= 0)
+        {
+          mag = limit; /* Far out of range */
+        }
+      else if (shift >= 64)
+        {
+          return 0; /* Rounds to zero */
+        }
+      else
+        {
+          mag = (uint64_t)mant * scale;
+          mag = (mag + (1ull << (shift - 1))) >> shift;
+        }
+    }
+
+  if (mag > limit)
+    {
+      mag = limit;
+    }
+
+  return bits >> 31 ? -(int32_t)mag : (int32_t)mag;
+}
+
+/****************************************************************************
+ * Name: float_convert16
+ *
+ * Description:
+ *   Floating point equivalent of `fixed_convert16`, for cores with an FPU.
+ *
+ ****************************************************************************/
+
+static inline int16_t float_convert16(float value, float scale)
+{
+  float scaled = value * scale;
+
+  if (scaled != scaled) return 0; /* NaN */
+  if (scaled >= INT16_MAX) return INT16_MAX;
+  if (scaled <= INT16_MIN) return INT16_MIN;
+  return (int16_t)(scaled < 0 ? scaled - 0.5f : scaled + 0.5f);
+}
+
+#endif /* _PYGMY_FIXEDPOINT_H_ */
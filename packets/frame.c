@@ -0,0 +1,421 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "frame.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* Reflected CRC-32 polynomial (IEEE 802.3, as used by zlib) */
+
+#define CRC32_POLY 0xedb88320
+
+/* Slice-by-8 processes 8 bytes per step using 8 tables (8 KiB) instead of a
+ * byte per step with one table (1 KiB).
+ */
+
+#ifdef CONFIG_PYGMY_CRC_SLICE8
+#define CRC_NTABLES 8
+#else
+#define CRC_NTABLES 1
+#endif
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static uint32_t crc_table[CRC_NTABLES][256];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: frame_hdr_crc
+ *
+ * Description:
+ *   Computes the CRC of a frame from its header fields and payload.
+ *
+ ****************************************************************************/
+
+static uint32_t frame_hdr_crc(uint8_t type, uint16_t len, const void *payload)
+{
+  uint8_t fields[3] = {type, len & 0xff, len >> 8};
+  uint32_t crc;
+
+  crc = frame_crc(0, fields, sizeof(fields));
+  return frame_crc(crc, payload, len);
+}
+
+/****************************************************************************
+ * Name: frame_zero_tail
+ *
+ * Description:
+ *   Counts the zero bytes at the end of the `len` bytes at `buf`.
+ *
+ ****************************************************************************/
+
+static size_t frame_zero_tail(const uint8_t *buf, size_t len)
+{
+  size_t n = len;
+
+  while (n > 0 && buf[n - 1] == 0)
+    {
+      n--;
+    }
+
+  return len - n;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: frame_crc_init
+ *
+ * Description:
+ *   Builds the CRC lookup tables. Must be called once before any frames are
+ *   created or parsed.
+ *
+ ****************************************************************************/
+
+void frame_crc_init(void)
+{
+  uint32_t crc;
+
+  for (int i = 0; i < 256; i++)
+    {
+      crc = i;
+      for (int bit = 0; bit < 8; bit++)
+        {
+          crc = crc & 1 ? (crc >> 1) ^ CRC32_POLY : crc >> 1;
+        }
+
+      crc_table[0][i] = crc;
+    }
+
+  /* Table `t` holds the CRC of byte `i` followed by `t` zero bytes */
+
+  for (int t = 1; t < CRC_NTABLES; t++)
+    {
+      for (int i = 0; i < 256; i++)
+        {
+          crc = crc_table[t - 1][i];
+          crc_table[t][i] = crc_table[0][crc & 0xff] ^ (crc >> 8);
+        }
+    }
+}
+
+/****************************************************************************
+ * Name: frame_crc
+ *
+ * Description:
+ *   Computes the CRC-32 of a buffer, continuing from a previous CRC so a
+ *   frame can be checked in pieces.
+ *
+ * Arguments:
+ *  crc - The CRC of the preceding data, or 0 to start
+ *  buf - The data
+ *  len - The length of the data in bytes
+ *
+ * Returns:
+ *  The CRC-32 of the preceding data and `buf`
+ *
+ ****************************************************************************/
+
+uint32_t frame_crc(uint32_t crc, const void *buf, size_t len)
+{
+  const uint8_t *pos = buf;
+
+  crc = ~crc;
+
+#ifdef CONFIG_PYGMY_CRC_SLICE8
+  uint32_t lo;
+  uint32_t hi;
+
+  while (len >= 8)
+    {
+      lo = get_u32(pos) ^ crc;
+      hi = get_u32(pos + 4);
+
+      crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+            crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+            crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+            crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+
+      pos += 8;
+      len -= 8;
+    }
+#endif
+
+  while (len--)
+    {
+      crc = crc_table[0][(crc ^ *pos++) & 0xff] ^ (crc >> 8);
+    }
+
+  return ~crc;
+}
+
+/****************************************************************************
+ * Name: frame_init
+ *
+ * Description:
+ *   Initialize the header of a frame around a payload. The header and
+ *   payload can then be written out back to back.
+ *
+ * Arguments:
+ *  hdr - The header to initialize
+ *  type - The frame type
+ *  payload - The payload of the frame
+ *  len - The length of the payload in bytes
+ *
+ ****************************************************************************/
+
+void frame_init(struct frame_hdr_s *hdr, uint8_t type, const void *payload,
+                size_t len)
+{
+  hdr->sync = FRAME_SYNC;
+  hdr->type = type;
+  hdr->len = len;
+  hdr->crc = frame_hdr_crc(type, len, payload);
+}
+
+/****************************************************************************
+ * Name: frame_parse
+ *
+ * Description:
+ *   Parses and verifies the frame at the start of `buf`.
+ *
+ * Arguments:
+ *  buf - The buffer holding the frame
+ *  len - The length of the buffer in bytes
+ *  frame - Where to describe the frame
+ *
+ * Returns:
+ *  0 on success, ENODATA if the buffer ends before the frame does, EBADMSG
+ *  if `buf` doesn't start with a valid frame.
+ *
+ ****************************************************************************/
+
+int frame_parse(const uint8_t *buf, size_t len, struct frame_view_s *frame)
+{
+  struct frame_hdr_s hdr;
+
+  if (len < sizeof(hdr))
+    {
+      return ENODATA;
+    }
+
+  memcpy(&hdr, buf, sizeof(hdr));
+
+  if (hdr.sync != FRAME_SYNC || hdr.len > FRAME_PAYLOAD_MAX)
+    {
+      return EBADMSG;
+    }
+
+  if (len - sizeof(hdr) < hdr.len)
+    {
+      return ENODATA;
+    }
+
+  if (frame_hdr_crc(hdr.type, hdr.len, buf + sizeof(hdr)) != hdr.crc)
+    {
+      return EBADMSG;
+    }
+
+  frame->type = hdr.type;
+  frame->payload = buf + sizeof(hdr);
+  frame->len = hdr.len;
+  return 0;
+}
+
+/****************************************************************************
+ * Name: logseg_init
+ *
+ * Description:
+ *   Initialize the header of a log segment.
+ *
+ * Arguments:
+ *  hdr - The header to initialize
+ *  seqnum - The sequence number of the segment
+ *  boot - The sequence number of the first segment written since boot
+ *  size - The size of the segment in bytes
+ *
+ ****************************************************************************/
+
+void logseg_init(struct logseg_hdr_s *hdr, uint32_t seqnum, uint32_t boot,
+                 uint32_t size)
+{
+  hdr->magic = LOGSEG_MAGIC;
+  hdr->version = LOGSEG_VERSION;
+  hdr->hdrlen = sizeof(*hdr);
+  hdr->seqnum = seqnum;
+  hdr->boot = boot;
+  hdr->size = size;
+  hdr->crc = frame_crc(0, hdr, offsetof(struct logseg_hdr_s, crc));
+}
+
+/****************************************************************************
+ * Name: logseg_parse
+ *
+ * Description:
+ *   Parses and verifies the log segment header at the start of `buf`.
+ *
+ * Arguments:
+ *  buf - The buffer holding the segment
+ *  len - The length of the buffer in bytes
+ *  hdr - Where to copy the header
+ *
+ * Returns:
+ *  0 on success, ENODATA if the buffer is too short, EBADMSG if `buf`
+ *  doesn't start with a valid segment header.
+ *
+ ****************************************************************************/
+
+int logseg_parse(const uint8_t *buf, size_t len, struct logseg_hdr_s *hdr)
+{
+  if (len < sizeof(*hdr))
+    {
+      return ENODATA;
+    }
+
+  memcpy(hdr, buf, sizeof(*hdr));
+
+  if (hdr->magic != LOGSEG_MAGIC || hdr->hdrlen < sizeof(*hdr) ||
+      hdr->crc != frame_crc(0, hdr, offsetof(struct logseg_hdr_s, crc)))
+    {
+      return EBADMSG;
+    }
+
+  if (len < hdr->hdrlen)
+    {
+      return ENODATA;
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: logseg_marks
+ *
+ * Description:
+ *   Finds the time index at the end of a finished log segment. Only the
+ *   tail of the segment is read. Segments that weren't finished, like one
+ *   recovered after power loss, have no index.
+ *
+ * Arguments:
+ *  buf - The buffer holding the whole segment
+ *  len - The length of the segment in bytes
+ *  index - Where to describe the index frame, whose payload is an array of
+ *          `struct frame_mark_s`
+ *
+ * Returns:
+ *  0 on success, ENODATA if the segment has no index.
+ *
+ ****************************************************************************/
+
+int logseg_marks(const uint8_t *buf, size_t len, struct frame_view_s *index)
+{
+  size_t start = 0;
+  struct frame_iter_s it;
+  struct frame_view_s frame;
+
+  if (len > sizeof(struct frame_hdr_s) + FRAME_PAYLOAD_MAX)
+    {
+      start = len - sizeof(struct frame_hdr_s) - FRAME_PAYLOAD_MAX;
+    }
+
+  frame_iter_init(&it, &buf[start], len - start);
+  while (frame_iter_next(&it, &frame) == 0)
+    {
+      if (frame.type == FRAME_INDEX && frame.payload + frame.len == &buf[len])
+        {
+          *index = frame;
+          return 0;
+        }
+    }
+
+  return ENODATA;
+}
+
+/****************************************************************************
+ * Name: frame_iter_init
+ *
+ * Description:
+ *   Prepares to iterate over the frames in a buffer.
+ *
+ * Arguments:
+ *  it - The iterator to initialize
+ *  buf - The buffer of back to back frames
+ *  len - The length of the buffer in bytes
+ *
+ ****************************************************************************/
+
+void frame_iter_init(struct frame_iter_s *it, const void *buf, size_t len)
+{
+  it->pos = buf;
+  it->end = it->pos + len;
+  it->skipped = 0;
+  it->padding = 0;
+}
+
+/****************************************************************************
+ * Name: frame_iter_next
+ *
+ * Description:
+ *   Gets the next valid frame in the buffer. Corrupted data is skipped up to
+ *   the next sync word that starts a valid frame, and counted in
+ *   `it->skipped`. A frame cut short at the end of the buffer (for example
+ *   by power loss while it was written) is also skipped. Runs of zero bytes
+ *   ending the skipped data, like the padding at the end of a log segment,
+ *   are counted in `it->padding` instead.
+ *
+ * Arguments:
+ *  it - The frame iterator
+ *  frame - Where to describe the frame
+ *
+ * Returns:
+ *  0 on success, ENODATA once the buffer is exhausted.
+ *
+ ****************************************************************************/
+
+int frame_iter_next(struct frame_iter_s *it, struct frame_view_s *frame)
+{
+  const uint8_t *next;
+  size_t zeros;
+  int err;
+
+  while (it->pos < it->end)
+    {
+      err = frame_parse(it->pos, it->end - it->pos, frame);
+      if (err == 0)
+        {
+          it->pos = frame->payload + frame->len;
+          return 0;
+        }
+
+      /* Resynchronize on the next possible sync word */
+
+      next = memchr(it->pos + 1, FRAME_SYNC & 0xff, it->end - it->pos - 1);
+      if (next == NULL)
+        {
+          next = it->end;
+        }
+
+      /* Zeros after a frame cut short are padding or unwritten space */
+
+      zeros = frame_zero_tail(it->pos, next - it->pos);
+      it->padding += zeros;
+      it->skipped += next - it->pos - zeros;
+      it->pos = next;
+    }
+
+  return ENODATA;
+}
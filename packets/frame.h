@@ -0,0 +1,142 @@
+#ifndef _PYGMY_FRAME_H_
+#define _PYGMY_FRAME_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "packets.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* Sync word starting every frame. Stored little endian, so the first byte
+ * (0xa5) is not printable and can't be mistaken for the start of a packet.
+ */
+
+#define FRAME_SYNC 0x5aa5
+
+/* Largest frame payload accepted by readers. Keeps a corrupted length from
+ * making a reader skip far ahead.
+ */
+
+#define FRAME_PAYLOAD_MAX 2048
+
+/* Magic number starting every log segment ("PYLG" in file order) */
+
+#define LOGSEG_MAGIC 0x474c5950
+
+/* Version of the log segment format */
+
+#define LOGSEG_VERSION 1
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Frame types */
+
+enum frame_type_e
+{
+  FRAME_PACKET = 0x1, /* A packet, exactly as it was transmitted */
+  FRAME_LZ = 0x2,     /* Several packets, compressed together */
+  FRAME_INDEX = 0x3,  /* Time index of a log segment */
+};
+
+/* Header of every record in a log file. The CRC-32 covers `type`, `len` and
+ * the payload.
+ */
+
+struct frame_hdr_s
+{
+  uint16_t sync; /* FRAME_SYNC */
+  uint8_t type;  /* Frame type */
+  uint16_t len;  /* Length of the payload in bytes */
+  uint32_t crc;  /* CRC-32 of the frame */
+} PACKED;
+
+/* Header at the start of every log segment file. The segment is filled with
+ * frames after it. Segments have a fixed size; the unused end of a segment
+ * is zero padding. The CRC-32 covers the rest of the header.
+ */
+
+struct logseg_hdr_s
+{
+  uint32_t magic;   /* LOGSEG_MAGIC */
+  uint16_t version; /* LOGSEG_VERSION */
+  uint16_t hdrlen;  /* Length of this header in bytes */
+  uint32_t seqnum;  /* Sequence number of the segment */
+  uint32_t boot;    /* Sequence number of the first segment of the boot */
+  uint32_t size;    /* Size of the segment in bytes, including the header */
+  uint32_t crc;     /* CRC-32 of the header */
+} PACKED;
+
+/* Start of the payload of a FRAME_LZ frame, followed by the LZ compressed
+ * packets (see lz.h). Decompressed, they are back to back, each preceded by
+ * its length as a little endian uint16_t. The times let readers place the
+ * frame without decompressing it.
+ */
+
+struct frame_lz_s
+{
+  uint16_t rawlen;  /* Length of the decompressed data in bytes */
+  pkt_time_t first; /* Mission time of the first packet */
+  pkt_time_t last;  /* Mission time of the last packet */
+} PACKED;
+
+/* Entry of the sparse time index ending a finished log segment. The index
+ * is a FRAME_INDEX frame whose payload is an array of these, in order of
+ * time, and whose end is the end of the segment. It lets readers seek to a
+ * mission time instead of decoding the segment from the start.
+ */
+
+struct frame_mark_s
+{
+  pkt_time_t time; /* Mission time of the first packet in the frame */
+  uint32_t packet; /* Packets in the segment before the frame */
+  uint32_t offset; /* Offset of the frame in the segment */
+} PACKED;
+
+/* A frame found in a buffer. `payload` points into the buffer. */
+
+struct frame_view_s
+{
+  uint8_t type;           /* Frame type */
+  const uint8_t *payload; /* Frame payload */
+  size_t len;             /* Length of the payload in bytes */
+};
+
+/* Iterator over consecutive frames in a buffer */
+
+struct frame_iter_s
+{
+  const uint8_t *pos; /* Next byte to decode */
+  const uint8_t *end; /* End of the buffer */
+  size_t skipped;     /* Bytes skipped while resynchronizing */
+  size_t padding;     /* Runs of zero bytes skipped, such as padding */
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void frame_crc_init(void);
+uint32_t frame_crc(uint32_t crc, const void *buf, size_t len);
+
+void frame_init(struct frame_hdr_s *hdr, uint8_t type, const void *payload,
+                size_t len);
+int frame_parse(const uint8_t *buf, size_t len, struct frame_view_s *frame);
+
+void logseg_init(struct logseg_hdr_s *hdr, uint32_t seqnum, uint32_t boot,
+                 uint32_t size);
+int logseg_parse(const uint8_t *buf, size_t len, struct logseg_hdr_s *hdr);
+int logseg_marks(const uint8_t *buf, size_t len, struct frame_view_s *index);
+
+void frame_iter_init(struct frame_iter_s *it, const void *buf, size_t len);
+int frame_iter_next(struct frame_iter_s *it, struct frame_view_s *frame);
+
+#endif /* _PYGMY_FRAME_H_ */
@@ -0,0 +1,315 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "lz.h"
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* The compressed format is the LZ4 block format: a sequence of literal runs
+ * each followed by a match (a 16 bit little endian offset back into the
+ * output and a length). These are its limits.
+ */
+
+#define MINMATCH 4     /* Shortest match */
+#define LASTLITERALS 5 /* Input always ends in at least this many literals */
+#define MFLIMIT 12     /* No match starts within this many bytes of the end */
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: read32
+ ****************************************************************************/
+
+static inline uint32_t read32(const uint8_t *p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+/****************************************************************************
+ * Name: hash
+ ****************************************************************************/
+
+static inline uint32_t hash(uint32_t v)
+{
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+/****************************************************************************
+ * Name: put_length
+ *
+ * Description:
+ *   Writes the part of a length that doesn't fit its 4 bit token field.
+ *
+ * Returns:
+ *   The new output position, or NULL if the output is full.
+ ****************************************************************************/
+
+static uint8_t *put_length(uint8_t *op, const uint8_t *end, size_t len)
+{
+  if (len < 15)
+    {
+      return op;
+    }
+
+  for (len -= 15; len >= 255; len -= 255)
+    {
+      if (op == end) return NULL;
+      *op++ = 255;
+    }
+
+  if (op == end) return NULL;
+  *op++ = len;
+  return op;
+}
+
+/****************************************************************************
+ * Name: put_sequence
+ *
+ * Description:
+ *   Writes a run of literals followed by a match of `mlen` bytes `offset`
+ *   bytes back. A match length of zero writes only the literals, which ends
+ *   the compressed data.
+ *
+ * Returns:
+ *   The new output position, or NULL if the output is full.
+ ****************************************************************************/
+
+static uint8_t *put_sequence(uint8_t *op, const uint8_t *end,
+                             const uint8_t *lit, size_t litlen,
+                             uint16_t offset, size_t mlen)
+{
+  uint8_t *token = op;
+
+  if (op == end) return NULL;
+  op++;
+
+  *token = (litlen < 15 ? litlen : 15) << 4;
+  op = put_length(op, end, litlen);
+  if (op == NULL || (size_t)(end - op) < litlen) return NULL;
+
+  memcpy(op, lit, litlen);
+  op += litlen;
+
+  if (mlen == 0)
+    {
+      return op;
+    }
+
+  mlen -= MINMATCH;
+  *token |= mlen < 15 ? mlen : 15;
+
+  if (end - op < 2) return NULL;
+  *op++ = offset & 0xff;
+  *op++ = offset >> 8;
+
+  return put_length(op, end, mlen);
+}
+
+/****************************************************************************
+ * Name: get_length
+ *
+ * Description:
+ *   Reads the rest of a length whose 4 bit token field was saturated.
+ *
+ * Returns:
+ *   False if the input ends first.
+ ****************************************************************************/
+
+static bool get_length(const uint8_t **ip, const uint8_t *end, size_t *len)
+{
+  uint8_t b;
+
+  if (*len < 15)
+    {
+      return true;
+    }
+
+  do
+    {
+      if (*ip == end) return false;
+      b = *(*ip)++;
+      *len += b;
+    }
+  while (b == 255);
+
+  return true;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: lz_compress
+ *
+ * Description:
+ *   Compresses a block of data on its own, without reference to anything
+ *   compressed before, so every block can be decompressed independently.
+ *   Matches are found greedily through a small hash table, which keeps the
+ *   compressor fast and its memory use fixed.
+ *
+ * Arguments:
+ *  src - The data to compress
+ *  len - The length of the data in bytes, at most LZ_INPUT_MAX
+ *  dst - Where to put the compressed data
+ *  cap - The size of `dst`. LZ_BOUND(len) bytes are always enough.
+ *  table - Scratch space of LZ_TABLE_LEN entries
+ *
+ * Returns:
+ *  The length of the compressed data, or 0 if it didn't fit in `dst`.
+ *
+ ****************************************************************************/
+
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                   uint16_t *table)
+{
+  const uint8_t *end = dst + cap;
+  uint8_t *op = dst;
+  size_t anchor = 0;
+  size_t ip = 0;
+  size_t ref;
+  size_t mlen;
+  uint32_t h;
+
+  if (len > LZ_INPUT_MAX)
+    {
+      return 0;
+    }
+
+  memset(table, 0, LZ_TABLE_LEN * sizeof(table[0]));
+
+  while (ip + MFLIMIT <= len)
+    {
+      h = hash(read32(&src[ip]));
+      ref = table[h];
+      table[h] = ip;
+
+      /* Empty table entries point at the start, so always check the bytes */
+
+      if (ref >= ip || read32(&src[ref]) != read32(&src[ip]))
+        {
+          ip++;
+          continue;
+        }
+
+      mlen = MINMATCH;
+      while (ip + mlen + LASTLITERALS < len &&
+             src[ref + mlen] == src[ip + mlen])
+        {
+          mlen++;
+        }
+
+      op = put_sequence(op, end, &src[anchor], ip - anchor, ip - ref, mlen);
+      if (op == NULL)
+        {
+          return 0;
+        }
+
+      ip += mlen;
+      anchor = ip;
+    }
+
+  op = put_sequence(op, end, &src[anchor], len - anchor, 0, 0);
+  return op == NULL ? 0 : op - dst;
+}
+
+/****************************************************************************
+ * Name: lz_decompress
+ *
+ * Description:
+ *   Decompresses a block compressed with `lz_compress` (or any LZ4 block
+ *   compressor). Corrupt input is detected rather than read or written out
+ *   of bounds.
+ *
+ * Arguments:
+ *  src - The compressed data
+ *  len - The length of the compressed data in bytes
+ *  dst - Where to put the decompressed data
+ *  cap - The size of `dst`
+ *  outlen - Where to store the length of the decompressed data
+ *
+ * Returns:
+ *  0 on success, EBADMSG if the data is corrupt or doesn't fit in `dst`.
+ *
+ ****************************************************************************/
+
+int lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                  size_t *outlen)
+{
+  const uint8_t *ip = src;
+  const uint8_t *end = src + len;
+  uint8_t *op = dst;
+  uint8_t token;
+  size_t litlen;
+  size_t mlen;
+  size_t offset;
+
+  /* `ip` and `op` never pass the end of their buffers, so the space left in
+   * them is never negative and is compared as a size
+   */
+
+  while (ip < end)
+    {
+      token = *ip++;
+
+      litlen = token >> 4;
+      if (!get_length(&ip, end, &litlen) || (size_t)(end - ip) < litlen ||
+          (size_t)(dst + cap - op) < litlen)
+        {
+          return EBADMSG;
+        }
+
+      memcpy(op, ip, litlen);
+      ip += litlen;
+      op += litlen;
+
+      /* The last sequence has no match */
+
+      if (ip == end)
+        {
+          break;
+        }
+
+      if (end - ip < 2)
+        {
+          return EBADMSG;
+        }
+
+      offset = ip[0] | ip[1] << 8;
+      ip += 2;
+
+      mlen = token & 0xf;
+      if (!get_length(&ip, end, &mlen))
+        {
+          return EBADMSG;
+        }
+
+      mlen += MINMATCH;
+      if (offset == 0 || offset > (size_t)(op - dst) ||
+          (size_t)(dst + cap - op) < mlen)
+        {
+          return EBADMSG;
+        }
+
+      /* Matches may overlap their own output, so copy bytewise */
+
+      for (size_t i = 0; i < mlen; i++, op++)
+        {
+          *op = op[-offset];
+        }
+    }
+
+  *outlen = op - dst;
+  return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef _PYGMY_LZ_H_
+#define _PYGMY_LZ_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+/****************************************************************************
+ * Pre-processor definitions
+ ****************************************************************************/
+
+/* Size of the compressor's match table, as a power of two. The table holds
+ * one uint16_t per entry.
+ */
+
+#define LZ_HASH_BITS 10
+#define LZ_TABLE_LEN (1 << LZ_HASH_BITS)
+
+/* Largest input a single call can compress */
+
+#define LZ_INPUT_MAX 65535
+
+/* Largest compressed size of `n` bytes of input, for sizing buffers */
+
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+size_t lz_compress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                   uint16_t *table);
+int lz_decompress(const uint8_t *src, size_t len, uint8_t *dst, size_t cap,
+                  size_t *outlen);
+
+#endif /* _PYGMY_LZ_H_ */
@@ -7,6 +7,8 @@
 #include <string.h>
 
 #include "../packets/packets.h"
+#include "altitude.h"
+#include "fixedpoint.h"
 
 /****************************************************************************
  * Pre-processor definitions
@@ -15,12 +17,65 @@
 #define us_to_ms(us) ((us) / 1000)
 
 #define RADS_TO_DEG (180.0f / M_PI)
-#define PRESS_SEA_LVL 101325
+
+/* Scale factors from uORB units to packet units */
+
+#define ACCEL_SCALE 100.0f               /* m/s^2 to cm/s^2 */
+#define GYRO_SCALE (RADS_TO_DEG * 10.0f) /* rad/s to 0.1dps */
+#define MAG_SCALE 10.0f                  /* uT to 0.1uT */
+
+/* Converts a sensor reading to a saturated int16_t packet value */
+
+#ifdef CONFIG_PYGMY_FIXED_CONVERSION
+#define convert16(value, scale) fixed_convert16((value), fixed_scale(scale))
+#else
+#define convert16(value, scale) float_convert16((value), (scale))
+#endif
 
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
 
+/****************************************************************************
+ * Name: zigzag
+ *
+ * Description:
+ *   Maps signed integers to unsigned so that small magnitudes stay small:
+ *   0, -1, 1, -2, 2, ... become 0, 1, 2, 3, 4, ...
+ *
+ ****************************************************************************/
+
+static uint32_t zigzag(int32_t value)
+{
+  return ((uint32_t)value << 1) ^ (uint32_t)(value >> 31);
+}
+
+/****************************************************************************
+ * Name: varint_put
+ *
+ * Description:
+ *   Encodes an unsigned LEB128 varint: 7 bits per byte, least significant
+ *   first, with the top bit set on all but the last byte.
+ *
+ * Returns:
+ *   The number of bytes written (at most 5)
+ *
+ ****************************************************************************/
+
+static size_t varint_put(uint8_t *buf, uint32_t value)
+{
+  size_t len = 0;
+
+  while (value >= 0x80)
+    {
+      buf[len++] = (value & 0x7f) | 0x80;
+      value >>= 7;
+    }
+
+  buf[len++] = value;
+  return len;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -31,7 +86,8 @@
  * Description:
  *   Initialize a packet header with a call sign and sequence number.
  *   If `callsign` is too long, it will be truncated. If `callsign` is too
- *   short, it will be 0 post-padded.
+ *   short, it will be 0 post-padded. The base time is filled in by the
+ *   first block pushed to the packet.
  *
  ****************************************************************************/
 
@@ -40,6 +96,8 @@ void packet_header_init(struct packet_hdr_s *hdr, char *callsign, uint8_t num)
   int len;
 
   hdr->num = num;
+  hdr->version = PACKET_VERSION_FLAG | PACKET_VERSION;
+  hdr->time = 0;
 
   /* Get the length of the call sign. It will be truncated if no null
    * terminator */
@@ -128,32 +186,55 @@ int packet_push(struct packet_s *pkt, const void *buf, size_t nbytes)
  * Name: packet_push_block
  *
  * Description:
- *   Append a block to the radio packet.
+ *   Append a block to the radio packet. The packet must already start with
+ *   a header. The first block's time becomes the packet's base time, and
+ *   every block stores its time as an offset from it.
  *
  * Arguments:
  *  pkt - The packet to append to
  *  kind - The block type
+ *  time - The mission time of the block
  *  block - The block to append
  *  nbytes - The length of the block to append in bytes
  *
  * Returns:
  *  0 on success, ENOMEM if insufficient space is available in the
- *  packet.
+ *  packet, ERANGE if `time` is too far from the packet's base time.
  *
  ****************************************************************************/
 
 int packet_push_block(struct packet_s *pkt, const uint8_t kind,
-                      const void *block, size_t nbytes)
+                      pkt_time_t time, const void *block, size_t nbytes)
 {
-  if (pkt->len + nbytes + sizeof(kind) > CONFIG_PYGMY_PACKET_MAXLEN)
+  struct packet_hdr_s *hdr = (struct packet_hdr_s *)pkt->contents;
+  struct block_hdr_s blk_hdr;
+  int32_t offset;
+
+  if (pkt->len + nbytes + sizeof(blk_hdr) > CONFIG_PYGMY_PACKET_MAXLEN)
     {
       return ENOMEM;
     }
 
+  /* The first block sets the base time */
+
+  if (pkt->len == sizeof(struct packet_hdr_s))
+    {
+      hdr->time = time;
+    }
+
+  offset = (int32_t)(time - hdr->time);
+  if (offset < BLOCK_OFFSET_MIN || offset > BLOCK_OFFSET_MAX)
+    {
+      return ERANGE;
+    }
+
+  blk_hdr.kind = kind;
+  blk_hdr.offset = offset;
+
   /* NOTE: cannot get to this point if there isn't enough room left, so errors
    * can be ignored */
 
-  packet_push(pkt, &kind, sizeof(kind));
+  packet_push(pkt, &blk_hdr, sizeof(blk_hdr));
   packet_push(pkt, block, nbytes);
   return 0;
 }
@@ -168,12 +249,15 @@ int packet_push_block(struct packet_s *pkt, const uint8_t kind,
  *  blk - The pressure block to initialize
  *  data - The uORB barometric data to initialize with
  *
+ * Returns:
+ *  The mission time of the block
+ *
  ****************************************************************************/
 
-void block_init_pressure(press_p *blk, struct sensor_baro *data)
+pkt_time_t block_init_pressure(press_p *blk, struct sensor_baro *data)
 {
-  blk->time = us_to_ms(data->timestamp);
   blk->press = (int32_t)(data->pressure * 100.0f);
+  return us_to_ms(data->timestamp);
 }
 
 /****************************************************************************
@@ -186,103 +270,109 @@ void block_init_pressure(press_p *blk, struct sensor_baro *data)
  *  blk - The temperature block to initialize
  *  data - The uORB barometric data to initialize with
  *
+ * Returns:
+ *  The mission time of the block
+ *
  ****************************************************************************/
 
-void block_init_temp(temp_p *blk, struct sensor_baro *data)
+pkt_time_t block_init_temp(temp_p *blk, struct sensor_baro *data)
 {
-  blk->time = us_to_ms(data->timestamp);
   blk->temp = (int32_t)(data->temperature * 1000.0f);
+  return us_to_ms(data->timestamp);
 }
 
 /****************************************************************************
  * Name: block_init_alt
  *
  * Description:
- *   Initialize a altitude block
+ *   Initialize a altitude block. The altitude is relative to the reference
+ *   pressure last given to `altitude_init`.
  *
  * Arguments:
  *  blk - The altitude block to initialize
  *  data - The uORB barometric data to initialize with
  *
+ * Returns:
+ *  The mission time of the block
+ *
  ****************************************************************************/
 
-void block_init_alt(alt_p *blk, struct sensor_baro *data)
+pkt_time_t block_init_alt(alt_p *blk, struct sensor_baro *data)
 {
-  blk->time = us_to_ms(data->timestamp);
-
-  /*
-   * Derivation from pressure at altitude above sea level.
-   * p/101325 = (1 - 2.25577 × 10-5 h)^5.25588
-   * ln(p/101325) = 5.25588ln(1 - 2.25577 × 10-5 h)
-   * ln(p/101325) / 5.25588 = ln(1 - 2.25577 × 10-5 h)
-   * e^(ln(p/101325) / 5.25588) = 1 - 2.25577 × 10-5 h
-   * 1 - e^(ln(p/101325) / 5.25588) = 2.25577 × 10-5 h
-   *
-   * (1 - e^(ln(p/101325) / 5.25588)) / 2.25577 × 10-5 = h
-   */
-
-  double exponent = log(data->pressure * 100 / PRESS_SEA_LVL) / 5.22588;
-  blk->alt = (1 - pow(M_E, exponent)) / (2.255577e-5);
+  blk->alt = altitude_cm(
+      (uint32_t)(data->pressure * (100.0f * (1 << ALT_PRESS_FRACBITS))));
+  return us_to_ms(data->timestamp);
 }
 
 /****************************************************************************
  * Name: block_init_accel
  *
  * Description:
- *   Initialize an acceleration block
+ *   Initialize an acceleration block. Readings beyond the int16_t range
+ *   saturate.
  *
  * Arguments:
  *  blk - The acceleration block to initialize
  *  data - The uORB acceleration data to initialize with
  *
+ * Returns:
+ *  The mission time of the block
+ *
  ****************************************************************************/
 
-void block_init_accel(accel_p *blk, struct sensor_accel *data)
+pkt_time_t block_init_accel(accel_p *blk, struct sensor_accel *data)
 {
-  blk->time = us_to_ms(data->timestamp);
-  blk->x = (int16_t)(data->x * 100.0f);
-  blk->y = (int16_t)(data->y * 100.0f);
-  blk->z = (int16_t)(data->z * 100.0f);
+  blk->x = convert16(data->x, ACCEL_SCALE);
+  blk->y = convert16(data->y, ACCEL_SCALE);
+  blk->z = convert16(data->z, ACCEL_SCALE);
+  return us_to_ms(data->timestamp);
 }
 
 /****************************************************************************
  * Name: block_init_gyro
  *
  * Description:
- *   Initialize a gyro block
+ *   Initialize a gyro block. Readings beyond the int16_t range saturate.
  *
  * Arguments:
  *  blk - The gyro block to initialize
  *  data - The uORB gyro data to initialize with
  *
+ * Returns:
+ *  The mission time of the block
+ *
  ****************************************************************************/
 
-void block_init_gyro(gyro_p *blk, struct sensor_gyro *data)
+pkt_time_t block_init_gyro(gyro_p *blk, struct sensor_gyro *data)
 {
-  blk->time = us_to_ms(data->timestamp);
-  blk->x = (int16_t)(data->x * RADS_TO_DEG * 10.0f);
-  blk->y = (int16_t)(data->y * RADS_TO_DEG * 10.0f);
-  blk->z = (int16_t)(data->z * RADS_TO_DEG * 10.0f);
+  blk->x = convert16(data->x, GYRO_SCALE);
+  blk->y = convert16(data->y, GYRO_SCALE);
+  blk->z = convert16(data->z, GYRO_SCALE);
+  return us_to_ms(data->timestamp);
 }
 
 /****************************************************************************
  * Name: block_init_mag
  *
  * Description:
- *   Initialize a magnetometer block
+ *   Initialize a magnetometer block. Readings beyond the int16_t range
+ *   saturate.
  *
  * Arguments:
  *  blk - The magnetometer block to initialize
  *  data - The uORB magnetometer data to initialize with
  *
+ * Returns:
+ *  The mission time of the block
+ *
  ****************************************************************************/
 
-void block_init_mag(mag_p *blk, struct sensor_mag *data)
+pkt_time_t block_init_mag(mag_p *blk, struct sensor_mag *data)
 {
-  blk->time = us_to_ms(data->timestamp);
-  blk->x = (int16_t)(data->x * RADS_TO_DEG * 10.0f);
-  blk->y = (int16_t)(data->y * RADS_TO_DEG * 10.0f);
-  blk->z = (int16_t)(data->z * RADS_TO_DEG * 10.0f);
+  blk->x = convert16(data->x, MAG_SCALE);
+  blk->y = convert16(data->y, MAG_SCALE);
+  blk->z = convert16(data->z, MAG_SCALE);
+  return us_to_ms(data->timestamp);
 }
 
 /****************************************************************************
@@ -299,7 +389,6 @@ void block_init_mag(mag_p *blk, struct sensor_mag *data)
 
 void block_init_volt(volt_p *blk, uint16_t voltage)
 {
-  blk->time = 0; /* TODO: implement */
   blk->voltage = voltage;
 }
 
@@ -313,11 +402,148 @@ void block_init_volt(volt_p *blk, uint16_t voltage)
  *  blk - The coordinate block to initialize
  *  data - The uORB GNSS data block
  *
+ * Returns:
+ *  The mission time of the block
+ *
  ****************************************************************************/
 
-void block_init_coord(coord_p *blk, struct sensor_gnss *data)
+pkt_time_t block_init_coord(coord_p *blk, struct sensor_gnss *data)
 {
-  blk->time = us_to_ms(data->timestamp);
   blk->lat = (int32_t)(data->latitude * 1000000);
   blk->lon = (int32_t)(data->longitude * 1000000);
+  return us_to_ms(data->timestamp);
+}
+
+/****************************************************************************
+ * Name: batch_init
+ *
+ * Description:
+ *   Initialize an empty batch block.
+ *
+ * Arguments:
+ *  batch - The batch to initialize
+ *  kind - The block kind of the samples that will be batched
+ *
+ ****************************************************************************/
+
+void batch_init(struct batch_s *batch, uint8_t kind)
+{
+  batch_p *hdr = (batch_p *)batch->contents;
+
+  hdr->kind = kind;
+  hdr->count = 0;
+  hdr->len = 0;
+  batch->len = sizeof(batch_p);
+}
+
+/****************************************************************************
+ * Name: batch_push
+ *
+ * Description:
+ *   Append a sample to a batch block.
+ *
+ * Arguments:
+ *  batch - The batch to append to
+ *  time - The mission time of the sample
+ *  x, y, z - The sample
+ *
+ * Returns:
+ *  0 on success, ENOMEM if the batch is full.
+ *
+ ****************************************************************************/
+
+int batch_push(struct batch_s *batch, pkt_time_t time, int16_t x, int16_t y,
+               int16_t z)
+{
+  batch_p *hdr = (batch_p *)batch->contents;
+  uint8_t *enc = &batch->contents[batch->len];
+
+  if (batch_full(batch))
+    {
+      return ENOMEM;
+    }
+
+  /* The first sample is stored in full */
+
+  if (hdr->count == 0)
+    {
+      batch->start = time;
+      hdr->x = x;
+      hdr->y = y;
+      hdr->z = z;
+    }
+
+  /* The others as differences from the previous sample */
+
+  else
+    {
+      enc += varint_put(enc, zigzag((int32_t)(time - batch->time)));
+      enc += varint_put(enc, zigzag(x - batch->last[0]));
+      enc += varint_put(enc, zigzag(y - batch->last[1]));
+      enc += varint_put(enc, zigzag(z - batch->last[2]));
+
+      hdr->len += enc - &batch->contents[batch->len];
+      batch->len = sizeof(batch_p) + hdr->len;
+    }
+
+  hdr->count++;
+  batch->time = time;
+  batch->last[0] = x;
+  batch->last[1] = y;
+  batch->last[2] = z;
+  return 0;
+}
+
+/****************************************************************************
+ * Name: batch_full
+ *
+ * Description:
+ *   Checks if a batch block can't take any more samples, either because it
+ *   holds `CONFIG_PYGMY_BATCH_NSAMPLES` samples or because another sample
+ *   might not fit.
+ *
+ ****************************************************************************/
+
+bool batch_full(const struct batch_s *batch)
+{
+  const batch_p *hdr = (const batch_p *)batch->contents;
+
+  return hdr->count >= CONFIG_PYGMY_BATCH_NSAMPLES ||
+         batch->len + BATCH_SAMPLE_MAXLEN > BATCH_MAXLEN;
+}
+
+/****************************************************************************
+ * Name: batch_empty
+ *
+ * Description:
+ *   Checks if a batch block holds no samples.
+ *
+ ****************************************************************************/
+
+bool batch_empty(const struct batch_s *batch)
+{
+  return ((const batch_p *)batch->contents)->count == 0;
+}
+
+/****************************************************************************
+ * Name: packet_push_batch
+ *
+ * Description:
+ *   Append a batch block to the radio packet. The batch is left untouched,
+ *   so it must be re-initialized before being reused.
+ *
+ * Arguments:
+ *  pkt - The packet to append to
+ *  batch - The batch to append
+ *
+ * Returns:
+ *  0 on success, ENOMEM if insufficient space is available in the
+ *  packet, ERANGE if the batch is too old for the packet.
+ *
+ ****************************************************************************/
+
+int packet_push_batch(struct packet_s *pkt, struct batch_s *batch)
+{
+  return packet_push_block(pkt, PACKET_BATCH, batch->start, batch->contents,
+                           batch->len);
 }
@@ -5,6 +5,7 @@
  * Included Files
  ****************************************************************************/
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <string.h>
 
@@ -24,16 +25,73 @@
 #define CONFIG_PYGMY_PACKET_MAXLEN 255
 #endif
 
+/* Maximum number of samples in a batch block */
+
+#ifndef CONFIG_PYGMY_BATCH_NSAMPLES
+#define CONFIG_PYGMY_BATCH_NSAMPLES 16
+#endif
+
+/* Maximum length of a batch block in bytes. Limited to half a packet so
+ * there is always room for one in a fresh packet.
+ */
+
+#if CONFIG_PYGMY_PACKET_MAXLEN / 2 < 128
+#define BATCH_MAXLEN (CONFIG_PYGMY_PACKET_MAXLEN / 2)
+#else
+#define BATCH_MAXLEN 128
+#endif
+
+/* Worst case length of an encoded batch sample: four 32 bit varints */
+
+#define BATCH_SAMPLE_MAXLEN (4 * 5)
+
+/* A batch must fit a batch_p (9 bytes) and at least one more sample */
+
+#if BATCH_MAXLEN < 9 + BATCH_SAMPLE_MAXLEN
+#error "CONFIG_PYGMY_PACKET_MAXLEN is too small for batch blocks"
+#endif
+
+/* Packet format version. Version 1 packets have no version field: their
+ * header is only the call sign and rolling counter, and every block carries
+ * its own 32 bit mission time. From version 2, the byte after the rolling
+ * counter holds the version with the top bit set, which can't be mistaken
+ * for a version 1 block kind.
+ */
+
+#define PACKET_VERSION 2
+#define PACKET_VERSION_FLAG 0x80
+
+/* Limits of a block's time offset from the packet's base time */
+
+#define BLOCK_OFFSET_MIN INT16_MIN
+#define BLOCK_OFFSET_MAX INT16_MAX
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 
+/* Packet time field (time since boot in milliseconds) */
+
+typedef uint32_t pkt_time_t;
+
 /* Header sent with all packets */
 
 struct packet_hdr_s
 {
   char callsign[CONFIG_PYGMY_CALLSIGN_LEN]; /* Call sign */
   uint8_t num;                              /* Rolling counter */
+  uint8_t version;                          /* Format version | flag */
+  pkt_time_t time;                          /* Base mission time */
+} PACKED;
+
+/* Header sent with every block. The block's mission time is the packet's
+ * base time plus `offset`.
+ */
+
+struct block_hdr_s
+{
+  uint8_t kind;   /* Block type */
+  int16_t offset; /* Time since the packet base time in milliseconds */
 } PACKED;
 
 /* Packet representation. */
@@ -44,29 +102,27 @@ struct packet_s
   size_t len;        /* Packet length in bytes */
 };
 
-/* Packet time field (time since boot in milliseconds) */
-
-typedef uint32_t pkt_time_t;
-
 /* Packet types */
 
 typedef enum
 {
-  PACKET_PRESS = 0x0, /* Pressure in Pa */
-  PACKET_TEMP = 0x1,  /* Temperature in millidegrees C */
-  PACKET_ALT = 0x2,   /* Altitude in centimetres */
-  PACKET_COORD = 0x3, /* Coordinates in 0.1 micro degrees (10^-7) */
-  PACKET_ACCEL = 0x4, /* Linear acceleration in cm/s^2 */
-  PACKET_GYRO = 0x5,  /* Angular velocity in 0.1dps */
-  PACKET_MAG = 0x6,   /* Magnetic field in 0.1 uTesla */
-  PACKET_VOLT = 0x7,  /* Battery voltage in millivolts */
+  PACKET_PRESS = 0x0,   /* Pressure in Pa */
+  PACKET_TEMP = 0x1,    /* Temperature in millidegrees C */
+  PACKET_ALT = 0x2,     /* Altitude in centimetres */
+  PACKET_COORD = 0x3,   /* Coordinates in 0.1 micro degrees (10^-7) */
+  PACKET_ACCEL = 0x4,   /* Linear acceleration in cm/s^2 */
+  PACKET_GYRO = 0x5,    /* Angular velocity in 0.1dps */
+  PACKET_MAG = 0x6,     /* Magnetic field in 0.1 uTesla */
+  PACKET_VOLT = 0x7,    /* Battery voltage in millivolts */
+  PACKET_BATCH = 0x8,   /* Consecutive samples of one IMU sensor */
+  PACKET_PARITY = 0x9,  /* Parity of a group of radio packets */
+  PACKET_PROFILE = 0xa, /* Upcoming change of radio profile */
 } pkt_kind_e;
 
 /* Coordinate packet */
 
 typedef struct
 {
-  pkt_time_t time; /* Mission time */
   int32_t lat;     /* Latitude in 0.1 micro degrees */
   int32_t lon;     /* Longitude in 0.1 micro degrees */
 } PACKED coord_p;
@@ -75,7 +131,6 @@ typedef struct
 
 typedef struct
 {
-  pkt_time_t time; /* Mission time */
   int32_t press;   /* Pressure in Pa */
 } PACKED press_p;
 
@@ -83,7 +138,6 @@ typedef struct
 
 typedef struct
 {
-  pkt_time_t time; /* Mission time */
   int32_t temp;    /* Temperature in millidegrees C */
 } PACKED temp_p;
 
@@ -91,7 +145,6 @@ typedef struct
 
 typedef struct
 {
-  pkt_time_t time; /* Mission time */
   int32_t alt;     /* Altitude in centimetres */
 } PACKED alt_p;
 
@@ -99,7 +152,6 @@ typedef struct
 
 typedef struct
 {
-  pkt_time_t time; /* Mission time */
   int16_t x;       /* Acceleration in x in cm/s^2 */
   int16_t y;       /* Acceleration in y in cm/s^2 */
   int16_t z;       /* Acceleration in z in cm/s^2 */
@@ -109,7 +161,6 @@ typedef struct
 
 typedef struct
 {
-  pkt_time_t time; /* Mission time */
   int16_t x;       /* Angular velocity in x in 0.1dps */
   int16_t y;       /* Angular velocity in y in 0.1dps */
   int16_t z;       /* Angular velocity in z in 0.1dps */
@@ -119,7 +170,6 @@ typedef struct
 
 typedef struct
 {
-  pkt_time_t time; /* Mission time */
   int16_t x;       /* Magnetic field in x in 0.1uT */
   int16_t y;       /* Magnetic field in y in 0.1uT */
   int16_t z;       /* Magnetic field in z in 0.1uT */
@@ -129,10 +179,84 @@ typedef struct
 
 typedef struct
 {
-  pkt_time_t time;  /* Mission time */
   uint16_t voltage; /* Battery voltage in millivolts */
 } PACKED volt_p;
 
+/* Batch packet. Holds consecutive samples of one kind of accel_p, gyro_p or
+ * mag_p block. The block time is the time of the first sample, which is
+ * stored in full. It is followed by `len` bytes encoding the other
+ * `count - 1` samples, each as the difference from the previous sample in
+ * time, x, y and z. Differences are zig-zag encoded
+ * (0, -1, 1, -2, ... become 0, 1, 2, 3, ...) and then stored as unsigned
+ * LEB128 varints, so small changes take a single byte.
+ */
+
+typedef struct
+{
+  uint8_t kind;    /* Block kind of the samples */
+  uint8_t count;   /* Number of samples in the batch */
+  uint8_t len;     /* Length of the encoded samples after the first */
+  int16_t x;       /* First sample x */
+  int16_t y;       /* First sample y */
+  int16_t z;       /* First sample z */
+} PACKED batch_p;
+
+/* Radio profile notice. Sent in the last `countdown` radio packets before
+ * the radio switches to another profile: the packet with a countdown of 1
+ * is the last one sent with the old settings.
+ */
+
+typedef struct
+{
+  uint8_t profile;   /* Profile switched to */
+  uint8_t spread;    /* Spread factor of the profile */
+  uint8_t countdown; /* Packets left before the switch, this one included */
+} PACKED profile_p;
+
+/* Parity packet. Sent alone in a packet after a group of `count` radio
+ * packets, numbered `stride` apart and ending with the packet numbered like
+ * the parity packet. It is followed by `size` bytes: the XOR of the group's
+ * packets without their call signs, each padded with zeros to `size`
+ * bytes. `len` is the XOR of those packet lengths. Any one lost packet of
+ * the group is the XOR of the parity and all the others.
+ */
+
+typedef struct
+{
+  uint8_t count;   /* Number of packets in the group */
+  uint8_t stride;  /* Difference between consecutive packet numbers */
+  uint8_t len;     /* XOR of the lengths of the packets */
+  uint8_t size;    /* Length of the parity that follows */
+} PACKED parity_p;
+
+/* Batch block under construction */
+
+struct batch_s
+{
+  uint8_t contents[BATCH_MAXLEN]; /* batch_p followed by encoded samples */
+  size_t len;                     /* Length of the block in bytes */
+  pkt_time_t start;               /* Time of the first sample */
+  pkt_time_t time;                /* Time of the last sample */
+  int16_t last[3];                /* Last sample x, y and z */
+};
+
+/****************************************************************************
+ * Inline Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: get_u32
+ *
+ * Description:
+ *   Reads an unaligned little endian 32 bit integer.
+ *
+ ****************************************************************************/
+
+static inline uint32_t get_u32(const uint8_t *buf)
+{
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
 /****************************************************************************
  * Public Function Prototypes
  ****************************************************************************/
@@ -143,15 +267,22 @@ void packet_header_init(struct packet_hdr_s *hdr, char *callsign,
                         uint8_t num);
 int packet_push(struct packet_s *pkt, const void *buf, size_t nbytes);
 int packet_push_block(struct packet_s *pkt, const uint8_t kind,
-                      const void *block, size_t nbytes);
-
-void block_init_pressure(press_p *blk, struct sensor_baro *data);
-void block_init_temp(temp_p *blk, struct sensor_baro *data);
-void block_init_alt(alt_p *blk, struct sensor_baro *data);
-void block_init_accel(accel_p *blk, struct sensor_accel *data);
-void block_init_gyro(gyro_p *blk, struct sensor_gyro *data);
-void block_init_mag(mag_p *blk, struct sensor_mag *data);
+                      pkt_time_t time, const void *block, size_t nbytes);
+
+pkt_time_t block_init_pressure(press_p *blk, struct sensor_baro *data);
+pkt_time_t block_init_temp(temp_p *blk, struct sensor_baro *data);
+pkt_time_t block_init_alt(alt_p *blk, struct sensor_baro *data);
+pkt_time_t block_init_accel(accel_p *blk, struct sensor_accel *data);
+pkt_time_t block_init_gyro(gyro_p *blk, struct sensor_gyro *data);
+pkt_time_t block_init_mag(mag_p *blk, struct sensor_mag *data);
 void block_init_volt(volt_p *blk, uint16_t voltage);
-void block_init_coord(coord_p *blk, struct sensor_gnss *data);
+pkt_time_t block_init_coord(coord_p *blk, struct sensor_gnss *data);
+
+void batch_init(struct batch_s *batch, uint8_t kind);
+int batch_push(struct batch_s *batch, pkt_time_t time, int16_t x, int16_t y,
+               int16_t z);
+bool batch_full(const struct batch_s *batch);
+bool batch_empty(const struct batch_s *batch);
+int packet_push_batch(struct packet_s *pkt, struct batch_s *batch);
 
 #endif /* _PYGMY_PACKET_H_ */
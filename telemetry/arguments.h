@@ -13,6 +13,7 @@
  ****************************************************************************/
 
 #define args_syncro(args) ((struct thread_args_t *)((args)))->syncro
+#define args_radio(args) ((struct thread_args_t *)((args)))->radio
 #define args_config(args) ((struct thread_args_t *)((args)))->config
 
 /****************************************************************************
@@ -21,7 +22,8 @@
 
 struct thread_args_t
 {
-  syncro_t *syncro;               /* Synchronization object */
+  syncro_t *syncro;               /* Log stream synchronization object */
+  syncro_t *radio;                /* Radio stream synchronization object */
   struct configuration_s *config; /* Configuration object */
 };
 
@@ -0,0 +1,300 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "backlog.h"
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Ring of bytes waiting to be written out. Records are copied in whole and
+ * may wrap around the end of the arena. The consumer writes them out
+ * straight from the arena.
+ */
+
+static uint8_t arena[CONFIG_PYGMY_LOG_BACKLOG];
+
+static size_t head;      /* Next byte to fill, only moved by the producer */
+static size_t tail;      /* Next byte to drain, only moved by the consumer */
+static size_t fill;      /* Bytes waiting, protected by `lock` */
+static size_t highwater; /* Most bytes waiting, protected by `lock` */
+static uint32_t drops;   /* Records dropped, protected by `lock` */
+static bool waiting;     /* The consumer is asleep, protected by `lock` */
+
+static pthread_mutex_t lock;
+static pthread_cond_t is_filled;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: ring_write
+ *
+ * Description:
+ *   Copies `nbytes` from `buf` into the arena starting at arena offset `pos`,
+ *   wrapping around the end of the arena.
+ ****************************************************************************/
+
+static void ring_write(size_t pos, const void *buf, size_t nbytes)
+{
+  size_t first = CONFIG_PYGMY_LOG_BACKLOG - pos;
+
+  if (first > nbytes)
+    {
+      first = nbytes;
+    }
+
+  memcpy(&arena[pos], buf, first);
+  memcpy(arena, (const uint8_t *)buf + first, nbytes - first);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: backlog_init
+ *
+ * Description:
+ *   Empties the backlog and resets its statistics.
+ *
+ * Return: 0 on success, errno error code on failure (mutex/cond init)
+ *
+ ****************************************************************************/
+
+int backlog_init(void)
+{
+  int err;
+  pthread_condattr_t attr;
+
+  head = tail = fill = highwater = 0;
+  drops = 0;
+  waiting = false;
+
+  err = pthread_mutex_init(&lock, NULL);
+  if (err) return err;
+
+  /* Timed waits use the monotonic clock, like the rest of the telemetry */
+
+  err = pthread_condattr_init(&attr);
+  if (err) return err;
+
+  err = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  if (err) return err;
+
+  err = pthread_cond_init(&is_filled, &attr);
+  pthread_condattr_destroy(&attr);
+  return err;
+}
+
+/****************************************************************************
+ * Name: backlog_push
+ *
+ * Description:
+ *   Copies a record into the backlog. Records are never split: if the whole
+ *   record doesn't fit, it is dropped. Never waits on the consumer, so a
+ *   stalled consumer can't hold up the producer.
+ *
+ *   NOTE: Only one thread may push.
+ *
+ * Parameters:
+ *   buf - The record to copy
+ *   nbytes - The length of the record in bytes
+ *
+ * Return: 0 on success, ENOMEM if the backlog is too full for the record
+ *
+ ****************************************************************************/
+
+int backlog_push(const void *buf, size_t nbytes)
+{
+  size_t room;
+
+  pthread_mutex_lock(&lock);
+  room = CONFIG_PYGMY_LOG_BACKLOG - fill;
+  if (nbytes > room)
+    {
+      drops++;
+    }
+  pthread_mutex_unlock(&lock);
+
+  if (nbytes > room)
+    {
+      return ENOMEM;
+    }
+
+  /* The consumer only reads the `fill` bytes from `tail`, so copy without
+   * the lock and only publish the new bytes under it
+   */
+
+  ring_write(head, buf, nbytes);
+  head = (head + nbytes) % CONFIG_PYGMY_LOG_BACKLOG;
+
+  pthread_mutex_lock(&lock);
+  fill += nbytes;
+  if (fill > highwater)
+    {
+      highwater = fill;
+    }
+
+  if (waiting)
+    {
+      pthread_cond_signal(&is_filled);
+    }
+  pthread_mutex_unlock(&lock);
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: backlog_drop
+ *
+ * Description:
+ *   Counts a record the producer dropped without pushing it, because it
+ *   found the backlog too full for it and what has to go in before it.
+ *
+ ****************************************************************************/
+
+void backlog_drop(void)
+{
+  pthread_mutex_lock(&lock);
+  drops++;
+  pthread_mutex_unlock(&lock);
+}
+
+/****************************************************************************
+ * Name: backlog_acquire
+ *
+ * Description:
+ *   Sleeps until more than `seen` bytes are waiting in the backlog. Waiting
+ *   bytes stay in the backlog, where the consumer reads them in place with
+ *   `backlog_iov`, until it gives them back with `backlog_release`. Records
+ *   may be split between releases, so the consumer sees the backlog as a
+ *   stream of bytes.
+ *
+ *   NOTE: Only one thread may acquire.
+ *
+ * Parameters:
+ *   seen - Bytes the consumer already acquired and hasn't released
+ *   abstime - When to stop waiting (CLOCK_MONOTONIC), or NULL to wait
+ *             indefinitely
+ *   nbytes - Where to store the number of newly acquired bytes
+ *
+ * Return: 0 on success, ETIMEDOUT if `abstime` passed with nothing new
+ * waiting, errno error code on failure (mutex lock or condition wait)
+ *
+ ****************************************************************************/
+
+int backlog_acquire(size_t seen, const struct timespec *abstime,
+                    size_t *nbytes)
+{
+  int err;
+
+  *nbytes = 0;
+
+  err = pthread_mutex_lock(&lock);
+  if (err) return err;
+
+  waiting = true;
+  while (fill <= seen && err == 0)
+    {
+      if (abstime == NULL)
+        {
+          err = pthread_cond_wait(&is_filled, &lock);
+        }
+      else
+        {
+          err = pthread_cond_timedwait(&is_filled, &lock, abstime);
+        }
+    }
+
+  waiting = false;
+  *nbytes = fill > seen ? fill - seen : 0;
+  pthread_mutex_unlock(&lock);
+
+  /* Bytes pushed as the wait failed are still good to drain */
+
+  return *nbytes == 0 ? err : 0;
+}
+
+/****************************************************************************
+ * Name: backlog_iov
+ *
+ * Description:
+ *   Describes where the first `nbytes` acquired bytes are in the arena. They
+ *   are in two pieces if they wrap around the end of it. The producer never
+ *   touches acquired bytes, so they can be read (or passed to `writev`)
+ *   without the lock.
+ *
+ * Parameters:
+ *   nbytes - Acquired bytes to describe, from the oldest
+ *   iov - Where to describe them
+ *
+ * Return: The number of pieces in `iov`, 1 or 2
+ *
+ ****************************************************************************/
+
+int backlog_iov(size_t nbytes, struct iovec iov[2])
+{
+  size_t first = CONFIG_PYGMY_LOG_BACKLOG - tail;
+
+  iov[0].iov_base = &arena[tail];
+  if (first >= nbytes)
+    {
+      iov[0].iov_len = nbytes;
+      return 1;
+    }
+
+  iov[0].iov_len = first;
+  iov[1].iov_base = arena;
+  iov[1].iov_len = nbytes - first;
+  return 2;
+}
+
+/****************************************************************************
+ * Name: backlog_release
+ *
+ * Description:
+ *   Gives the oldest `nbytes` acquired bytes back to the producer once they
+ *   have been written out (or dropped).
+ *
+ * Parameters:
+ *   nbytes - Acquired bytes to release
+ *
+ ****************************************************************************/
+
+void backlog_release(size_t nbytes)
+{
+  tail = (tail + nbytes) % CONFIG_PYGMY_LOG_BACKLOG;
+
+  pthread_mutex_lock(&lock);
+  fill -= nbytes;
+  pthread_mutex_unlock(&lock);
+}
+
+/****************************************************************************
+ * Name: backlog_stats
+ *
+ * Description:
+ *   Gets a consistent copy of the backlog statistics. Safe to call from any
+ *   thread.
+ *
+ ****************************************************************************/
+
+void backlog_stats(struct backlog_stats_s *stats)
+{
+  pthread_mutex_lock(&lock);
+  stats->size = CONFIG_PYGMY_LOG_BACKLOG;
+  stats->fill = fill;
+  stats->highwater = highwater;
+  stats->drops = drops;
+  pthread_mutex_unlock(&lock);
+}
@@ -0,0 +1,50 @@
+#ifndef _PYGMY_BACKLOG_H_
+#define _PYGMY_BACKLOG_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <time.h>
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Size of the RAM backlog of log frames waiting to be written to flash */
+
+#ifndef CONFIG_PYGMY_LOG_BACKLOG
+#define CONFIG_PYGMY_LOG_BACKLOG 32768
+#endif
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Backlog statistics */
+
+struct backlog_stats_s
+{
+  size_t size;      /* Size of the backlog in bytes */
+  size_t fill;      /* Bytes currently waiting or being written */
+  size_t highwater; /* Most bytes ever waiting at once */
+  uint32_t drops;   /* Records dropped because the backlog was full */
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+int backlog_init(void);
+int backlog_push(const void *buf, size_t nbytes);
+void backlog_drop(void);
+int backlog_acquire(size_t seen, const struct timespec *abstime,
+                    size_t *nbytes);
+int backlog_iov(size_t nbytes, struct iovec iov[2]);
+void backlog_release(size_t nbytes);
+void backlog_stats(struct backlog_stats_s *stats);
+
+#endif // _PYGMY_BACKLOG_H_
@@ -7,19 +7,216 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/statfs.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "../packets/frame.h"
+#include "../packets/lz.h"
 #include "../packets/packets.h"
 #include "arguments.h"
+#include "backlog.h"
+#include "logindex.h"
+#include "logrecover.h"
+#include "logsync.h"
 #include "syncro.h"
 #include "syslogging.h"
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Largest write to the log file, which is written straight from the
+ * backlog
+ */
+
+#ifndef CONFIG_PYGMY_LOG_BUFSIZE
+#define CONFIG_PYGMY_LOG_BUFSIZE 4096
+#endif
+
+/* Longest time a logged packet may wait before it is written out */
+
+#ifndef CONFIG_PYGMY_LOG_FLUSH_MS
+#define CONFIG_PYGMY_LOG_FLUSH_MS 1000
+#endif
+
+/* Bytes of packets compressed together into one log frame. Every group is
+ * compressed on its own, so a damaged frame only loses its own packets.
+ */
+
+#ifndef CONFIG_PYGMY_LOG_LZ_BLOCK
+#define CONFIG_PYGMY_LOG_LZ_BLOCK 1024
+#endif
+
+/* Largest compressed log frame payload */
+
+#define LOG_LZ_PAYLOAD_MAXLEN                                                \
+  (sizeof(struct frame_lz_s) + LZ_BOUND(CONFIG_PYGMY_LOG_LZ_BLOCK))
+
+/* Largest log frame */
+
+#ifdef CONFIG_PYGMY_LOG_COMPRESS
+#if CONFIG_PYGMY_LOG_LZ_BLOCK < CONFIG_PYGMY_PACKET_MAXLEN + 2
+#error "CONFIG_PYGMY_LOG_LZ_BLOCK must fit a packet and its length"
+#endif
+#define LOG_FRAME_MAXLEN (sizeof(struct frame_hdr_s) + LOG_LZ_PAYLOAD_MAXLEN)
+_Static_assert(LOG_LZ_PAYLOAD_MAXLEN <= FRAME_PAYLOAD_MAX,
+               "CONFIG_PYGMY_LOG_LZ_BLOCK is too big to compress into a frame");
+#else
+#define LOG_FRAME_MAXLEN                                                     \
+  (sizeof(struct frame_hdr_s) + CONFIG_PYGMY_PACKET_MAXLEN)
+#endif
+
+/* Size of the log segment files. The log thread pads each segment's share
+ * of the logged stream to exactly fill it, so that frames never straddle
+ * two segments.
+ */
+
+#ifndef CONFIG_PYGMY_LOG_SEGSIZE
+#define CONFIG_PYGMY_LOG_SEGSIZE 1048576
+#endif
+
+#define LOG_SEG_DATALEN (CONFIG_PYGMY_LOG_SEGSIZE - sizeof(struct logseg_hdr_s))
+
+/* Sparse time index ending each segment. A mark is added every this many
+ * packets or this much mission time, whichever comes first, up to
+ * CONFIG_PYGMY_LOG_NMARKS marks. Space for the largest index is kept free
+ * at the end of every segment.
+ */
+
+#ifndef CONFIG_PYGMY_LOG_MARK_PACKETS
+#define CONFIG_PYGMY_LOG_MARK_PACKETS 64
+#endif
+
+#ifndef CONFIG_PYGMY_LOG_MARK_MS
+#define CONFIG_PYGMY_LOG_MARK_MS 1000
+#endif
+
+#ifndef CONFIG_PYGMY_LOG_NMARKS
+#define CONFIG_PYGMY_LOG_NMARKS 128
+#endif
+
+#define LOG_INDEX_MAXLEN                                                     \
+  (sizeof(struct frame_hdr_s) +                                              \
+   CONFIG_PYGMY_LOG_NMARKS * sizeof(struct frame_mark_s))
+
+_Static_assert(LOG_INDEX_MAXLEN <= sizeof(struct frame_hdr_s) +
+                                       FRAME_PAYLOAD_MAX,
+               "CONFIG_PYGMY_LOG_NMARKS is too big for one frame");
+
+/* Bytes of a segment available for log frames */
+
+#define LOG_SEG_FRAMELEN (LOG_SEG_DATALEN - LOG_INDEX_MAXLEN)
+
+#if CONFIG_PYGMY_LOG_SEGSIZE < 2 * CONFIG_PYGMY_LOG_BUFSIZE
+#error "CONFIG_PYGMY_LOG_SEGSIZE must be at least twice CONFIG_PYGMY_LOG_BUFSIZE"
+#endif
+
+/* A partial block is held in the backlog until it fills up */
+
+#if CONFIG_PYGMY_LOG_BACKLOG < 2 * CONFIG_PYGMY_LOG_BUFSIZE
+#error "CONFIG_PYGMY_LOG_BACKLOG must be at least twice CONFIG_PYGMY_LOG_BUFSIZE"
+#endif
+
+/* Most segments the log thread can finish before the log writer rotates out
+ * of the first of them: as many as fit in the backlog, plus the one being
+ * written
+ */
+
+#define LOG_NDONE (CONFIG_PYGMY_LOG_BACKLOG / LOG_SEG_DATALEN + 2)
+
+/* Backlog fill increase worth reporting a new high-water mark for */
+
+#define BACKLOG_REPORT_STEP (CONFIG_PYGMY_LOG_BACKLOG / 8)
+
 /****************************************************************************
  * Private Data
  ****************************************************************************/
 
-struct packet_s *pkt; /* Shared packet pointer */
+/* Frame the packet being logged is consumed into, owned by the log thread */
+
+static uint8_t log_frame[sizeof(struct frame_hdr_s) +
+                         CONFIG_PYGMY_PACKET_MAXLEN];
+
+/* Local copy of the packet being logged */
+
+static struct packet_s log_packet = {
+    .contents = &log_frame[sizeof(struct frame_hdr_s)],
+    .len = 0,
+};
+
+/* Zeros to pad out the end of a segment with, up to its index */
+
+static const uint8_t log_padding[LOG_FRAME_MAXLEN + LOG_INDEX_MAXLEN];
+
+#ifdef CONFIG_PYGMY_LOG_COMPRESS
+/* Group of packets waiting to be compressed into one frame, owned by the
+ * log thread. Each packet is preceded by its length.
+ */
+
+static uint8_t log_raw[CONFIG_PYGMY_LOG_LZ_BLOCK];
+
+static size_t log_raw_len;               /* Bytes in `log_raw` */
+static uint32_t log_raw_packets;         /* Packets in `log_raw` */
+static pkt_time_t log_raw_first;         /* Time of the first packet */
+static pkt_time_t log_raw_last;          /* Time of the last packet */
+static struct timespec log_raw_deadline; /* When the group must be logged */
+
+/* Compressor state and the compressed frame */
+
+static uint16_t log_lz_table[LZ_TABLE_LEN];
+static uint8_t log_lz_frame[LOG_FRAME_MAXLEN];
+#endif
+
+/* Metadata of the segment the log thread is filling */
+
+static struct logindex_entry_s log_seg;
+
+/* Time index of the segment the log thread is filling, laid out as the
+ * frame it is logged in
+ */
+
+static struct
+{
+  struct frame_hdr_s hdr;
+  struct frame_mark_s marks[CONFIG_PYGMY_LOG_NMARKS];
+} PACKED log_index;
+
+static unsigned log_nmarks;       /* Marks in `log_index` */
+static uint32_t log_mark_packets; /* Packets between marks */
+static uint32_t log_mark_ms;      /* Mission time between marks */
+
+/* Metadata of segments the log thread finished, waiting for the log writer
+ * to finish writing them
+ */
+
+static struct logindex_entry_s log_done[LOG_NDONE];
+static unsigned log_done_head; /* Next to add, protected by `log_done_lock` */
+static unsigned log_done_tail; /* Next to take, protected by `log_done_lock` */
+static pthread_mutex_t log_done_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Log writer state, owned by the log writer thread. Frames are left in the
+ * backlog until a whole file system block of them can be written out
+ * straight from it.
+ */
+
+static size_t log_fill;              /* Bytes acquired from the backlog */
+static size_t log_block;             /* Bytes written out at a time */
+static off_t log_offset;             /* Bytes written to the log file */
+static struct timespec log_deadline; /* When staged data must be written */
+
+static int log_spare = -1;  /* Next log segment, created ahead of time */
+static int log_spare_err;   /* Why the spare couldn't be created when idle */
+static unsigned log_boot;   /* Sequence number of this boot's first segment */
+static unsigned log_cur;    /* Sequence number of the current segment */
+static unsigned log_next;   /* Sequence number of the spare segment */
+static bool log_misaligned; /* A segment was cut short */
+static int log_write_err;   /* Why the last write failed, reported once */
 
 /****************************************************************************
  * Private Functions
@@ -36,31 +233,263 @@ struct packet_s *pkt; /* Shared packet pointer */
 static void close_fd(void *arg) { close(*((int *)(arg))); }
 
 /****************************************************************************
- * Name: logfile_next
+ * Name: timespec_before
  *
  * Description:
- *   Closes the currently open file descriptor and re-populates it with a new
- *   one of the next log file. The next log file will have a file-name with
- *   the next sequence number.
+ *   Checks if time `a` comes before time `b`.
+ ****************************************************************************/
+
+static bool timespec_before(const struct timespec *a,
+                            const struct timespec *b)
+{
+  return a->tv_sec < b->tv_sec ||
+         (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+/****************************************************************************
+ * Name: logfile_sync
  *
- *   NOTE: Does not close file descriptor `fd` if it is a negative number.
+ * Description:
+ *   Syncs the log file, reporting how long it took.
  ****************************************************************************/
 
-static int logfile_next(int *fd, unsigned *seqnum)
+static int logfile_sync(int fd)
 {
   int err;
-  char filename[sizeof(CONFIG_PYGMY_TELEM_PWRFS "/") + 25];
+  struct logsync_stats_s stats;
+
+  pydebug("Syncing log file...\n");
+  err = logsync_sync(fd);
+  if (err)
+    {
+      pyerr("Couldn't sync logfile: %d\n", err);
+      return err;
+    }
+
+  logsync_stats(&stats);
+  pydebug("Log file synced in %lu us (max %lu us).\n",
+          (unsigned long)stats.last_us, (unsigned long)stats.max_us);
+  return 0;
+}
+
+/****************************************************************************
+ * Name: flush_deadline
+ *
+ * Description:
+ *   Gets when data logged now must be written out by: after the flush
+ *   interval, but never later than the data would be due for syncing.
+ ****************************************************************************/
 
-  /* Close current file if valid */
+static void flush_deadline(struct timespec *deadline)
+{
+  uint32_t flush_ms;
 
-  if (*fd > 0)
+  flush_ms = logsync_limit_ms();
+  if (flush_ms > CONFIG_PYGMY_LOG_FLUSH_MS)
     {
-      err = close(*fd);
-      if (err < 0)
+      flush_ms = CONFIG_PYGMY_LOG_FLUSH_MS;
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, deadline);
+  deadline->tv_sec += flush_ms / 1000;
+  deadline->tv_nsec += (flush_ms % 1000) * 1000000;
+  if (deadline->tv_nsec >= 1000000000)
+    {
+      deadline->tv_sec++;
+      deadline->tv_nsec -= 1000000000;
+    }
+}
+
+/****************************************************************************
+ * Name: logseg_add
+ *
+ * Description:
+ *   Accounts for a frame of `len` bytes holding `packets` packets, from time
+ *   `first` to `last`, that the log thread pushed into the current segment.
+ ****************************************************************************/
+
+static void logseg_add(size_t len, uint32_t packets, pkt_time_t first,
+                       pkt_time_t last)
+{
+  if (log_seg.packets == 0)
+    {
+      log_seg.first = first;
+    }
+
+  log_seg.packets += packets;
+  log_seg.last = last;
+  log_seg.used += len;
+}
+
+/****************************************************************************
+ * Name: logseg_start
+ *
+ * Description:
+ *   Starts the metadata and time index of a new segment.
+ ****************************************************************************/
+
+static void logseg_start(void)
+{
+  log_seg = (struct logindex_entry_s){0};
+  log_nmarks = 0;
+  log_mark_packets = CONFIG_PYGMY_LOG_MARK_PACKETS;
+  log_mark_ms = CONFIG_PYGMY_LOG_MARK_MS;
+}
+
+/****************************************************************************
+ * Name: logseg_mark
+ *
+ * Description:
+ *   Adds the frame about to be pushed into the current segment, starting
+ *   with a packet from time `time`, to the segment's time index if enough
+ *   packets or time passed since the last mark.
+ ****************************************************************************/
+
+static void logseg_mark(pkt_time_t time)
+{
+  unsigned i;
+
+  if (log_nmarks > 0 &&
+      log_seg.packets - log_index.marks[log_nmarks - 1].packet <
+          log_mark_packets &&
+      time - log_index.marks[log_nmarks - 1].time < log_mark_ms)
+    {
+      return;
+    }
+
+  /* Once the index is full, keep every other mark and space marks twice as
+   * far apart, so the index covers the whole segment however slowly it
+   * fills
+   */
+
+  if (log_nmarks == CONFIG_PYGMY_LOG_NMARKS)
+    {
+      for (i = 0; 2 * i < log_nmarks; i++)
         {
-          return errno;
+          log_index.marks[i] = log_index.marks[2 * i];
         }
+
+      log_nmarks = i;
+      log_mark_packets *= 2;
+      log_mark_ms *= 2;
+    }
+
+  log_index.marks[log_nmarks].time = time;
+  log_index.marks[log_nmarks].packet = log_seg.packets;
+  log_index.marks[log_nmarks].offset =
+      sizeof(struct logseg_hdr_s) + log_seg.used;
+  log_nmarks++;
+}
+
+/****************************************************************************
+ * Name: logseg_finish
+ *
+ * Description:
+ *   Pads out the current segment and ends it with its time index.
+ *
+ * Returns:
+ *   0 on success, ENOMEM if the backlog is too full for both.
+ ****************************************************************************/
+
+static int logseg_finish(void)
+{
+  size_t len = log_nmarks * sizeof(struct frame_mark_s);
+  size_t pad = LOG_SEG_DATALEN - log_seg.used - sizeof(log_index.hdr) - len;
+  struct backlog_stats_s stats;
+
+  /* Only this thread pushes, so room found now is still there for both */
+
+  backlog_stats(&stats);
+  if (stats.size - stats.fill < pad + sizeof(log_index.hdr) + len)
+    {
+      return ENOMEM;
+    }
+
+  frame_init(&log_index.hdr, FRAME_INDEX, log_index.marks, len);
+  backlog_push(log_padding, pad);
+  backlog_push(&log_index, sizeof(log_index.hdr) + len);
+  return 0;
+}
+
+/****************************************************************************
+ * Name: logseg_done
+ *
+ * Description:
+ *   Hands the metadata of the segment the log thread just finished to the
+ *   log writer, and starts a new one.
+ ****************************************************************************/
+
+static void logseg_done(void)
+{
+  pthread_mutex_lock(&log_done_lock);
+  log_done[log_done_head % LOG_NDONE] = log_seg;
+  log_done_head++;
+  pthread_mutex_unlock(&log_done_lock);
+
+  logseg_start();
+}
+
+/****************************************************************************
+ * Name: logseg_index
+ *
+ * Description:
+ *   Adds the segment the log writer just finished to the log index, using
+ *   the metadata the log thread handed over for it.
+ ****************************************************************************/
+
+static void logseg_index(void)
+{
+  struct logindex_entry_s entry;
+  bool found;
+
+  pthread_mutex_lock(&log_done_lock);
+  found = log_done_tail != log_done_head;
+  if (found)
+    {
+      entry = log_done[log_done_tail % LOG_NDONE];
+      log_done_tail++;
     }
+  pthread_mutex_unlock(&log_done_lock);
+
+  /* Once a segment was cut short by the file system, segments no longer
+   * line up with what the log thread finished
+   */
+
+  if (!found || log_misaligned)
+    {
+      pywarn("No metadata for log segment %u.\n", log_cur);
+      return;
+    }
+
+  entry.seqnum = log_cur;
+  entry.boot = log_boot;
+  logindex_add(&entry);
+}
+
+/****************************************************************************
+ * Name: logfile_prepare
+ *
+ * Description:
+ *   Creates the log segment with the next sequence number as the spare
+ *   segment, ready for rotating into. The segment is extended to its full
+ *   size up front where the file system allows it, and its header is
+ *   written, so rotating into it costs no more than a file descriptor swap.
+ ****************************************************************************/
+
+static int logfile_prepare(unsigned *seqnum)
+{
+  int fd;
+  int err;
+  ssize_t b_written;
+  struct logseg_hdr_s hdr;
+  char filename[sizeof(CONFIG_PYGMY_TELEM_PWRFS "/") + 25];
+
+  /* Never create a segment with a sequence number the index doesn't know is
+   * taken. If the index can't be saved it is removed, and the next boot
+   * falls back to scanning for sequence numbers, so carry on regardless.
+   */
+
+  logindex_reserve(*seqnum);
 
   /* Create new file with file name of the next sequence number */
 
@@ -69,37 +498,333 @@ static int logfile_next(int *fd, unsigned *seqnum)
 
   /* Create and open this file in write mode */
 
-  err = open(filename, O_WRONLY | O_CREAT);
-  if (err < 0)
+  fd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
     {
-      pyerr("Couldn't open log file '%s': %d\n", filename, errno);
-      return errno;
+      err = errno;
+      pyerr("Couldn't open log file '%s': %d\n", filename, err);
+      return err;
+    }
+
+  /* Reserve the whole segment. Not every file system can, and writing works
+   * without it, so only warn.
+   */
+
+  if (ftruncate(fd, CONFIG_PYGMY_LOG_SEGSIZE) < 0)
+    {
+      pywarn("Couldn't extend log file '%s': %d\n", filename, errno);
+    }
+
+  logseg_init(&hdr, *seqnum, log_boot, CONFIG_PYGMY_LOG_SEGSIZE);
+  b_written = write(fd, &hdr, sizeof(hdr));
+  if (b_written != sizeof(hdr))
+    {
+      err = b_written < 0 ? errno : EIO;
+      pyerr("Couldn't write log file header '%s': %d\n", filename, err);
+      close(fd);
+      return err;
     }
 
-  *fd = err;    /* File descriptor was returned */
+  log_spare = fd; /* File descriptor was returned */
+  log_next = *seqnum;
   *seqnum += 1; /* Safe to increment sequence number */
   return 0;
 }
 
 /****************************************************************************
- * Name: parse_seqnum
+ * Name: logfile_next
+ *
+ * Description:
+ *   Syncs and closes the currently open log segment and swaps in the spare
+ *   one. If the spare segment isn't ready yet it is created now.
+ *
+ *   NOTE: Does not close file descriptor `fd` if it is a negative number.
+ ****************************************************************************/
+
+static int logfile_next(int *fd, unsigned *seqnum)
+{
+  int err;
+
+  log_spare_err = 0;
+  if (log_spare < 0)
+    {
+      err = logfile_prepare(seqnum);
+      if (err)
+        {
+          return err;
+        }
+    }
+
+  /* Close current file if valid. Closing doesn't sync, so sync the full
+   * file first.
+   */
+
+  if (*fd >= 0)
+    {
+      logfile_sync(*fd);
+      err = close(*fd);
+      if (err < 0)
+        {
+          err = errno;
+          pyerr("Couldn't close log file: %d\n", err);
+        }
+
+      logseg_index();
+    }
+
+  *fd = log_spare;
+  log_cur = log_next;
+  log_spare = -1;
+  log_offset = sizeof(struct logseg_hdr_s); /* Data starts after header */
+  return 0;
+}
+
+/****************************************************************************
+ * Name: logbuf_block_size
+ *
+ * Description:
+ *   Gets how many bytes to write out of the backlog at a time: the block
+ *   size of the power safe file system, or the largest write if blocks are
+ *   bigger than it.
+ ****************************************************************************/
+
+static size_t logbuf_block_size(void)
+{
+  struct statfs fs;
+
+  if (statfs(CONFIG_PYGMY_TELEM_PWRFS, &fs) < 0 || fs.f_bsize <= 0)
+    {
+      pywarn("Couldn't get log file system block size: %d\n", errno);
+      return CONFIG_PYGMY_LOG_BUFSIZE;
+    }
+
+  if (fs.f_bsize > CONFIG_PYGMY_LOG_BUFSIZE)
+    {
+      pywarn("Log file system blocks (%ld bytes) exceed the largest write\n",
+             (long)fs.f_bsize);
+      return CONFIG_PYGMY_LOG_BUFSIZE;
+    }
+
+  return fs.f_bsize;
+}
+
+/****************************************************************************
+ * Name: logbuf_write
+ *
+ * Description:
+ *   Writes the first `nbytes` acquired bytes to the log file straight from
+ *   the backlog and releases them. Bytes wrapping around the end of the
+ *   backlog are still written with one call. When the log segment is full,
+ *   writing carries on in the next log segment. On any other error the
+ *   bytes that weren't written stay acquired and are retried once the next
+ *   write is due, so the log file never skips bytes the segment layout
+ *   counts on.
+ ****************************************************************************/
+
+static int logbuf_write(int *fd, unsigned *seqnum, size_t nbytes)
+{
+  int err = 0;
+  ssize_t b_written;
+  size_t done = 0;
+  size_t room;
+  int iovcnt;
+  struct iovec iov[2];
+
+  while (done < nbytes)
+    {
+      /* Segment is full, so rotate to the next */
+
+      room = CONFIG_PYGMY_LOG_SEGSIZE - log_offset;
+      if (room == 0)
+        {
+          err = logfile_next(fd, seqnum);
+          if (err)
+            {
+              pyerr("Couldn't create logfile %d: %d\n", *seqnum, err);
+              break;
+            }
+
+          continue;
+        }
+
+      iovcnt = backlog_iov(nbytes - done < room ? nbytes - done : room, iov);
+      b_written = writev(*fd, iov, iovcnt);
+      if (b_written > 0)
+        {
+          backlog_release(b_written);
+          done += b_written;
+          log_offset += b_written;
+          logsync_written(b_written);
+          continue;
+        }
+
+      /* Writing nothing without an error would only repeat, so it is
+       * treated as an I/O error
+       */
+
+      err = b_written < 0 ? errno : EIO;
+
+      /* Some unexpected error */
+
+      if (err != EFBIG)
+        {
+          if (err != log_write_err)
+            {
+              pyerr("Couldn't write data to logfile: %d\n", err);
+            }
+
+          break;
+        }
+
+      /* The file system can't hold a whole segment. Carry on in the next
+       * one; frames may straddle segments from here on.
+       */
+
+      pywarn("Log file full before the end of its segment.\n");
+      log_offset = CONFIG_PYGMY_LOG_SEGSIZE;
+      log_misaligned = true;
+    }
+
+  /* Retry once the next write is due rather than as soon as more data
+   * arrives
+   */
+
+  if (err)
+    {
+      flush_deadline(&log_deadline);
+    }
+
+  log_write_err = err;
+  log_fill -= done;
+  return err;
+}
+
+/****************************************************************************
+ * Name: logbuf_flush
+ *
+ * Description:
+ *   Writes out all complete file system blocks acquired from the backlog.
+ *   If acquired data is due, or `all` is set, everything is written out instead.
+ *   Writes are kept block aligned in the log file, so after writing a
+ *   partial block the next write only completes that block. After a failed
+ *   write nothing is written until acquired data is due again.
+ ****************************************************************************/
+
+static int logbuf_flush(int *fd, unsigned *seqnum, bool all)
+{
+  int err = 0;
+  size_t nbytes;
+  struct timespec now;
+
+  if (log_fill == 0)
+    {
+      return 0;
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  if (!timespec_before(&now, &log_deadline))
+    {
+      all = true;
+    }
+  else if (log_write_err)
+    {
+      return log_write_err;
+    }
+
+  for (;;)
+    {
+      nbytes = log_block - log_offset % log_block;
+      if (log_fill < nbytes)
+        {
+          break;
+        }
+
+      err = logbuf_write(fd, seqnum, nbytes);
+      if (err) return err;
+    }
+
+  if (all && log_fill > 0)
+    {
+      err = logbuf_write(fd, seqnum, log_fill);
+    }
+
+  return err;
+}
+
+/****************************************************************************
+ * Name: logbuf_staged
+ *
+ * Description:
+ *   Accounts for `nbytes` newly acquired from the backlog. The first bytes
+ *   acquired set the deadline for writing them out, which is
+ *   never later than the data would be due for syncing.
+ ****************************************************************************/
+
+static void logbuf_staged(size_t nbytes)
+{
+  if (log_fill == 0)
+    {
+      flush_deadline(&log_deadline);
+    }
+
+  log_fill += nbytes;
+}
+
+/****************************************************************************
+ * Name: log_wait_deadline
  *
  * Description:
- *   Parses a number out of a log filename.
+ *   Gets how long the log writer thread may wait for more data: until
+ *   staged data must be written out or written data must be synced,
+ *   whichever comes first. If the spare log segment isn't ready, the writer
+ *   shouldn't wait at all but create it once the backlog is drained.
+ *
+ * Returns:
+ *   The deadline, or NULL to wait indefinitely
  ****************************************************************************/
 
-static unsigned parse_seqnum(const char *str)
+static const struct timespec *log_wait_deadline(struct timespec *deadline)
 {
-  const char *start = str;
+  /* Don't wait while the spare segment still needs creating */
 
-  /* Find start digit */
+  if (log_spare < 0 && log_spare_err == 0)
+    {
+      clock_gettime(CLOCK_MONOTONIC, deadline);
+      return deadline;
+    }
+
+  if (!logsync_deadline(deadline))
+    {
+      return log_fill > 0 ? &log_deadline : NULL;
+    }
 
-  while (!isdigit(*start))
+  if (log_fill > 0 && timespec_before(&log_deadline, deadline))
     {
-      start++;
+      *deadline = log_deadline;
     }
 
-  return strtoul(start, NULL, 10);
+  return deadline;
+}
+
+/****************************************************************************
+ * Name: parse_seqnum
+ *
+ * Description:
+ *   Parses the sequence number out of a log filename of the form
+ *   "log<n>.bin". Returns false for any other file name.
+ ****************************************************************************/
+
+static bool parse_seqnum(const char *str, unsigned *seqnum)
+{
+  char *end;
+
+  if (strncmp(str, "log", 3) != 0 || !isdigit((unsigned char)str[3]))
+    {
+      return false;
+    }
+
+  *seqnum = strtoul(&str[3], &end, 10);
+  return strcmp(end, ".bin") == 0;
 }
 
 /****************************************************************************
@@ -107,6 +832,8 @@ static unsigned parse_seqnum(const char *str)
  *
  * Description:
  *   Reads through the current log files to find the greatest sequence number.
+ *   Slow with many log files, so only used when the log index is missing or
+ *   corrupt.
  ****************************************************************************/
 
 static int logfile_cur_seqnum(unsigned *seqnum)
@@ -139,11 +866,13 @@ static int logfile_cur_seqnum(unsigned *seqnum)
           continue;
         }
 
-      /* WARNING: This parsing code makes the assumption that all log file
-       * names have the format "log<n>.bin", and that no other file names will
-       * be present in the power safe directory. */
+      /* Skip anything that isn't a log segment, like the log index */
+
+      if (!parse_seqnum(de->d_name, &seq))
+        {
+          continue;
+        }
 
-      seq = parse_seqnum(de->d_name);
       if (seq > maxseq)
         {
           maxseq = seq;
@@ -165,122 +894,384 @@ static int logfile_cur_seqnum(unsigned *seqnum)
 }
 
 /****************************************************************************
- * Public Functions
+ * Name: log_push
+ *
+ * Description:
+ *   Pushes a log frame of `len` bytes holding `packets` packets, from time
+ *   `first` to `last`, into the backlog. The segment is padded out and
+ *   finished with its time index first if the frame doesn't fit in it, so
+ *   the writer can rotate segments without knowing where frames start.
+ *
+ * Returns:
+ *   0 on success, ENOMEM if the backlog is full.
  ****************************************************************************/
 
+static int log_push(const uint8_t *frame, size_t len, uint32_t packets,
+                    pkt_time_t first, pkt_time_t last)
+{
+  int err;
+
+  if (log_seg.used + len > LOG_SEG_FRAMELEN)
+    {
+      /* The frame is dropped if the segment can't be finished first */
+
+      err = logseg_finish();
+      if (err)
+        {
+          backlog_drop();
+          return err;
+        }
+
+      logseg_done();
+    }
+
+  err = backlog_push(frame, len);
+  if (err)
+    {
+      return err;
+    }
+
+  logseg_mark(first);
+  logseg_add(len, packets, first, last);
+  return 0;
+}
+
+#ifdef CONFIG_PYGMY_LOG_COMPRESS
 /****************************************************************************
- * Name: log_thread
+ * Name: log_group_flush
  *
  * Description:
- *   Performs logging operations to onboard storage.
+ *   Compresses the group of packets waiting to be logged into one frame and
+ *   pushes it into the backlog. The group is emptied either way.
+ *
+ * Returns:
+ *   0 on success, ENOMEM if the backlog is full.
  ****************************************************************************/
 
-void *log_thread(void *arg)
+static int log_group_flush(void)
 {
-  syncro_t *syncro = args_syncro(arg);
   int err;
-  int pwrfs = -1;
-  unsigned seqnum = 0;
-  ssize_t b_written;
-  pkt = NULL;
+  size_t len;
+  struct frame_lz_s lz;
+  uint8_t *payload = &log_lz_frame[sizeof(struct frame_hdr_s)];
 
-  pyinfo("Log thread started.\n");
+  if (log_raw_packets == 0)
+    {
+      return 0;
+    }
 
-  /* Get the next available sequence number */
+  lz.rawlen = log_raw_len;
+  lz.first = log_raw_first;
+  lz.last = log_raw_last;
+  memcpy(payload, &lz, sizeof(lz));
 
-  err = logfile_cur_seqnum(&seqnum);
-  if (err)
+  /* The output buffer is sized for incompressible data, so this only fails
+   * on a bug
+   */
+
+  len = lz_compress(log_raw, log_raw_len, &payload[sizeof(lz)],
+                    LOG_LZ_PAYLOAD_MAXLEN - sizeof(lz), log_lz_table);
+  if (len == 0)
     {
-      /* Should use `seqnum` of 0 from above var init in this case */
+      pyerr("Couldn't compress %zu bytes of packets.\n", log_raw_len);
+      err = EIO;
+    }
+  else
+    {
+      len += sizeof(lz);
+      frame_init((struct frame_hdr_s *)log_lz_frame, FRAME_LZ, payload, len);
+      err = log_push(log_lz_frame, sizeof(struct frame_hdr_s) + len,
+                     log_raw_packets, log_raw_first, log_raw_last);
+      pydebug("Compressed %zu bytes of packets into %zu.\n", log_raw_len,
+              len);
+    }
+
+  log_raw_len = 0;
+  log_raw_packets = 0;
+  return err;
+}
+
+/****************************************************************************
+ * Name: log_group_add
+ *
+ * Description:
+ *   Adds a packet to the group waiting to be compressed. If the group is
+ *   full, it is flushed first, and the number of packets it held stored in
+ *   `flushed`.
+ *
+ * Returns:
+ *   The result of flushing the group, 0 if it wasn't flushed.
+ ****************************************************************************/
 
-      pywarn("Couldn't get the next available sequence number.\n");
+static int log_group_add(const struct packet_s *pkt, uint32_t *flushed)
+{
+  int err = 0;
+  uint16_t len = pkt->len;
+  const struct packet_hdr_s *hdr = (const struct packet_hdr_s *)pkt->contents;
+
+  *flushed = 0;
+  if (log_raw_len + sizeof(len) + pkt->len > sizeof(log_raw))
+    {
+      *flushed = log_raw_packets;
+      err = log_group_flush();
     }
 
-  /* Open power safe file system */
+  /* The first packet of a group sets when the group must be logged by */
 
-  err = logfile_next(&pwrfs, &seqnum);
-  if (err)
+  if (log_raw_packets == 0)
     {
-      err = errno;
-      pyerr("Couldn't open power safe log file: %d\n", err);
-      pthread_exit((void *)(long)err);
+      log_raw_first = hdr->time;
+      flush_deadline(&log_raw_deadline);
     }
 
-  pthread_cleanup_push(close_fd, pwrfs);
+  memcpy(&log_raw[log_raw_len], &len, sizeof(len));
+  memcpy(&log_raw[log_raw_len + sizeof(len)], pkt->contents, pkt->len);
+  log_raw_len += sizeof(len) + pkt->len;
+  log_raw_packets++;
+  log_raw_last = hdr->time;
+  return err;
+}
+#endif
 
-  /* Log sensor data continuously */
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: log_thread
+ *
+ * Description:
+ *   Copies packets to be logged into the RAM backlog as log frames, or
+ *   compresses groups of them into log frames if log compression is
+ *   enabled. Never touches the file system, so flash stalls are absorbed by
+ *   the backlog instead of making this thread fall behind the packet ring.
+ ****************************************************************************/
+
+void *log_thread(void *arg)
+{
+  syncro_t *syncro = args_syncro(arg);
+  int err;
+  uint32_t drops = 0;
+  uint32_t backlog_drops = 0;
+  size_t reported = BACKLOG_REPORT_STEP;
+  struct packet_s *pkt = &log_packet;
+#ifdef CONFIG_PYGMY_LOG_COMPRESS
+  uint32_t flushed;
+#else
+  const struct packet_hdr_s *hdr;
+#endif
+  struct backlog_stats_s stats;
+
+  pyinfo("Log thread started.\n");
+
+  logseg_start();
 
-  unsigned count = 0;
   for (;;)
     {
-      /* Wait for unlogged packet */
+      /* Wait for unlogged packet. While packets are waiting to be
+       * compressed, only wait until they must be logged.
+       */
 
-      err = syncro_get_unlogged(syncro, &pkt);
+#ifdef CONFIG_PYGMY_LOG_COMPRESS
+      err = syncro_consume_until(syncro, SYNCRO_LOGGER, pkt,
+                                 log_raw_packets > 0 ? &log_raw_deadline
+                                                     : NULL);
+      if (err == ETIMEDOUT)
+        {
+          flushed = log_raw_packets;
+          if (log_group_flush() == ENOMEM)
+            {
+              backlog_drops += flushed;
+              pywarn("Log backlog full, dropped %lu packets (%lu dropped).\n",
+                     (unsigned long)flushed, (unsigned long)backlog_drops);
+            }
 
+          continue;
+        }
+#else
+      err = syncro_consume(syncro, SYNCRO_LOGGER, pkt);
+#endif
       if (err)
         {
           pyerr("Error getting shared packet: %d\n", err);
           continue; /* Try again */
         }
 
-      /* If packet was NULL, mark it as logged and try again */
+      /* Report if the ring overtook us since the last packet */
 
-      if (pkt == NULL)
+      if (syncro_drops(syncro, SYNCRO_LOGGER) != drops)
         {
-          pywarn("Shared packet was NULL.\n");
-          syncro_mark_logged(syncro);
+          drops = syncro_drops(syncro, SYNCRO_LOGGER);
+          pywarn("Log thread has dropped %lu packets.\n",
+                 (unsigned long)drops);
+        }
+
+#ifdef CONFIG_PYGMY_LOG_COMPRESS
+      /* Group packets to compress them together, since consecutive packets
+       * share most of their structure but a single packet has little
+       * redundancy of its own.
+       */
+
+      if (log_group_add(pkt, &flushed) == ENOMEM)
+        {
+          backlog_drops += flushed;
+          pywarn("Log backlog full, dropped %lu packets (%lu dropped).\n",
+                 (unsigned long)flushed, (unsigned long)backlog_drops);
+        }
+#else
+      /* Log packet as a frame, so its length is kept and it can be checked
+       * for corruption when read back.
+       */
+
+      hdr = (const struct packet_hdr_s *)pkt->contents;
+      frame_init((struct frame_hdr_s *)log_frame, FRAME_PACKET, pkt->contents,
+                 pkt->len);
+      err = log_push(log_frame, sizeof(struct frame_hdr_s) + pkt->len, 1,
+                     hdr->time, hdr->time);
+      if (err == ENOMEM)
+        {
+          pywarn("Log backlog full, dropped packet %d (%lu dropped).\n",
+                 hdr->num, (unsigned long)++backlog_drops);
           continue;
         }
+#endif
 
-      /* Log packet */
+      pydebug("Logged %d!\n", ((struct packet_hdr_s *)(pkt->contents))->num);
 
-      b_written = write(pwrfs, pkt->contents, pkt->len);
-      if (b_written <= 0)
+      /* Report new backlog high-water marks, to help size the backlog */
+
+      backlog_stats(&stats);
+      if (stats.highwater >= reported)
         {
-          err = errno;
+          pyinfo("Log backlog high-water mark: %zu of %zu bytes.\n",
+                 stats.highwater, stats.size);
+          reported = stats.highwater + BACKLOG_REPORT_STEP;
+        }
+    }
 
-          /* Some unexpected error */
+  return (void *)(long)(err);
+}
 
-          if (err != EFBIG)
-            {
-              pyerr("Couldn't write data to logfile: %d\n", err);
-              continue;
-            }
+/****************************************************************************
+ * Name: log_writer_thread
+ *
+ * Description:
+ *   Drains the RAM backlog to onboard storage.
+ ****************************************************************************/
+
+void *log_writer_thread(void *arg)
+{
+  int err;
+  int pwrfs = -1;
+  unsigned seqnum = 0;
+  size_t nbytes;
+  struct timespec deadline;
 
-          /* File exceeded maximum size, so we need to swap files and
-           * continue. */
+  (void)arg;
 
-          err = logfile_next(&pwrfs, &seqnum);
-          if (err)
-            {
-              pyerr("Couldn't create logfile %d: %d\n", seqnum, err);
-              continue;
-            }
+  pyinfo("Log writer thread started.\n");
+
+  /* Get the next available sequence number from the log index, falling back
+   * to scanning the log files
+   */
+
+  err = logindex_load(&seqnum);
+  if (err)
+    {
+      pywarn("Couldn't load log index (%d), scanning log files.\n", err);
+
+      err = logfile_cur_seqnum(&seqnum);
+      if (err)
+        {
+          /* Should use `seqnum` of 0 from above var init in this case */
+
+          pywarn("Couldn't get the next available sequence number.\n");
         }
-      pydebug("Logged %d!\n", ((struct packet_hdr_s *)(pkt->contents))->num);
 
-      /* Mark packet as logged */
+      logindex_reset(seqnum);
+    }
+
+  /* Clean up after power loss before writing anything new */
 
-      syncro_mark_logged(syncro);
+  logrecover(seqnum);
 
-      /* Sync after `n` packets logged */
+  /* Open the first log segment of this boot */
 
-      if (count % CONFIG_PYGMY_NLOGSAVE == 0)
+  log_boot = seqnum;
+  err = logfile_next(&pwrfs, &seqnum);
+  if (err)
+    {
+      pyerr("Couldn't open power safe log file: %d\n", err);
+      pthread_exit((void *)(long)err);
+    }
+
+  pthread_cleanup_push(close_fd, &pwrfs);
+
+  /* Coalesce writes into whole file system blocks */
+
+  log_fill = 0;
+  log_block = logbuf_block_size();
+  pyinfo("Logging in %zu byte blocks.\n", log_block);
+
+  /* Sync by time and volume written rather than packet count */
+
+  logsync_init();
+
+  /* Write out logged data continuously */
+
+  for (;;)
+    {
+      /* Wait for more logged data than is already acquired. Acquired data
+       * is written out and synced if nothing arrives before it is due.
+       * Complete blocks are always written out below, so at most a partial
+       * block stays acquired.
+       */
+
+      err = backlog_acquire(log_fill, log_wait_deadline(&deadline),
+                            &nbytes);
+
+      if (err == ETIMEDOUT)
         {
-          pydebug("Syncing log file...\n");
-          err = fsync(pwrfs);
-          if (err < 0)
+          /* Idle, so create the spare log segment if it is missing */
+
+          if (log_spare < 0 && log_spare_err == 0)
             {
-              err = errno;
-              pyerr("Couldn't sync logfile: %d\n", err);
+              /* On failure, try again when rotating instead */
+
+              log_spare_err = logfile_prepare(&seqnum);
             }
-          else
+
+          /* Save the segments finished since the index was last saved */
+
+          logindex_flush();
+
+          logbuf_flush(&pwrfs, &seqnum, false);
+          if (logsync_due())
             {
-              pydebug("Log file synced!\n");
+              logfile_sync(pwrfs);
             }
+          continue;
+        }
+      else if (err)
+        {
+          pyerr("Error draining log backlog: %d\n", err);
+          continue; /* Try again */
         }
 
-      count++;
+      logbuf_staged(nbytes);
+
+      err = logbuf_flush(&pwrfs, &seqnum, false);
+      if (err)
+        {
+          continue;
+        }
+
+      /* Sync once enough data or old enough data is unsynced */
+
+      if (logsync_due())
+        {
+          err = logfile_sync(pwrfs);
+        }
     }
 
   pthread_cleanup_pop(1); /* Close pwrfs */
@@ -0,0 +1,305 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../packets/frame.h"
+#include "logindex.h"
+#include "syslogging.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Index file, and the temporary file it is rewritten through */
+
+#define LOGINDEX_PATH CONFIG_PYGMY_TELEM_PWRFS "/index.bin"
+#define LOGINDEX_TMPPATH CONFIG_PYGMY_TELEM_PWRFS "/index.tmp"
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* In-memory copy of the index, only touched by the log writer thread */
+
+static struct logindex_hdr_s index_hdr;
+static struct logindex_entry_s entries[CONFIG_PYGMY_LOG_INDEX_NENTRIES];
+static bool index_dirty; /* Entries were added since the index was saved */
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: logindex_crc
+ ****************************************************************************/
+
+static uint32_t logindex_crc(void)
+{
+  uint32_t crc;
+
+  crc = frame_crc(0, &index_hdr, offsetof(struct logindex_hdr_s, crc));
+  return frame_crc(crc, entries, index_hdr.count * sizeof(entries[0]));
+}
+
+/****************************************************************************
+ * Name: logindex_write
+ *
+ * Description:
+ *   Writes the index to a temporary file which is then renamed over the
+ *   index, so the index on disk is always either the old or the new one,
+ *   never a mix.
+ *
+ * Return: 0 on success, errno error code on failure
+ *
+ ****************************************************************************/
+
+static int logindex_write(void)
+{
+  int fd;
+  int err = 0;
+  size_t len;
+
+  index_hdr.crc = logindex_crc();
+  len = index_hdr.count * sizeof(entries[0]);
+
+  fd = open(LOGINDEX_TMPPATH, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0)
+    {
+      return errno;
+    }
+
+  errno = 0;
+  if (write(fd, &index_hdr, sizeof(index_hdr)) != sizeof(index_hdr) ||
+      write(fd, entries, len) != (ssize_t)len || fsync(fd) < 0)
+    {
+      err = errno ? errno : EIO;
+    }
+
+  if (close(fd) < 0 && !err)
+    {
+      err = errno;
+    }
+
+  if (err)
+    {
+      return err;
+    }
+
+  if (rename(LOGINDEX_TMPPATH, LOGINDEX_PATH) < 0)
+    {
+      return errno;
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: logindex_save
+ *
+ * Description:
+ *   Saves the index. If that fails the index on disk is out of date, and
+ *   could hand out a sequence number that is already in use next boot, so
+ *   it is removed instead. The next boot then falls back to scanning the log
+ *   directory.
+ *
+ * Return: 0 on success, errno error code on failure
+ *
+ ****************************************************************************/
+
+static int logindex_save(void)
+{
+  int err;
+
+  err = logindex_write();
+  if (err)
+    {
+      pyerr("Couldn't save log index: %d\n", err);
+      unlink(LOGINDEX_PATH);
+    }
+
+  index_dirty = false;
+  return err;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: logindex_load
+ *
+ * Description:
+ *   Loads the index from the power safe file system.
+ *
+ * Parameters:
+ *   next - Where to store the next free sequence number
+ *
+ * Return: 0 on success, ENOENT if there is no index, EBADMSG if it is
+ * corrupt, errno error code on other failures (open/read)
+ *
+ ****************************************************************************/
+
+int logindex_load(unsigned *next)
+{
+  int fd;
+  int err = 0;
+  ssize_t len;
+
+  fd = open(LOGINDEX_PATH, O_RDONLY);
+  if (fd < 0)
+    {
+      return errno;
+    }
+
+  len = read(fd, &index_hdr, sizeof(index_hdr));
+  if (len < 0)
+    {
+      err = errno;
+    }
+  else if (len != sizeof(index_hdr) || index_hdr.magic != LOGINDEX_MAGIC ||
+           index_hdr.version != LOGINDEX_VERSION ||
+           index_hdr.count > CONFIG_PYGMY_LOG_INDEX_NENTRIES)
+    {
+      err = EBADMSG;
+    }
+  else
+    {
+      len = read(fd, entries, index_hdr.count * sizeof(entries[0]));
+      if (len < 0)
+        {
+          err = errno;
+        }
+      else if (len != (ssize_t)(index_hdr.count * sizeof(entries[0])) ||
+               logindex_crc() != index_hdr.crc)
+        {
+          err = EBADMSG;
+        }
+    }
+
+  close(fd);
+
+  if (err)
+    {
+      return err;
+    }
+
+  *next = index_hdr.next;
+  return 0;
+}
+
+/****************************************************************************
+ * Name: logindex_reset
+ *
+ * Description:
+ *   Starts a new, empty index, for when it couldn't be loaded.
+ *
+ * Parameters:
+ *   next - The next free sequence number
+ *
+ ****************************************************************************/
+
+void logindex_reset(unsigned next)
+{
+  index_hdr.magic = LOGINDEX_MAGIC;
+  index_hdr.version = LOGINDEX_VERSION;
+  index_hdr.count = 0;
+  index_hdr.next = next;
+}
+
+/****************************************************************************
+ * Name: logindex_reserve
+ *
+ * Description:
+ *   Makes sure sequence number `seqnum` is reserved before a segment is
+ *   created with it. Saves the index only if a new batch of sequence
+ *   numbers has to be reserved.
+ *
+ * Return: 0 on success, errno error code on failure (saving)
+ *
+ ****************************************************************************/
+
+int logindex_reserve(unsigned seqnum)
+{
+  if (seqnum < index_hdr.next)
+    {
+      return 0;
+    }
+
+  index_hdr.next = seqnum + LOGINDEX_RESERVE;
+  return logindex_save();
+}
+
+/****************************************************************************
+ * Name: logindex_last
+ *
+ * Description:
+ *   Gets the sequence number of the most recent segment in the index.
+ *
+ * Return: The sequence number, or 0 if the index is empty
+ *
+ ****************************************************************************/
+
+unsigned logindex_last(void)
+{
+  return index_hdr.count > 0 ? entries[index_hdr.count - 1].seqnum : 0;
+}
+
+/****************************************************************************
+ * Name: logindex_add
+ *
+ * Description:
+ *   Adds the metadata of a finished segment to the index. The oldest entry
+ *   is dropped when the index is full. The index isn't saved, to keep the
+ *   file system out of segment rotation; `logindex_flush` saves it later.
+ *   Until then, the entry is rebuilt by recovery at the next boot if power
+ *   is lost.
+ *
+ ****************************************************************************/
+
+void logindex_add(const struct logindex_entry_s *entry)
+{
+  if (index_hdr.count == CONFIG_PYGMY_LOG_INDEX_NENTRIES)
+    {
+      memmove(entries, &entries[1], sizeof(entries) - sizeof(entries[0]));
+      index_hdr.count--;
+    }
+
+  entries[index_hdr.count++] = *entry;
+  if (entry->seqnum >= index_hdr.next)
+    {
+      index_hdr.next = entry->seqnum + 1;
+    }
+
+  index_dirty = true;
+}
+
+/****************************************************************************
+ * Name: logindex_flush
+ *
+ * Description:
+ *   Saves the index if entries were added since it was last saved. Meant
+ *   for when the log writer is idle. Reserving sequence numbers saves the
+ *   index too, so at most a batch of entries is ever left unsaved, and
+ *   those are all in the range recovery looks at.
+ *
+ * Return: 0 on success, errno error code on failure (saving)
+ *
+ ****************************************************************************/
+
+int logindex_flush(void)
+{
+  if (!index_dirty)
+    {
+      return 0;
+    }
+
+  return logindex_save();
+}
@@ -0,0 +1,79 @@
+#ifndef _PYGMY_LOGINDEX_H_
+#define _PYGMY_LOGINDEX_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+
+#include "../packets/packets.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Number of most recent log segments the index keeps metadata for */
+
+#ifndef CONFIG_PYGMY_LOG_INDEX_NENTRIES
+#define CONFIG_PYGMY_LOG_INDEX_NENTRIES 32
+#endif
+
+/* Sequence numbers reserved at a time. Segments are only created with
+ * reserved numbers, so a number is never reused even if the index isn't
+ * saved again before power is lost. Saving the index once per this many
+ * segments keeps it off the rotation path most of the time; finished
+ * segments are only added to the saved index when the log writer is idle.
+ */
+
+#define LOGINDEX_RESERVE 8
+
+/* Magic number starting the index file ("PYIX" in file order) */
+
+#define LOGINDEX_MAGIC 0x58495950
+
+/* Version of the index file format */
+
+#define LOGINDEX_VERSION 1
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Header of the index file, followed by `count` entries. The CRC-32 covers
+ * the rest of the header and the entries.
+ */
+
+struct logindex_hdr_s
+{
+  uint32_t magic;   /* LOGINDEX_MAGIC */
+  uint16_t version; /* LOGINDEX_VERSION */
+  uint16_t count;   /* Number of entries */
+  uint32_t next;    /* Lowest sequence number not yet handed out */
+  uint32_t crc;     /* CRC-32 of the index */
+} PACKED;
+
+/* Metadata of a finished log segment */
+
+struct logindex_entry_s
+{
+  uint32_t seqnum;  /* Sequence number of the segment */
+  uint32_t boot;    /* Boot ID of the segment */
+  uint32_t used;    /* Bytes of frames in the segment, excluding padding */
+  uint32_t packets; /* Number of packets in the segment, 0 if unknown */
+  pkt_time_t first; /* Mission time of the first packet */
+  pkt_time_t last;  /* Mission time of the last packet */
+} PACKED;
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+int logindex_load(unsigned *next);
+void logindex_reset(unsigned next);
+int logindex_reserve(unsigned seqnum);
+unsigned logindex_last(void);
+void logindex_add(const struct logindex_entry_s *entry);
+int logindex_flush(void);
+
+#endif // _PYGMY_LOGINDEX_H_
@@ -0,0 +1,313 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../packets/frame.h"
+#include "../packets/packets.h"
+#include "logindex.h"
+#include "logrecover.h"
+#include "syslogging.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Largest log frame, compressed or not */
+
+#define RECOVER_FRAME_MAXLEN (sizeof(struct frame_hdr_s) + FRAME_PAYLOAD_MAX)
+
+/* Granularity of the search for the end of the written data. Frames never
+ * contain a run of zeros this long, so the first all zero chunk is where the
+ * written data ends and the padding or unwritten space starts.
+ */
+
+#define RECOVER_CHUNK 512
+
+/* Window scanned for frames at a time. Consecutive windows overlap by a
+ * whole frame, so every frame lies entirely within some window.
+ */
+
+#define RECOVER_WINDOW (2 * RECOVER_FRAME_MAXLEN)
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static uint8_t window[RECOVER_WINDOW];
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: chunk_is_zero
+ *
+ * Description:
+ *   Checks if the chunk of the file starting at `offset` is all zero, or
+ *   past the end of the file.
+ ****************************************************************************/
+
+static bool chunk_is_zero(int fd, off_t offset)
+{
+  ssize_t len;
+
+  len = pread(fd, window, RECOVER_CHUNK, offset);
+  for (ssize_t i = 0; i < len; i++)
+    {
+      if (window[i] != 0)
+        {
+          return false;
+        }
+    }
+
+  return true;
+}
+
+/****************************************************************************
+ * Name: data_end
+ *
+ * Description:
+ *   Finds where the written data in a segment ends, by binary search over
+ *   chunks, so only a handful of chunks are read however big the segment
+ *   is. Written data is contiguous from the header and any zeros only come
+ *   after it.
+ ****************************************************************************/
+
+static off_t data_end(int fd, off_t start, off_t size)
+{
+  off_t lo = 0;
+  off_t hi = (size - start + RECOVER_CHUNK - 1) / RECOVER_CHUNK;
+  off_t mid;
+
+  /* Find the first all zero chunk */
+
+  while (lo < hi)
+    {
+      mid = lo + (hi - lo) / 2;
+      if (chunk_is_zero(fd, start + mid * RECOVER_CHUNK))
+        {
+          hi = mid;
+        }
+      else
+        {
+          lo = mid + 1;
+        }
+    }
+
+  start += lo * RECOVER_CHUNK;
+  return start < size ? start : size;
+}
+
+/****************************************************************************
+ * Name: frame_times
+ *
+ * Description:
+ *   Gets the base mission times of the first and last packets in a frame.
+ ****************************************************************************/
+
+static void frame_times(const struct frame_view_s *frame, pkt_time_t *first,
+                        pkt_time_t *last)
+{
+  struct packet_hdr_s hdr;
+  struct frame_lz_s lz;
+
+  if (frame->type == FRAME_PACKET && frame->len >= sizeof(hdr))
+    {
+      memcpy(&hdr, frame->payload, sizeof(hdr));
+      *first = hdr.time;
+      *last = hdr.time;
+    }
+  else if (frame->type == FRAME_LZ && frame->len >= sizeof(lz))
+    {
+      memcpy(&lz, frame->payload, sizeof(lz));
+      *first = lz.first;
+      *last = lz.last;
+    }
+}
+
+/****************************************************************************
+ * Name: last_frame
+ *
+ * Description:
+ *   Finds the end of the last valid frame before `end`, scanning windows
+ *   backwards from `end` until one holds a valid frame. Normally only the
+ *   first window is read.
+ *
+ * Returns:
+ *   The end of the last valid frame, or `start` if there is none.
+ ****************************************************************************/
+
+static off_t last_frame(int fd, off_t start, off_t end, pkt_time_t *time)
+{
+  off_t pos;
+  off_t found = start;
+  ssize_t len;
+  pkt_time_t unused;
+  struct frame_iter_s it;
+  struct frame_view_s frame;
+
+  while (found == start && end > start)
+    {
+      pos = end - start > (off_t)RECOVER_WINDOW ? end - (off_t)RECOVER_WINDOW
+                                               : start;
+      len = pread(fd, window, end - pos, pos);
+      if (len <= 0)
+        {
+          break;
+        }
+
+      frame_iter_init(&it, window, len);
+      while (frame_iter_next(&it, &frame) == 0)
+        {
+          found = pos + (frame.payload + frame.len - window);
+          frame_times(&frame, &unused, time);
+        }
+
+      if (pos == start)
+        {
+          break;
+        }
+
+      /* Overlap the next window with this one by a whole frame, so frames
+       * cut by the start of this window are whole in the next one
+       */
+
+      end = pos + RECOVER_FRAME_MAXLEN;
+    }
+
+  return found;
+}
+
+/****************************************************************************
+ * Name: recover_segment
+ *
+ * Description:
+ *   Recovers a log segment that was being written when power was lost:
+ *   truncates it after its last valid frame and adds it to the log index.
+ *   Only the start and the tail of the segment are read. Segments without
+ *   any frames, like an unused spare segment, are removed.
+ ****************************************************************************/
+
+static void recover_segment(unsigned seqnum)
+{
+  int fd;
+  ssize_t len;
+  off_t end;
+  off_t good;
+  pkt_time_t first = 0;
+  pkt_time_t last = 0;
+  pkt_time_t unused;
+  struct stat st;
+  struct logseg_hdr_s seg;
+  struct frame_view_s frame;
+  struct logindex_entry_s entry = {0};
+  char filename[sizeof(CONFIG_PYGMY_TELEM_PWRFS "/") + 25];
+
+  snprintf(filename, sizeof(filename), CONFIG_PYGMY_TELEM_PWRFS "/log%d.bin",
+           seqnum);
+
+  fd = open(filename, O_RDWR);
+  if (fd < 0)
+    {
+      return; /* Never created */
+    }
+
+  len = pread(fd, window, RECOVER_WINDOW, 0);
+  if (fstat(fd, &st) < 0 || len < 0 ||
+      logseg_parse(window, len, &seg) != 0)
+    {
+      pywarn("Log segment %u has no valid header, leaving it alone.\n",
+             seqnum);
+      close(fd);
+      return;
+    }
+
+  /* Find the end of the written data, then the last whole frame in it */
+
+  end = data_end(fd, seg.hdrlen, st.st_size);
+  good = last_frame(fd, seg.hdrlen, end, &last);
+
+  if (good == seg.hdrlen)
+    {
+      pyinfo("Removing empty log segment %u.\n", seqnum);
+      close(fd);
+      unlink(filename);
+      return;
+    }
+
+  if (good < end)
+    {
+      pywarn("Log segment %u has %ld bytes after its last frame, "
+             "truncating.\n",
+             seqnum, (long)(end - good));
+    }
+
+  if (good < st.st_size && ftruncate(fd, good) < 0)
+    {
+      pyerr("Couldn't truncate log segment %u: %d\n", seqnum, errno);
+    }
+
+  /* The first frame directly follows the header. Counting packets would
+   * mean reading the whole segment, so that is left unknown.
+   */
+
+  len = pread(fd, window, RECOVER_FRAME_MAXLEN, seg.hdrlen);
+  if (len > 0 && frame_parse(window, len, &frame) == 0)
+    {
+      frame_times(&frame, &first, &unused);
+    }
+
+  close(fd);
+
+  entry.seqnum = seqnum;
+  entry.boot = seg.boot;
+  entry.used = good - seg.hdrlen;
+  entry.first = first;
+  entry.last = last;
+  logindex_add(&entry);
+
+  pyinfo("Recovered log segment %u (%lu bytes).\n", seqnum,
+         (unsigned long)entry.used);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: logrecover
+ *
+ * Description:
+ *   Recovers the log segments the last boot left unfinished, before any new
+ *   ones are written. Those are the segments missing from the log index
+ *   below the next free sequence number. Only the last two batches of
+ *   reserved sequence numbers can hold them, so at most that many segments
+ *   are looked for, however many log files there are.
+ *
+ * Parameters:
+ *   next - The next free sequence number
+ *
+ ****************************************************************************/
+
+void logrecover(unsigned next)
+{
+  unsigned seqnum = logindex_last() + 1;
+
+  if (next > 2 * LOGINDEX_RESERVE && seqnum < next - 2 * LOGINDEX_RESERVE)
+    {
+      seqnum = next - 2 * LOGINDEX_RESERVE;
+    }
+
+  for (; seqnum < next; seqnum++)
+    {
+      recover_segment(seqnum);
+    }
+}
@@ -0,0 +1,10 @@
+#ifndef _PYGMY_LOGRECOVER_H_
+#define _PYGMY_LOGRECOVER_H_
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void logrecover(unsigned next);
+
+#endif // _PYGMY_LOGRECOVER_H_
@@ -0,0 +1,260 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "logsync.h"
+#include "phase.h"
+#include "syslogging.h"
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Scheduling state, only touched by the log writer thread, which writes
+ * and syncs the log file
+ */
+
+static size_t unsynced;           /* Bytes written since the last sync */
+static struct timespec oldest;    /* When the oldest of them was written */
+static bool failed;               /* The last sync failed */
+
+/* Statistics, which other threads may read */
+
+static struct logsync_stats_s stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: elapsed_us
+ ****************************************************************************/
+
+static uint32_t elapsed_us(const struct timespec *start,
+                           const struct timespec *end)
+{
+  return (end->tv_sec - start->tv_sec) * 1000000 +
+         (end->tv_nsec - start->tv_nsec) / 1000;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: logsync_init
+ *
+ * Description:
+ *   Resets the sync schedule and statistics.
+ *
+ ****************************************************************************/
+
+void logsync_init(void)
+{
+  unsynced = 0;
+  failed = false;
+
+  pthread_mutex_lock(&stats_lock);
+  stats = (struct logsync_stats_s){0};
+  pthread_mutex_unlock(&stats_lock);
+}
+
+/****************************************************************************
+ * Name: logsync_written
+ *
+ * Description:
+ *   Records that data was written to the log file and is waiting for a sync.
+ *
+ * Arguments:
+ *   nbytes - The number of bytes written
+ *
+ ****************************************************************************/
+
+void logsync_written(size_t nbytes)
+{
+  if (nbytes == 0)
+    {
+      return;
+    }
+
+  if (unsynced == 0)
+    {
+      clock_gettime(CLOCK_MONOTONIC, &oldest);
+    }
+
+  unsynced += nbytes;
+}
+
+/****************************************************************************
+ * Name: logsync_limit_ms
+ *
+ * Description:
+ *   Gets how long logged data may currently wait to be synced. This is much
+ *   shorter once past apogee, when a hard landing or someone pulling the
+ *   battery could cut power at any time.
+ *
+ * Returns:
+ *   The limit in milliseconds
+ *
+ ****************************************************************************/
+
+uint32_t logsync_limit_ms(void)
+{
+  return phase_get() >= PHASE_DESCENT ? CONFIG_PYGMY_LOGSYNC_CRIT_MS
+                                      : CONFIG_PYGMY_LOGSYNC_MS;
+}
+
+/****************************************************************************
+ * Name: logsync_deadline
+ *
+ * Description:
+ *   Gets when the next sync is due at the latest.
+ *
+ * Arguments:
+ *   deadline - Where to store the CLOCK_MONOTONIC deadline
+ *
+ * Returns:
+ *   True if a sync is pending, false if there is nothing to sync (and
+ *   `deadline` is left alone)
+ *
+ ****************************************************************************/
+
+bool logsync_deadline(struct timespec *deadline)
+{
+  uint32_t limit = logsync_limit_ms();
+
+  if (unsynced == 0)
+    {
+      return false;
+    }
+
+  deadline->tv_sec = oldest.tv_sec + limit / 1000;
+  deadline->tv_nsec = oldest.tv_nsec + (limit % 1000) * 1000000;
+  if (deadline->tv_nsec >= 1000000000)
+    {
+      deadline->tv_sec++;
+      deadline->tv_nsec -= 1000000000;
+    }
+
+  return true;
+}
+
+/****************************************************************************
+ * Name: logsync_due
+ *
+ * Description:
+ *   Checks if the log file should be synced now: either too many bytes or
+ *   too old data are unsynced. After a failed sync only the time limit
+ *   applies, so a failing file system isn't retried on every write.
+ *
+ ****************************************************************************/
+
+bool logsync_due(void)
+{
+  struct timespec now;
+  struct timespec deadline;
+
+  if (!logsync_deadline(&deadline))
+    {
+      return false;
+    }
+
+  if (!failed && unsynced >= CONFIG_PYGMY_LOGSYNC_BYTES)
+    {
+      return true;
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec > deadline.tv_sec ||
+         (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec);
+}
+
+/****************************************************************************
+ * Name: logsync_sync
+ *
+ * Description:
+ *   Syncs the log file and records how long it took.
+ *
+ * Arguments:
+ *   fd - The log file
+ *
+ * Returns:
+ *   0 on success, errno error code on failure (fsync)
+ *
+ ****************************************************************************/
+
+int logsync_sync(int fd)
+{
+  int err = 0;
+  uint32_t us;
+  struct timespec start;
+  struct timespec end;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (fsync(fd) < 0)
+    {
+      err = errno;
+    }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  us = elapsed_us(&start, &end);
+
+  pthread_mutex_lock(&stats_lock);
+  if (err)
+    {
+      stats.failures++;
+    }
+  else
+    {
+      stats.syncs++;
+      stats.bytes += unsynced;
+    }
+
+  stats.last_us = us;
+  stats.total_us += us;
+  if (us > stats.max_us)
+    {
+      stats.max_us = us;
+    }
+
+  pthread_mutex_unlock(&stats_lock);
+
+  /* On failure the data stays unsynced, and the sync is retried once the
+   * time limit passes again, however many bytes are waiting
+   */
+
+  failed = err != 0;
+  if (err)
+    {
+      oldest = end;
+    }
+  else
+    {
+      unsynced = 0;
+    }
+
+  return err;
+}
+
+/****************************************************************************
+ * Name: logsync_stats
+ *
+ * Description:
+ *   Gets a consistent copy of the sync statistics. Safe to call from any
+ *   thread.
+ *
+ ****************************************************************************/
+
+void logsync_stats(struct logsync_stats_s *copy)
+{
+  pthread_mutex_lock(&stats_lock);
+  *copy = stats;
+  pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,67 @@
+#ifndef _PYGMY_LOGSYNC_H_
+#define _PYGMY_LOGSYNC_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "phase.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Most logged bytes that may be left unsynced */
+
+#ifndef CONFIG_PYGMY_LOGSYNC_BYTES
+#define CONFIG_PYGMY_LOGSYNC_BYTES 16384
+#endif
+
+/* Longest time logged data may be left unsynced, in milliseconds */
+
+#ifndef CONFIG_PYGMY_LOGSYNC_MS
+#define CONFIG_PYGMY_LOGSYNC_MS 2000
+#endif
+
+/* Longest time logged data may be left unsynced after apogee, in
+ * milliseconds
+ */
+
+#ifndef CONFIG_PYGMY_LOGSYNC_CRIT_MS
+#define CONFIG_PYGMY_LOGSYNC_CRIT_MS 250
+#endif
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Log sync statistics */
+
+struct logsync_stats_s
+{
+  uint32_t syncs;       /* Number of syncs */
+  uint32_t failures;    /* Number of syncs that failed */
+  uint32_t last_us;     /* Duration of the last sync */
+  uint32_t max_us;      /* Duration of the longest sync */
+  uint64_t total_us;    /* Time spent syncing in total */
+  uint64_t bytes;       /* Bytes synced in total */
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void logsync_init(void);
+void logsync_written(size_t nbytes);
+uint32_t logsync_limit_ms(void);
+bool logsync_deadline(struct timespec *deadline);
+bool logsync_due(void);
+int logsync_sync(int fd);
+void logsync_stats(struct logsync_stats_s *stats);
+
+#endif // _PYGMY_LOGSYNC_H_
@@ -0,0 +1,842 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include <uORB/uORB.h>
+
+#include "../packets/altitude.h"
+#include "../packets/fec.h"
+#include "../packets/packets.h"
+#include "packager.h"
+#include "phase.h"
+#include "radioprofile.h"
+#include "snapshot.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+#define us_to_ms(us) ((us) / 1000)
+
+/* Oldest GPS coordinates (or held radio values) still worth sending in
+ * milliseconds. This leaves half of the block time offset range for the
+ * rest of the packet.
+ */
+
+#define COORD_MAXAGE (BLOCK_OFFSET_MAX / 2)
+
+/* The batch of an IMU sensor in a stream's packaging state */
+
+#ifdef CONFIG_PYGMY_BATCH_IMU
+#define imu_batch(pkgr, name) (&(pkgr)->name)
+#else
+#define imu_batch(pkgr, name) NULL
+#endif
+
+/* Rates of the sensors in the radio stream in Hz, 0 to leave them out */
+
+#ifndef CONFIG_PYGMY_RADIO_BARO_FREQ
+#define CONFIG_PYGMY_RADIO_BARO_FREQ 2
+#endif
+
+#ifndef CONFIG_PYGMY_RADIO_ACCEL_FREQ
+#define CONFIG_PYGMY_RADIO_ACCEL_FREQ 2
+#endif
+
+#ifndef CONFIG_PYGMY_RADIO_GYRO_FREQ
+#define CONFIG_PYGMY_RADIO_GYRO_FREQ 1
+#endif
+
+#ifndef CONFIG_PYGMY_RADIO_MAG_FREQ
+#define CONFIG_PYGMY_RADIO_MAG_FREQ 0
+#endif
+
+/* Percentage of a radio packet IMU blocks may use */
+
+#ifndef CONFIG_PYGMY_RADIO_IMU_QUOTA
+#define CONFIG_PYGMY_RADIO_IMU_QUOTA 50
+#endif
+
+/* Longest radio packet. Parity packets only protect packets short enough
+ * to leave room for the parity block's headers, and the radio thread may
+ * add a profile notice.
+ */
+
+#ifdef CONFIG_PYGMY_RADIO_FEC
+#define RADIO_MAXLEN (FEC_DATA_MAXLEN - RADIOPROFILE_RESERVE)
+#else
+#define RADIO_MAXLEN (CONFIG_PYGMY_PACKET_MAXLEN - RADIOPROFILE_RESERVE)
+#endif
+
+/* Space at the end of every radio packet kept for the critical blocks */
+
+#define RADIO_RESERVE                                                        \
+  (3 * sizeof(struct block_hdr_s) + sizeof(coord_p) + sizeof(alt_p) +       \
+   sizeof(volt_p))
+
+/* Space in a radio packet for blocks other than the critical ones */
+
+#define RADIO_OPEN_MAXLEN (RADIO_MAXLEN - RADIO_RESERVE)
+
+/* Most bytes of a radio packet IMU blocks may use */
+
+#define RADIO_IMU_MAXLEN                                                     \
+  (RADIO_MAXLEN * CONFIG_PYGMY_RADIO_IMU_QUOTA / 100)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* Priority classes of blocks in the radio stream */
+
+enum package_prio_e
+{
+  PRIO_CRITICAL, /* In every packet, in space reserved for them */
+  PRIO_NORMAL,   /* As long as the packet has room */
+  PRIO_IMU,      /* Up to the IMU quota of the packet */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Latest GPS coordinate to send out, shared by all streams */
+
+#ifdef CONFIG_SENSORS_L86_XXX
+static struct sensor_gnss coordinates;
+#endif
+
+/* Priority class of each block kind in the radio stream */
+
+static const uint8_t radio_prios[] = {
+    [PACKET_PRESS] = PRIO_NORMAL,   [PACKET_TEMP] = PRIO_NORMAL,
+    [PACKET_ALT] = PRIO_CRITICAL,   [PACKET_COORD] = PRIO_CRITICAL,
+    [PACKET_ACCEL] = PRIO_IMU,      [PACKET_GYRO] = PRIO_IMU,
+    [PACKET_MAG] = PRIO_IMU,        [PACKET_VOLT] = PRIO_CRITICAL,
+    [PACKET_BATCH] = PRIO_IMU,
+};
+
+/* Rates of the sensors in the radio stream */
+
+static const uint32_t radio_freqs[] = {
+#ifdef CONFIG_SENSORS_MS56XX
+    [SENSOR_BARO] = CONFIG_PYGMY_RADIO_BARO_FREQ,
+#endif
+#ifdef CONFIG_SENSORS_LSM6DSO32
+    [SENSOR_ACCEL] = CONFIG_PYGMY_RADIO_ACCEL_FREQ,
+    [SENSOR_GYRO] = CONFIG_PYGMY_RADIO_GYRO_FREQ,
+#endif
+#ifdef CONFIG_SENSORS_LIS2MDL
+    [SENSOR_MAG] = CONFIG_PYGMY_RADIO_MAG_FREQ,
+#endif
+#ifdef CONFIG_SENSORS_L86_XXX
+    [SENSOR_GPS] = 0,
+#endif
+};
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: package_due
+ *
+ * Description:
+ *   Checks if a sample taken at `timestamp` (in microseconds) belongs in the
+ *   stream. The radio stream only takes samples at the sensor's radio rate;
+ *   the others take every sample.
+ *
+ ****************************************************************************/
+
+static bool package_due(struct packager_s *pkgr, enum sensor_kind sensor,
+                        uint64_t timestamp)
+{
+  pkt_time_t time = us_to_ms(timestamp);
+  uint32_t period;
+
+  if (pkgr->stream != PACKAGE_RADIO)
+    {
+      return true;
+    }
+
+  if (radio_freqs[sensor] == 0 ||
+      (int32_t)(time - pkgr->due[sensor]) < 0)
+    {
+      return false;
+    }
+
+  /* Step from the due time rather than the sample time, so jitter in the
+   * sample times doesn't lower the rate, unless that falls behind
+   */
+
+  period = 1000 / radio_freqs[sensor];
+  pkgr->due[sensor] += period;
+  if ((int32_t)(time - pkgr->due[sensor]) >= 0)
+    {
+      pkgr->due[sensor] = time + period;
+    }
+
+  return true;
+}
+
+/****************************************************************************
+ * Name: package_held
+ *
+ * Description:
+ *   Gets where the radio stream holds the latest value of a critical block
+ *   kind, or NULL for coordinates, which all streams share.
+ *
+ ****************************************************************************/
+
+static struct package_held_s *package_held(struct packager_s *pkgr,
+                                           uint8_t kind)
+{
+  switch (kind)
+    {
+    case PACKET_ALT:
+      return &pkgr->alt;
+    case PACKET_VOLT:
+      return &pkgr->volt;
+    default:
+      return NULL;
+    }
+}
+
+/****************************************************************************
+ * Name: package_radio
+ *
+ * Description:
+ *   Adds a block to a radio packet according to its priority class.
+ *   Critical blocks are held back and added when the packet is finished,
+ *   into space no other block may use, so they are in every packet. IMU
+ *   blocks beyond their quota of the packet are dropped, leaving the rest
+ *   of the packet to other blocks.
+ *
+ * Returns:
+ *   0 on success or if the block was held back or dropped, ENOMEM on no
+ *   more packet space, ERANGE if the block is too far from the packet's
+ *   base time
+ *
+ ****************************************************************************/
+
+static int package_radio(struct packager_s *pkgr, struct packet_s *pkt,
+                         uint8_t kind, pkt_time_t time, const void *blk,
+                         size_t nbytes)
+{
+  int err;
+  size_t len = sizeof(struct block_hdr_s) + nbytes;
+  struct package_held_s *held;
+
+  switch (radio_prios[kind])
+    {
+    case PRIO_CRITICAL:
+      held = package_held(pkgr, kind);
+      if (held != NULL && nbytes <= sizeof(held->blk))
+        {
+          held->valid = true;
+          held->time = time;
+          memcpy(held->blk, blk, nbytes);
+        }
+
+      return 0;
+
+    case PRIO_IMU:
+      if (!radioprofile_imu() || pkgr->bulk + len > RADIO_IMU_MAXLEN)
+        {
+          return 0;
+        }
+      break;
+
+    default:
+      break;
+    }
+
+  if (pkt->len + len > RADIO_OPEN_MAXLEN)
+    {
+      return ENOMEM;
+    }
+
+  err = packet_push_block(pkt, kind, time, blk, nbytes);
+  if (err == 0 && radio_prios[kind] == PRIO_IMU)
+    {
+      pkgr->bulk += len;
+    }
+
+  return err;
+}
+
+/****************************************************************************
+ * Name: package_block
+ *
+ * Description:
+ *   Adds a block to the packet, by priority for the radio stream, or to the
+ *   radio's latest value table for `PACKAGE_LATEST`.
+ *
+ * Returns:
+ *   0 on success, ENOMEM on no more packet space, ERANGE if the block is
+ *   too far from the packet's base time
+ *
+ ****************************************************************************/
+
+static int package_block(struct packager_s *pkgr, struct packet_s *pkt,
+                         uint8_t kind, pkt_time_t time, const void *blk,
+                         size_t nbytes)
+{
+#ifdef CONFIG_PYGMY_RADIO_LATEST
+  if (pkgr->stream == PACKAGE_LATEST)
+    {
+      snapshot_update(kind, time, blk, nbytes);
+      return 0;
+    }
+#endif
+
+  if (pkgr->stream == PACKAGE_RADIO)
+    {
+      return package_radio(pkgr, pkt, kind, time, blk, nbytes);
+    }
+
+  return packet_push_block(pkt, kind, time, blk, nbytes);
+}
+
+/****************************************************************************
+ * Name: package_batch
+ *
+ * Description:
+ *   Adds a batch to the packet and empties it. A batch too old to be
+ *   timestamped relative to the packet can never be sent, so it is dropped.
+ *   One too new for the packet is kept for the next packet.
+ *
+ * Returns:
+ *   0 on success or if the batch was dropped, ENOMEM on no more packet
+ *   space, ERANGE if the batch is too new for the packet
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_PYGMY_BATCH_IMU
+static int package_batch(struct packet_s *pkt, struct batch_s *batch,
+                         uint8_t kind)
+{
+  const struct packet_hdr_s *hdr = (struct packet_hdr_s *)pkt->contents;
+  int err;
+
+  err = packet_push_batch(pkt, batch);
+  if (err == ENOMEM) return err;
+  if (err == ERANGE && (int32_t)(batch->start - hdr->time) > 0) return err;
+
+  batch_init(batch, kind);
+  return 0;
+}
+#endif
+
+/****************************************************************************
+ * Name: package_batched
+ *
+ * Description:
+ *   Adds an IMU block to its batch instead of the packet. The batch is added
+ *   to the packet once it is full. If it doesn't fit, it is kept until the
+ *   next packet.
+ *
+ * Arguments:
+ *   pkt - The packet to add the batch to once full
+ *   batch - The batch of this kind of block
+ *   kind - The kind of block being batched
+ *   time - The mission time of the block
+ *   blk - The block to batch (accel_p, gyro_p and mag_p share a layout)
+ *
+ * Returns:
+ *   0 on success, ENOMEM or ERANGE if a full batch left over from the last
+ *   packet doesn't fit
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_PYGMY_BATCH_IMU
+static int package_batched(struct packet_s *pkt, struct batch_s *batch,
+                           uint8_t kind, pkt_time_t time, const accel_p *blk)
+{
+  int err;
+
+  /* A full batch left over from the last packet goes out first */
+
+  if (batch_full(batch))
+    {
+      err = package_batch(pkt, batch, kind);
+      if (err) return err;
+    }
+
+  batch_push(batch, time, blk->x, blk->y, blk->z);
+
+  /* Send the batch off as soon as it fills up. The block is already in the
+   * batch, so a batch that doesn't fit just waits for the next packet.
+   */
+
+  if (batch_full(batch))
+    {
+      package_batch(pkt, batch, kind);
+    }
+
+  return 0;
+}
+#endif
+
+/****************************************************************************
+ * Name: package_imu
+ *
+ * Description:
+ *   Adds an IMU block to the packet. The log stream collects them into
+ *   batches with `CONFIG_PYGMY_BATCH_IMU`. The radio stream sends them on
+ *   their own, since its samples are too far apart for batches to fill
+ *   before they go stale.
+ *
+ * Returns:
+ *   0 on success, ENOMEM on no more packet space, ERANGE if the block is
+ *   too far from the packet's base time
+ *
+ ****************************************************************************/
+
+#if defined(CONFIG_SENSORS_LSM6DSO32) || defined(CONFIG_SENSORS_LIS2MDL)
+static int package_imu(struct packager_s *pkgr, struct packet_s *pkt,
+                       struct batch_s *batch, uint8_t kind, pkt_time_t time,
+                       const accel_p *blk)
+{
+#ifdef CONFIG_PYGMY_BATCH_IMU
+  if (pkgr->stream == PACKAGE_LOG)
+    {
+      return package_batched(pkt, batch, kind, time, blk);
+    }
+#else
+  (void)batch;
+#endif
+
+  return package_block(pkgr, pkt, kind, time, blk, sizeof(*blk));
+}
+#endif
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: packager_init
+ *
+ * Description:
+ *   Prepares the packaging state shared by all streams. Must be called once
+ *   before any stream is initialized.
+ *
+ ****************************************************************************/
+
+void packager_init(void)
+{
+  /* Altitude relative to the configured reference pressure */
+
+  altitude_init(CONFIG_PYGMY_ALT_REFPRESS);
+
+  /* Mark coordinates as initially invalid */
+
+#ifdef CONFIG_SENSORS_L86_XXX
+  coordinates.latitude = NAN;
+  coordinates.longitude = NAN;
+#endif
+}
+
+/****************************************************************************
+ * Name: package_init
+ *
+ * Description:
+ *   Resets the packaging state of a stream before its packets are
+ *   constructed.
+ *
+ * Arguments:
+ *   pkgr - The packaging state to reset
+ *   stream - The stream it packages
+ *
+ ****************************************************************************/
+
+void package_init(struct packager_s *pkgr, enum package_stream_e stream)
+{
+  pkgr->stream = stream;
+  pkgr->latest = 0;
+  pkgr->bulk = 0;
+  pkgr->alt.valid = false;
+  pkgr->volt.valid = false;
+
+  for (int i = 0; i < SENSOR_COUNT; i++)
+    {
+      pkgr->due[i] = 0;
+    }
+
+  /* The log stream sees every sample, so it feeds flight phase detection */
+
+  if (stream == PACKAGE_LOG)
+    {
+      phase_init();
+    }
+
+  /* Start with empty batches */
+
+#ifdef CONFIG_PYGMY_BATCH_IMU
+#ifdef CONFIG_SENSORS_LSM6DSO32
+  batch_init(&pkgr->accel_batch, PACKET_ACCEL);
+  batch_init(&pkgr->gyro_batch, PACKET_GYRO);
+#endif
+#ifdef CONFIG_SENSORS_LIS2MDL
+  batch_init(&pkgr->mag_batch, PACKET_MAG);
+#endif
+#endif
+}
+
+/****************************************************************************
+ * Name: package_uorb
+ *
+ * Description:
+ *   Packages some uORB sensor data as a block in a packet depending on which
+ *   sensor it originated from, if the stream takes this sample. GPS data is
+ *   not packaged immediately; it is stored and added to packets with
+ *   `package_coord`. With `CONFIG_PYGMY_BATCH_IMU`, IMU data in the log
+ *   stream is collected into batch blocks which are added to the packet
+ *   once full. A sample that doesn't fit, or is too far from the packet's
+ *   base time, leaves the packet and packaging state as they were, so it
+ *   can be packaged into the next packet.
+ *
+ * Arguments:
+ *   pkgr - The packaging state of the stream
+ *   pkt - The packet to add the block(s) to
+ *   sensor - The sensor which the data came from
+ *   data - The data read from the sensor
+ *   buf - The buffer to use to put the block in
+ *
+ * Returns:
+ *   0 on success, ENOMEM on no more packet space, ERANGE if the sample is
+ *   too far from the packet's base time
+ *
+ ****************************************************************************/
+
+int package_uorb(struct packager_s *pkgr, struct packet_s *pkt,
+                 enum sensor_kind sensor, void *data, void *buf)
+{
+  int err = 0;
+  pkt_time_t time = pkgr->latest;
+  pkt_time_t due = pkgr->due[sensor];
+  size_t len = pkt != NULL ? pkt->len : 0;
+
+  switch (sensor)
+    {
+#ifdef CONFIG_SENSORS_MS56XX
+    case SENSOR_BARO:
+      {
+        if (!package_due(pkgr, sensor,
+                         ((struct sensor_baro *)data)->timestamp))
+          {
+            break;
+          }
+
+        /* Pressure data */
+
+        time = block_init_pressure(buf, data);
+        err = package_block(pkgr, pkt, PACKET_PRESS, time, buf,
+                            sizeof(press_p));
+        if (err) break;
+
+        /* Temperature data */
+
+        time = block_init_temp(buf, data);
+        err = package_block(pkgr, pkt, PACKET_TEMP, time, buf,
+                            sizeof(temp_p));
+        if (err) break;
+
+        /* Altitude data */
+
+        time = block_init_alt(buf, data);
+        err = package_block(pkgr, pkt, PACKET_ALT, time, buf, sizeof(alt_p));
+        if (err == 0 && pkgr->stream == PACKAGE_LOG)
+          {
+            phase_update(time, ((alt_p *)buf)->alt);
+          }
+        break;
+      }
+#endif
+#ifdef CONFIG_SENSORS_LSM6DSO32
+    case SENSOR_ACCEL:
+      {
+        if (!package_due(pkgr, sensor,
+                         ((struct sensor_accel *)data)->timestamp))
+          {
+            break;
+          }
+
+        /* Accelerometer data */
+
+        time = block_init_accel(buf, data);
+        err = package_imu(pkgr, pkt, imu_batch(pkgr, accel_batch),
+                          PACKET_ACCEL, time, buf);
+        break;
+      }
+    case SENSOR_GYRO:
+      {
+        if (!package_due(pkgr, sensor,
+                         ((struct sensor_gyro *)data)->timestamp))
+          {
+            break;
+          }
+
+        /* Gyro data */
+
+        time = block_init_gyro(buf, data);
+        err = package_imu(pkgr, pkt, imu_batch(pkgr, gyro_batch),
+                          PACKET_GYRO, time, buf);
+        break;
+      }
+#endif
+#ifdef CONFIG_SENSORS_LIS2MDL
+    case SENSOR_MAG:
+      {
+        if (!package_due(pkgr, sensor,
+                         ((struct sensor_mag *)data)->timestamp))
+          {
+            break;
+          }
+
+        /* Magnetometer data */
+
+        time = block_init_mag(buf, data);
+        err = package_imu(pkgr, pkt, imu_batch(pkgr, mag_batch),
+                          PACKET_MAG, time, buf);
+        break;
+      }
+#endif
+#ifdef CONFIG_SENSORS_L86_XXX
+    case SENSOR_GPS:
+      {
+        /* Store the latest GPS coordinates */
+
+        memcpy(&coordinates, data, sizeof(coordinates));
+        time = us_to_ms(coordinates.timestamp);
+
+        /* The latest value table takes them as soon as they arrive */
+
+        if (pkgr->stream == PACKAGE_LATEST)
+          {
+            err = package_coord(pkgr, pkt, buf);
+          }
+        break;
+      }
+#endif
+    default:
+      break;
+    }
+
+  /* Take back the blocks of a sample that didn't fit whole */
+
+  if (err == ENOMEM || err == ERANGE)
+    {
+      pkt->len = len;
+      pkgr->due[sensor] = due;
+      return err;
+    }
+
+  if ((int32_t)(time - pkgr->latest) > 0)
+    {
+      pkgr->latest = time;
+    }
+
+  return err;
+}
+
+/****************************************************************************
+ * Name: package_volt
+ *
+ * Description:
+ *   Adds a battery voltage block to a packet.
+ *
+ * Arguments:
+ *   pkgr - The packaging state of the stream
+ *   pkt - The packet to add the block to
+ *   time - The mission time of the measurement
+ *   buf - The buffer holding the voltage block
+ *
+ * Returns:
+ *   0 on success, ENOMEM on no more packet space
+ *
+ ****************************************************************************/
+
+int package_volt(struct packager_s *pkgr, struct packet_s *pkt,
+                 pkt_time_t time, void *buf)
+{
+  return package_block(pkgr, pkt, PACKET_VOLT, time, buf, sizeof(volt_p));
+}
+
+/****************************************************************************
+ * Name: package_coord
+ *
+ * Description:
+ *   Adds the latest GPS coordinates to a packet, if they're valid. Stale
+ *   coordinates are skipped, since they would take up too much of the range
+ *   of block time offsets if they became the packet's base time. The radio
+ *   stream adds them when the packet is finished instead.
+ *
+ * Arguments:
+ *   pkgr - The packaging state of the stream
+ *   pkt - The packet to add the block to
+ *   buf - The buffer to use to put the block in
+ *
+ * Returns:
+ *   0 on success or if there are no valid coordinates, ENOMEM on no more
+ *   packet space
+ *
+ ****************************************************************************/
+
+int package_coord(struct packager_s *pkgr, struct packet_s *pkt, void *buf)
+{
+#ifdef CONFIG_SENSORS_L86_XXX
+  pkt_time_t time;
+
+  if (!isnan(coordinates.latitude) && !isnan(coordinates.longitude))
+    {
+      time = block_init_coord(buf, &coordinates);
+      if ((int32_t)(pkgr->latest - time) > COORD_MAXAGE)
+        {
+          return 0;
+        }
+
+      return package_block(pkgr, pkt, PACKET_COORD, time, buf,
+                           sizeof(coord_p));
+    }
+#else
+  (void)pkgr;
+  (void)pkt;
+  (void)buf;
+#endif
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: package_finish
+ *
+ * Description:
+ *   Completes a packet before it is published. A radio packet gets the
+ *   latest coordinates, altitude and voltage, in the space reserved for
+ *   them, and its IMU quota is reset for the next packet.
+ *
+ * Arguments:
+ *   pkgr - The packaging state of the stream
+ *   pkt - The packet to complete
+ *   buf - The buffer to use to put blocks in
+ *
+ * Returns:
+ *   0 on success
+ *
+ ****************************************************************************/
+
+int package_finish(struct packager_s *pkgr, struct packet_s *pkt, void *buf)
+{
+  const struct
+  {
+    struct package_held_s *held;
+    uint8_t kind;
+    size_t len;
+  } critical[] = {
+      {&pkgr->alt, PACKET_ALT, sizeof(alt_p)},
+      {&pkgr->volt, PACKET_VOLT, sizeof(volt_p)},
+  };
+#ifdef CONFIG_SENSORS_L86_XXX
+  pkt_time_t time;
+#endif
+
+  if (pkgr->stream != PACKAGE_RADIO)
+    {
+      return 0;
+    }
+
+  pkgr->bulk = 0;
+
+  /* The reserved space always fits these, so only values too far from the
+   * packet's base time to be added can fail, and those are left out
+   */
+
+#ifdef CONFIG_SENSORS_L86_XXX
+  if (!isnan(coordinates.latitude) && !isnan(coordinates.longitude))
+    {
+      time = block_init_coord(buf, &coordinates);
+      if ((int32_t)(pkgr->latest - time) <= COORD_MAXAGE)
+        {
+          packet_push_block(pkt, PACKET_COORD, time, buf, sizeof(coord_p));
+        }
+    }
+#else
+  (void)buf;
+#endif
+
+  for (size_t i = 0; i < sizeof(critical) / sizeof(critical[0]); i++)
+    {
+      if (!critical[i].held->valid ||
+          (int32_t)(pkgr->latest - critical[i].held->time) > COORD_MAXAGE)
+        {
+          continue;
+        }
+
+      packet_push_block(pkt, critical[i].kind, critical[i].held->time,
+                        critical[i].held->blk, critical[i].len);
+    }
+
+  return 0;
+}
+
+/****************************************************************************
+ * Name: package_flush
+ *
+ * Description:
+ *   Adds batches that filled up but didn't fit in the previous packet. Should
+ *   be called at the start of each packet. Batches that still don't fit
+ *   wait for the next packet.
+ *
+ * Arguments:
+ *   pkgr - The packaging state of the stream
+ *   pkt - The packet to add the batches to
+ *
+ * Returns:
+ *   0 on success, ENOMEM on no more packet space, ERANGE if a batch is
+ *   too far from the packet's base time
+ *
+ ****************************************************************************/
+
+int package_flush(struct packager_s *pkgr, struct packet_s *pkt)
+{
+  int err = 0;
+
+#ifdef CONFIG_PYGMY_BATCH_IMU
+  struct
+  {
+    struct batch_s *batch;
+    uint8_t kind;
+  } pending[] = {
+#ifdef CONFIG_SENSORS_LSM6DSO32
+      {&pkgr->accel_batch, PACKET_ACCEL},
+      {&pkgr->gyro_batch, PACKET_GYRO},
+#endif
+#ifdef CONFIG_SENSORS_LIS2MDL
+      {&pkgr->mag_batch, PACKET_MAG},
+#endif
+  };
+
+  for (size_t i = 0; i < sizeof(pending) / sizeof(pending[0]); i++)
+    {
+      if (!batch_full(pending[i].batch))
+        {
+          continue;
+        }
+
+      err = package_batch(pkt, pending[i].batch, pending[i].kind);
+      if (err == ENOMEM) break;
+    }
+#else
+  (void)pkgr;
+  (void)pkt;
+#endif
+
+  return err;
+}
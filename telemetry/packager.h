@@ -0,0 +1,95 @@
+#ifndef _PYGMY_PACKAGER_H_
+#define _PYGMY_PACKAGER_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <uORB/uORB.h>
+
+#include "../packets/packets.h"
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Sensor indexes */
+
+enum sensor_kind
+{
+#ifdef CONFIG_SENSORS_MS56XX
+  SENSOR_BARO,
+#endif
+#ifdef CONFIG_SENSORS_LSM6DSO32
+  SENSOR_ACCEL,
+  SENSOR_GYRO,
+#endif
+#ifdef CONFIG_SENSORS_LIS2MDL
+  SENSOR_MAG,
+#endif
+#ifdef CONFIG_SENSORS_L86_XXX
+  SENSOR_GPS,
+#endif
+  SENSOR_COUNT, /* Number of sensors */
+};
+
+/* Packet streams built from the sensor data */
+
+enum package_stream_e
+{
+  PACKAGE_LOG,      /* Every sample, for logging */
+  PACKAGE_RADIO,    /* Samples decimated to the radio stream rates */
+  PACKAGE_NSTREAMS, /* Number of streams */
+  PACKAGE_LATEST,   /* Every sample, into the radio's latest value table */
+};
+
+/* Latest value of a critical block kind, held back until the radio packet
+ * is finished
+ */
+
+struct package_held_s
+{
+  bool valid;                  /* A value is held */
+  pkt_time_t time;             /* Mission time of the value */
+  uint8_t blk[sizeof(alt_p)];  /* The block (alt_p or volt_p) */
+};
+
+/* Packaging state of one packet stream */
+
+struct packager_s
+{
+  enum package_stream_e stream; /* Stream being packaged */
+  pkt_time_t latest;            /* Mission time of the newest data packaged */
+  pkt_time_t due[SENSOR_COUNT]; /* When the next sample of a sensor is due */
+  size_t bulk;                  /* Radio packet bytes used by IMU blocks */
+  struct package_held_s alt;    /* Latest altitude for the radio packet */
+  struct package_held_s volt;   /* Latest voltage for the radio packet */
+#ifdef CONFIG_PYGMY_BATCH_IMU
+#ifdef CONFIG_SENSORS_LSM6DSO32
+  struct batch_s accel_batch; /* Accelerometer samples being batched */
+  struct batch_s gyro_batch;  /* Gyroscope samples being batched */
+#endif
+#ifdef CONFIG_SENSORS_LIS2MDL
+  struct batch_s mag_batch; /* Magnetometer samples being batched */
+#endif
+#endif
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void packager_init(void);
+void package_init(struct packager_s *pkgr, enum package_stream_e stream);
+int package_uorb(struct packager_s *pkgr, struct packet_s *pkt,
+                 enum sensor_kind sensor, void *data, void *buf);
+int package_volt(struct packager_s *pkgr, struct packet_s *pkt,
+                 pkt_time_t time, void *buf);
+int package_coord(struct packager_s *pkgr, struct packet_s *pkt, void *buf);
+int package_flush(struct packager_s *pkgr, struct packet_s *pkt);
+int package_finish(struct packager_s *pkgr, struct packet_s *pkt, void *buf);
+
+#endif // _PYGMY_PACKAGER_H_
@@ -10,6 +10,7 @@
 #include <pthread.h>
 #include <stdio.h>
 #include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
 #if defined(CONFIG_RP2040_ADC)
@@ -21,6 +22,7 @@
 #include "../common/configuration.h"
 #include "../packets/packets.h"
 #include "arguments.h"
+#include "packager.h"
 #include "syncro.h"
 #include "syslogging.h"
 
@@ -32,45 +34,51 @@
 
 #define array_len(arr) sizeof(arr) / sizeof((arr)[0])
 
-/* Sensor indexes */
+/* Longest time a radio packet is built for before it is sent */
 
-enum sensor_kind
-{
-#ifdef CONFIG_SENSORS_MS56XX
-  SENSOR_BARO,
-#endif
-#ifdef CONFIG_SENSORS_LSM6DSO32
-  SENSOR_ACCEL,
-  SENSOR_GYRO,
-#endif
-#ifdef CONFIG_SENSORS_LIS2MDL
-  SENSOR_MAG,
+#ifndef CONFIG_PYGMY_RADIO_PERIOD_MS
+#define CONFIG_PYGMY_RADIO_PERIOD_MS 1000
 #endif
-#ifdef CONFIG_SENSORS_L86_XXX
-  SENSOR_GPS,
+
+/* Packet streams built. In latest value mode the radio assembles its own
+ * packets, so only the log stream is built.
+ */
+
+#ifdef CONFIG_PYGMY_RADIO_LATEST
+#define PACKET_NSTREAMS (PACKAGE_LOG + 1)
+#else
+#define PACKET_NSTREAMS PACKAGE_NSTREAMS
 #endif
-};
 
 /****************************************************************************
- * Private Data
+ * Private Types
  ****************************************************************************/
 
-/* Buffer for packet header construction */
+/* A stream of packets built from the sensor data */
 
-static struct packet_hdr_s pkt_hdr;
+struct stream_s
+{
+  syncro_t *syncro;            /* Ring the stream is published to */
+  struct packet_s *pkt;        /* Packet under construction */
+  struct packet_hdr_s hdr;     /* Header of the stream's packets */
+  struct packager_s pkgr;      /* Packaging state of the stream */
+  pkt_time_t deadline;         /* Time to publish the packet by */
+  size_t start_len;            /* Packet length before leftover batches */
+};
 
-/* Packet under construction */
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
 
-static struct packet_s pkt_a;
-static struct packet_s pkt_b;
+/* The full rate log stream and the decimated radio stream */
 
-/* Buffer for constructing packets */
+static struct stream_s streams[PACKET_NSTREAMS];
 
-static uint8_t pkt_bufa[CONFIG_PYGMY_PACKET_MAXLEN];
-static uint8_t pkt_bufb[CONFIG_PYGMY_PACKET_MAXLEN];
+/* Packaging state of the radio's latest value table */
 
-static struct packet_s *pkt_cur = &pkt_a;
-static struct packet_s *pkt_prev = &pkt_b;
+#ifdef CONFIG_PYGMY_RADIO_LATEST
+static struct packager_s latest;
+#endif
 
 /* Buffer to store blocks under construction temporarily */
 
@@ -82,12 +90,6 @@ static uint8_t block_buf[32];
 
 static uint8_t uorb_data[72];
 
-/* Latest GPS coordinate to send out */
-
-#ifdef CONFIG_SENSORS_L86_XXX
-static struct sensor_gnss coordinates;
-#endif
-
 /* uORB sensor polling */
 
 struct pollfd fds[] = {
@@ -160,107 +162,204 @@ static const uint32_t frequencies[] = {
  * Private Functions
  ****************************************************************************/
 
-/*
- * Packages some uORB sensor data as a block in the current packet depending
- * which sensor it originated from.
- * WARNING: modifies `pkt_cur`, global within this thread
+/****************************************************************************
+ * Name: to_millivolts
  *
- * @param sensor The sensor which the data came from
- * @param data The data read from the sensor
- * @param buf The buffer to use to put the block in
- * @return 0 on success, ENOMEM on no more packet space
- */
-static int package_uorb(enum sensor_kind sensor, void *data, void *buf)
-{
-  int err = 0;
+ * Description:
+ *   Converts an ADC reading to a millivolts battery reading. Assumes maximum
+ *   battery voltage is 4.2V.
+ *
+ ****************************************************************************/
 
-  switch (sensor)
-    {
-#ifdef CONFIG_SENSORS_MS56XX
-    case SENSOR_BARO:
-      {
-        /* Pressure data */
+#if defined(CONFIG_RP2040_ADC)
+uint16_t to_millivolts(struct adc_msg_s *reading)
+{
+  /* NOTE: the resistor divider on the board will read 3.231V when the battery
+   * voltage is at 4.2. Hence, for a more accurate reading, we use the
+   * constant of 4.3 volts in our calculation. This number would result in a
+   * full 3.308V measurement from the ADC, so our calculated battery voltage
+   * will be closer to the real 4.2.
+   */
+  return (4300 * (reading->am_data >> 16)) / (32768);
+}
+#endif
 
-        block_init_pressure(buf, data);
-        err = packet_push_block(pkt_cur, PACKET_PRESS, buf, sizeof(press_p));
-        if (err == ENOMEM) break;
+/****************************************************************************
+ * Name: mission_time
+ *
+ * Description:
+ *   Gets the current mission time in milliseconds. This uses the same clock
+ *   as uORB sample timestamps.
+ *
+ ****************************************************************************/
 
-        /* Temperature data */
+static pkt_time_t mission_time(void)
+{
+  struct timespec now;
 
-        block_init_temp(buf, data);
-        err = packet_push_block(pkt_cur, PACKET_TEMP, buf, sizeof(temp_p));
-        if (err == ENOMEM) break;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
 
-        /* Altitude data */
+/****************************************************************************
+ * Name: stream_start
+ *
+ * Description:
+ *   Claims a fresh packet for the stream from its ring and starts it off
+ *   with the header, a battery measurement, the latest GPS coordinates and
+ *   any IMU batches left over from the last packet.
+ *
+ * Arguments:
+ *   stream - The stream to start a packet in
+ *   adc - The battery ADC file descriptor
+ *
+ ****************************************************************************/
 
-        block_init_alt(buf, data);
-        err = packet_push_block(pkt_cur, PACKET_ALT, buf, sizeof(alt_p));
-        if (err == ENOMEM) break;
-      }
+static void stream_start(struct stream_s *stream, int adc)
+{
+  int err;
+#if defined(CONFIG_RP2040_ADC)
+  struct adc_msg_s voltage;
+  ssize_t b_read;
 #endif
-#ifdef CONFIG_SENSORS_LSM6DSO32
-    case SENSOR_ACCEL:
-      {
-        /* Accelerometer data */
-
-        block_init_accel(buf, data);
-        err = packet_push_block(pkt_cur, PACKET_ACCEL, buf, sizeof(accel_p));
-        break;
-      }
-    case SENSOR_GYRO:
-      {
-        /* Gyro data */
-
-        block_init_gyro(buf, data);
-        err = packet_push_block(pkt_cur, PACKET_GYRO, buf, sizeof(gyro_p));
-        break;
-      }
+
+  stream->pkt = syncro_claim(stream->syncro);
+  stream->deadline = mission_time() + CONFIG_PYGMY_RADIO_PERIOD_MS;
+
+  /* Add header to packet */
+
+  err = packet_push(stream->pkt, &stream->hdr, sizeof(stream->hdr));
+  if (err)
+    {
+      pyerr("Out of packet space!\n");
+    }
+
+  /* Add one battery measurement to every packet */
+
+#if defined(CONFIG_RP2040_ADC)
+  b_read = read(adc, &voltage, sizeof(voltage));
+  if (b_read < 0)
+    {
+      pyerr("Couldn't read battery voltage: %d", errno);
+    }
+  else if (b_read < sizeof(voltage))
+    {
+      pywarn("Couldn't read full battery voltage\n");
+    }
+  else
+    {
+      block_init_volt((void *)block_buf, to_millivolts(&voltage));
+      package_volt(&stream->pkgr, stream->pkt, mission_time(), block_buf);
+#ifdef CONFIG_PYGMY_RADIO_LATEST
+      package_volt(&latest, NULL, mission_time(), block_buf);
 #endif
-#ifdef CONFIG_SENSORS_LIS2MDL
-    case SENSOR_MAG:
-      {
-        /* Magnetometer data */
-
-        block_init_mag(buf, data);
-        err = packet_push_block(pkt_cur, PACKET_MAG, buf, sizeof(mag_p));
-        break;
-      }
+    }
+#else
+  (void)adc;
 #endif
-#ifdef CONFIG_SENSORS_L86_XXX
-    case SENSOR_GPS:
-      {
-        /* Store the latest GPS coordinates */
 
-        memcpy(&coordinates, data, sizeof(coordinates));
-        break;
-      }
-#endif
+  /* Add the latest GPS coordinates to every packet if they're valid */
+
+  package_coord(&stream->pkgr, stream->pkt, block_buf);
+
+  /* Add IMU batches left over from the last packet. Those that don't fit
+   * wait for the next one.
+   */
+
+  stream->start_len = stream->pkt->len;
+  package_flush(&stream->pkgr, stream->pkt);
+}
+
+/****************************************************************************
+ * Name: stream_publish
+ *
+ * Description:
+ *   Finishes the stream's packet, shares it with its consumers and starts
+ *   the next one.
+ *
+ * Arguments:
+ *   stream - The stream to publish the packet of
+ *   adc - The battery ADC file descriptor
+ *
+ ****************************************************************************/
+
+static void stream_publish(struct stream_s *stream, int adc)
+{
+  int err;
+
+  package_finish(&stream->pkgr, stream->pkt, block_buf);
+
+  err = syncro_publish(stream->syncro);
+  if (err)
+    {
+      pyerr("Couldn't publish new packet: %d\n", err);
     }
 
-  return err;
+  /* Update packet sequence number */
+
+  stream->hdr.num++;
+  stream_start(stream, adc);
 }
 
 /****************************************************************************
- * Name: to_millivolts
+ * Name: stream_package
  *
  * Description:
- *   Converts an ADC reading to a millivolts battery reading. Assumes maximum
- *   battery voltage is 4.2V.
+ *   Adds a sample to the stream's packet. A packet out of space, or whose
+ *   base time is too far from the sample's, is published and the sample
+ *   goes into the next one. The new packet may already be full of IMU
+ *   batches left over from the last one, so this repeats until the sample
+ *   fits. It is only dropped if it doesn't fit a packet holding nothing but
+ *   the blocks every packet starts with.
+ *
+ * Arguments:
+ *   stream - The stream to add the sample to
+ *   adc - The battery ADC file descriptor
+ *   sensor - The sensor the sample in `uorb_data` came from
  *
  ****************************************************************************/
 
-#if defined(CONFIG_RP2040_ADC)
-uint16_t to_millivolts(struct adc_msg_s *reading)
+static void stream_package(struct stream_s *stream, int adc, int sensor)
 {
-  /* NOTE: the resistor divider on the board will read 3.231V when the battery
-   * voltage is at 4.2. Hence, for a more accurate reading, we use the
-   * constant of 4.3 volts in our calculation. This number would result in a
-   * full 3.308V measurement from the ADC, so our calculated battery voltage
-   * will be closer to the real 4.2.
-   */
-  return (4300 * (reading->am_data >> 16)) / (32768);
+  int err;
+
+  for (;;)
+    {
+      err = package_uorb(&stream->pkgr, stream->pkt, sensor, uorb_data,
+                         block_buf);
+      if (err != ENOMEM && err != ERANGE)
+        {
+          return;
+        }
+
+      if (stream->pkt->len <= stream->start_len)
+        {
+          pywarn("Sample doesn't fit a new packet, dropped\n");
+          return;
+        }
+
+      stream_publish(stream, adc);
+    }
 }
+
+/****************************************************************************
+ * Name: poll_timeout
+ *
+ * Description:
+ *   Gets how long to poll the sensors for: until the radio packet is due,
+ *   or forever if the radio assembles its own packets.
+ *
+ ****************************************************************************/
+
+static int poll_timeout(void)
+{
+#ifdef CONFIG_PYGMY_RADIO_LATEST
+  return -1;
+#else
+  int32_t timeout = streams[PACKAGE_RADIO].deadline - mission_time();
+  return timeout > 0 ? timeout : 0;
 #endif
+}
 
 /****************************************************************************
  * Public Functions
@@ -278,26 +377,26 @@ uint16_t to_millivolts(struct adc_msg_s *reading)
 void *packet_thread(void *arg)
 {
   int err;
-#if defined(CONFIG_RP2040_ADC)
-  int adc;
-  struct adc_msg_s voltage;
-#endif
+  int adc = -1;
 
   /* Unpack arguments */
 
-  syncro_t *syncro = args_syncro(arg);
   struct configuration_s *config = args_config(arg);
 
   pyinfo("Packet thread started.\n");
 
-  /* Prepare packet header for constructing packets */
-
-  packet_header_init(&pkt_hdr, config->radio.callsign, 0);
+  packager_init();
 
-  /* Prepare packets for construction */
+  /* Every sample goes to the log, the radio gets a decimated copy or the
+   * latest values
+   */
 
-  packet_init(&pkt_a, pkt_bufa);
-  packet_init(&pkt_b, pkt_bufb);
+  streams[PACKAGE_LOG].syncro = args_syncro(arg);
+#ifdef CONFIG_PYGMY_RADIO_LATEST
+  package_init(&latest, PACKAGE_LATEST);
+#else
+  streams[PACKAGE_RADIO].syncro = args_radio(arg);
+#endif
 
   /* Get file descriptor to ADC for battery measurements */
 
@@ -310,16 +409,9 @@ void *packet_thread(void *arg)
     }
 #endif
 
-    /* Mark coordinates as initially invalid */
-
-#ifdef CONFIG_SENSORS_L86_XXX
-  coordinates.latitude = NAN;
-  coordinates.longitude = NAN;
-#endif
-
   /* Subscribe to all sensors */
 
-  for (int i = 0; i < array_len(fds); i++)
+  for (size_t i = 0; i < array_len(fds); i++)
     {
       fds[i].fd = orb_subscribe(metas[i]);
       if (fds[i].fd < 0)
@@ -363,7 +455,7 @@ void *packet_thread(void *arg)
 
   /* Set sensor frequencies */
 
-  for (int i = 0; i < array_len(frequencies); i++)
+  for (size_t i = 0; i < array_len(frequencies); i++)
     {
       err = orb_set_frequency(fds[i].fd, frequencies[i]);
       if (err < 0)
@@ -373,123 +465,66 @@ void *packet_thread(void *arg)
         }
     }
 
+  /* Reset packaging state and start the first packet of each stream. Each
+   * stream numbers its packets on its own.
+   */
+
+  for (size_t s = 0; s < array_len(streams); s++)
+    {
+      packet_header_init(&streams[s].hdr, config->radio.callsign, 0);
+      package_init(&streams[s].pkgr, s);
+      stream_start(&streams[s], adc);
+    }
+
   /* Create packets while sampling sensors continually. */
 
   for (;;)
     {
-      /* Reset current packet for fresh construction */
-
-      packet_reset(pkt_cur);
+      /* Poll until some data is available or the radio packet is due */
 
-      /* Add header to packet */
+      err = poll(fds, array_len(fds), poll_timeout());
 
-      err = packet_push(pkt_cur, &pkt_hdr, sizeof(pkt_hdr));
-      if (err)
+      if (err < 0)
         {
-          pyerr("Out of packet space!\n");
+          pyerr("Error polling sensors: %d\n", errno);
+          continue;
         }
 
-        /* Construct a packet from sensor data */
+      /* Package any data available into both streams */
 
-        /* Add one battery measurement to every packet */
-
-#if defined(CONFIG_RP2040_ADC)
-      ssize_t b_read = read(adc, &voltage, sizeof(voltage));
-      if (b_read < 0)
+      for (size_t i = 0; i < array_len(fds); i++)
         {
-          err = errno;
-          pyerr("Couldn't read battery voltage: %d", err);
-          goto uorb_collection;
-        }
-      else if (b_read < sizeof(voltage))
-        {
-          pywarn("Couldn't read full battery voltage\n");
-          goto uorb_collection;
-        }
-
-      /* We read some battery voltage, time to make a packet */
+          if (!(fds[i].revents & POLLIN)) continue;
 
-      block_init_volt((void *)block_buf, to_millivolts(&voltage));
-      err =
-          packet_push_block(pkt_cur, PACKET_VOLT, block_buf, sizeof(volt_p));
-      if (err == ENOMEM) break;
-#endif
-
-      /* Add the latest GPS coordinates to every packet if they're valid */
-
-#ifdef CONFIG_SENSORS_L86_XXX
-      if (!isnan(coordinates.latitude) && !isnan(coordinates.longitude))
-        {
-          block_init_coord((void *)block_buf, &coordinates);
-          err = packet_push_block(pkt_cur, PACKET_COORD, block_buf,
-                                  sizeof(coord_p));
-        }
-      if (err == ENOMEM) break;
-#endif
-
-    uorb_collection:
-      for (;;)
-        {
-          /* Poll forever until some data is available */
-
-          err = poll(fds, array_len(fds), -1);
+          fds[i].revents = 0; /* Reset events */
 
+          err = orb_copy(metas[i], fds[i].fd, uorb_data);
           if (err < 0)
             {
-              pyerr("Error polling sensors: %d\n", errno);
+              pyerr("Error copying uORB data: %d\n", errno);
               continue;
             }
 
-          /* Polling worked and we have some data to package */
-
-          for (int i = 0; i < array_len(fds); i++)
+          for (size_t s = 0; s < array_len(streams); s++)
             {
-              /* Some data available on this sensor */
-
-              if (fds[i].revents & POLLIN)
-                {
-                  fds[i].revents = 0; /* Reset events */
-
-                  err = orb_copy(metas[i], fds[i].fd, uorb_data);
-                  if (err < 0)
-                    {
-                      pyerr("Error copying uORB data: %d\n", errno);
-                      continue;
-                    }
-
-                  /* Package according to sensor */
-
-                  err = package_uorb(i, uorb_data, block_buf);
-
-                  /* Out of packet space, stop reading this set of poll events
-                   */
-                  if (err == ENOMEM) break;
-                }
+              stream_package(&streams[s], adc, i);
             }
 
-          /* We exited the collection loop after polling, if out of memory in
-           * this packet then break completely to finish it */
-
-          if (err == ENOMEM) break;
+#ifdef CONFIG_PYGMY_RADIO_LATEST
+          package_uorb(&latest, NULL, i, uorb_data, block_buf);
+#endif
         }
 
-      /* Share this packet with other threads using syncro monitor */
+      /* The radio packet goes out on time even if it isn't full, so the
+       * ground station gets regular updates
+       */
 
-      err = syncro_publish(syncro, pkt_cur);
-      if (err)
+#ifndef CONFIG_PYGMY_RADIO_LATEST
+      if ((int32_t)(mission_time() - streams[PACKAGE_RADIO].deadline) >= 0)
         {
-          pyerr("Couldn't publish new packet: %d\n", err);
+          stream_publish(&streams[PACKAGE_RADIO], adc);
         }
-
-      /* Swap to already consumed packet buffer for next iteration */
-
-      struct packet_s *tmp = pkt_cur;
-      pkt_cur = pkt_prev;
-      pkt_prev = tmp;
-
-      /* Update packet sequence number */
-
-      pkt_hdr.num++;
+#endif
     }
 
   return 0;
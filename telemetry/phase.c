@@ -0,0 +1,180 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "phase.h"
+#include "syslogging.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Smoothing of altitude samples, as a right shift: each sample moves the
+ * smoothed altitude 1/8 of the way
+ */
+
+#define ALT_SMOOTHING 3
+
+/* Smoothing of the ground altitude while on the pad. Much slower, so it
+ * follows weather but not a launch.
+ */
+
+#define GROUND_SMOOTHING 8
+
+/* Altitude change that still counts as holding steady for landing, in
+ * centimetres
+ */
+
+#define LANDED_BAND 200
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+static atomic_int phase; /* Current phase, read from any thread */
+
+/* Detection state, only touched by the thread feeding altitudes */
+
+static int32_t alt;         /* Smoothed altitude */
+static int32_t ground;      /* Smoothed ground altitude */
+static int32_t peak;        /* Highest smoothed altitude */
+static int32_t steady_alt;  /* Altitude when it last started holding */
+static pkt_time_t steady;   /* Time when it last started holding */
+static bool started;        /* An altitude was seen */
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: phase_set
+ ****************************************************************************/
+
+static void phase_set(enum flight_phase_e next, pkt_time_t time)
+{
+  atomic_store(&phase, next);
+  pyinfo("Flight phase %s at %lu ms, altitude %ld cm\n", phase_name(next),
+         (unsigned long)time, (long)alt);
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: phase_init
+ *
+ * Description:
+ *   Resets flight phase detection to waiting on the pad.
+ *
+ ****************************************************************************/
+
+void phase_init(void)
+{
+  atomic_store(&phase, PHASE_PAD);
+  started = false;
+}
+
+/****************************************************************************
+ * Name: phase_update
+ *
+ * Description:
+ *   Feeds a barometric altitude sample to flight phase detection. Launch is
+ *   a rise of CONFIG_PYGMY_PHASE_LAUNCH_ALT above the ground, apogee a drop
+ *   of CONFIG_PYGMY_PHASE_APOGEE_DROP below the peak, and landing the
+ *   altitude holding within a couple of metres for
+ *   CONFIG_PYGMY_PHASE_LANDED_MS. All of them use smoothed altitudes, so a
+ *   single noisy sample can't trigger them.
+ *
+ *   NOTE: Only one thread may feed samples.
+ *
+ * Arguments:
+ *   time - The mission time of the sample
+ *   sample - The altitude in centimetres
+ *
+ ****************************************************************************/
+
+void phase_update(pkt_time_t time, int32_t sample)
+{
+  if (!started)
+    {
+      alt = ground = peak = steady_alt = sample;
+      steady = time;
+      started = true;
+      return;
+    }
+
+  alt += (sample - alt) >> ALT_SMOOTHING;
+
+  switch (atomic_load(&phase))
+    {
+    case PHASE_PAD:
+      if (alt - ground > CONFIG_PYGMY_PHASE_LAUNCH_ALT)
+        {
+          peak = alt;
+          phase_set(PHASE_ASCENT, time);
+          break;
+        }
+
+      ground += (alt - ground) >> GROUND_SMOOTHING;
+      break;
+
+    case PHASE_ASCENT:
+      if (alt > peak)
+        {
+          peak = alt;
+        }
+      else if (peak - alt > CONFIG_PYGMY_PHASE_APOGEE_DROP)
+        {
+          steady_alt = alt;
+          steady = time;
+          phase_set(PHASE_DESCENT, time);
+        }
+      break;
+
+    case PHASE_DESCENT:
+      if (abs(alt - steady_alt) > LANDED_BAND)
+        {
+          steady_alt = alt;
+          steady = time;
+        }
+      else if (time - steady >= CONFIG_PYGMY_PHASE_LANDED_MS)
+        {
+          phase_set(PHASE_LANDED, time);
+        }
+      break;
+
+    case PHASE_LANDED:
+      break;
+    }
+}
+
+/****************************************************************************
+ * Name: phase_get
+ *
+ * Description:
+ *   Gets the current flight phase. Safe to call from any thread.
+ *
+ ****************************************************************************/
+
+enum flight_phase_e phase_get(void) { return atomic_load(&phase); }
+
+/****************************************************************************
+ * Name: phase_name
+ ****************************************************************************/
+
+const char *phase_name(enum flight_phase_e phase)
+{
+  static const char *const names[] = {
+      [PHASE_PAD] = "pad",
+      [PHASE_ASCENT] = "ascent",
+      [PHASE_DESCENT] = "descent",
+      [PHASE_LANDED] = "landed",
+  };
+
+  return names[phase];
+}
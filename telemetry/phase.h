@@ -0,0 +1,59 @@
+#ifndef _PYGMY_PHASE_H_
+#define _PYGMY_PHASE_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdint.h>
+
+#include "../packets/packets.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Rise above the ground altitude that signals launch, in centimetres */
+
+#ifndef CONFIG_PYGMY_PHASE_LAUNCH_ALT
+#define CONFIG_PYGMY_PHASE_LAUNCH_ALT 2000
+#endif
+
+/* Drop below the peak altitude that signals apogee, in centimetres */
+
+#ifndef CONFIG_PYGMY_PHASE_APOGEE_DROP
+#define CONFIG_PYGMY_PHASE_APOGEE_DROP 500
+#endif
+
+/* Time the altitude must hold steady for to signal landing, in
+ * milliseconds
+ */
+
+#ifndef CONFIG_PYGMY_PHASE_LANDED_MS
+#define CONFIG_PYGMY_PHASE_LANDED_MS 5000
+#endif
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Flight phases, in the order they happen */
+
+enum flight_phase_e
+{
+  PHASE_PAD = 0, /* Waiting for launch */
+  PHASE_ASCENT,  /* Launched, climbing */
+  PHASE_DESCENT, /* Past apogee */
+  PHASE_LANDED,  /* Back on the ground */
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void phase_init(void);
+void phase_update(pkt_time_t time, int32_t sample);
+enum flight_phase_e phase_get(void);
+const char *phase_name(enum flight_phase_e phase);
+
+#endif // _PYGMY_PHASE_H_
@@ -6,11 +6,16 @@
 #include <fcntl.h>
 #include <pthread.h>
 #include <sys/ioctl.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "../common/configuration.h"
+#include "../packets/fec.h"
 #include "../packets/packets.h"
 #include "arguments.h"
+#include "radioprofile.h"
+#include "radiosched.h"
+#include "snapshot.h"
 #include "syncro.h"
 #include "syslogging.h"
 
@@ -26,6 +31,21 @@
 #define CONFIG_PYGMY_TELEM_RADIOPATH "/dev/rn2903"
 #endif
 
+/* Packets in each parity group, and groups interleaved */
+
+#ifndef CONFIG_PYGMY_RADIO_FEC_GROUP
+#define CONFIG_PYGMY_RADIO_FEC_GROUP 8
+#endif
+
+#ifndef CONFIG_PYGMY_RADIO_FEC_DEPTH
+#define CONFIG_PYGMY_RADIO_FEC_DEPTH 1
+#endif
+
+#if (CONFIG_PYGMY_RADIO_FEC_GROUP - 1) * CONFIG_PYGMY_RADIO_FEC_DEPTH >=    \
+    FEC_SPAN_MAX
+#error "Radio parity groups span too many packets"
+#endif
+
 /* Handle ioctl errors by storing the value of errno, printing the error
  * information and exiting the thread. This is a cancellation point.
  */
@@ -46,9 +66,7 @@
  * Private Data
  ****************************************************************************/
 
-static struct packet_s *pkt; /* Shared packet pointer */
-
-static uint8_t local_contents[256]; /* Packet contents local copy */
+static uint8_t local_contents[CONFIG_PYGMY_PACKET_MAXLEN]; /* Local copy */
 
 /* Packet local copy */
 
@@ -57,12 +75,236 @@ static struct packet_s local_packet = {
     .len = 0,
 };
 
+#ifdef CONFIG_PYGMY_RADIO_FEC
+/* Parity of the packets sent, and the parity packet to send next */
+
+static struct fec_group_s fec_groups[CONFIG_PYGMY_RADIO_FEC_DEPTH];
+static struct fec_enc_s fec;
+
+static uint8_t parity_contents[CONFIG_PYGMY_PACKET_MAXLEN];
+
+static struct packet_s parity_packet = {
+    .contents = parity_contents,
+    .len = 0,
+};
+#endif
+
+#ifdef CONFIG_PYGMY_RADIO_LATEST
+/* Header of the packets assembled from the latest values */
+
+static struct packet_hdr_s radio_hdr;
+
+/* Version of the latest values last sent */
+
+static uint32_t radio_version;
+#else
+/* A time that has always passed, to check for packets without waiting */
+
+static const struct timespec radio_now = {0};
+
+/* Packets the radio was too slow to send */
+
+static uint32_t radio_drops;
+#endif
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
 
 static void close_fd(void *arg) { close(*(int *)(arg)); }
 
+/****************************************************************************
+ * Name: radio_sleep
+ *
+ * Description:
+ *   Sleeps for `us` microseconds.
+ *
+ ****************************************************************************/
+
+static void radio_sleep(uint32_t us)
+{
+  struct timespec delay;
+
+  delay.tv_sec = us / 1000000;
+  delay.tv_nsec = (us % 1000000) * 1000;
+  nanosleep(&delay, NULL);
+}
+
+/****************************************************************************
+ * Name: radio_send
+ *
+ * Description:
+ *   Transmits a packet. The airtime is used up as the transmission starts,
+ *   so it is accounted for even if the driver doesn't block until the
+ *   packet is sent.
+ *
+ ****************************************************************************/
+
+static void radio_send(int radio, const struct packet_s *pkt)
+{
+  ssize_t b_sent;
+
+  radiosched_sent(pkt->len);
+
+  b_sent = write(radio, pkt->contents, pkt->len);
+  if (b_sent < 0)
+    {
+      pyerr("Packet failed to send: %d\n", errno);
+      return;
+    }
+
+  pydebug("Transmitted %d.\n", ((struct packet_hdr_s *)(pkt->contents))->num);
+}
+
+#ifdef CONFIG_PYGMY_RADIO_FEC
+/****************************************************************************
+ * Name: radio_parity
+ *
+ * Description:
+ *   Adds the packet about to be sent to its parity group. Once a group is
+ *   complete, its parity packet is sent after the packet as soon as there
+ *   is airtime, so the ground can rebuild any one lost packet of the group.
+ *   A packet that can't be protected is sent all the same.
+ *
+ * Returns:
+ *   0 on success, EMSGSIZE if the packet was sent without protection.
+ *
+ ****************************************************************************/
+
+static int radio_parity(int radio, struct packet_s *pkt)
+{
+  uint32_t wait;
+  int err;
+
+  err = fec_enc_push(&fec, pkt);
+  radio_send(radio, pkt);
+  if (err)
+    {
+      return err;
+    }
+
+  if (fec_enc_parity(&fec, &parity_packet) == 0)
+    {
+      while ((wait = radiosched_wait(parity_packet.len)) > 0)
+        {
+          radio_sleep(wait);
+        }
+
+      radio_send(radio, &parity_packet);
+    }
+
+  return 0;
+}
+#endif
+
+#ifdef CONFIG_PYGMY_RADIO_PROFILES
+/****************************************************************************
+ * Name: radio_profile
+ *
+ * Description:
+ *   Applies the radio profile of the flight phase once its change has been
+ *   announced to the ground.
+ *
+ ****************************************************************************/
+
+static void radio_profile(int radio, struct radio_config_s *config)
+{
+  if (!radioprofile_switch(config))
+    {
+      return;
+    }
+
+#ifdef CONFIG_LPWAN_RN2XX3
+  if (ioctl(radio, WLIOC_SETSPREAD, config->spread) < 0)
+    {
+      pyerr("Couldn't set radio spread factor: %d\n", errno);
+    }
+#else
+  (void)radio;
+#endif
+
+  radiosched_config(config);
+}
+#endif
+
+/****************************************************************************
+ * Name: radio_next
+ *
+ * Description:
+ *   Gets the next packet to send into the local packet, once the radio link
+ *   has airtime for it. The freshest data available when the link is free
+ *   is sent: in latest value mode the packet is assembled from the newest
+ *   value of every block kind, otherwise packets published while waiting
+ *   replace the one waiting.
+ *
+ * Returns:
+ *   0 on success, errno error code on failure
+ *
+ ****************************************************************************/
+
+#ifdef CONFIG_PYGMY_RADIO_LATEST
+static int radio_next(syncro_t *syncro)
+{
+  uint32_t wait;
+
+  (void)syncro;
+
+  /* Only send once there is something new */
+
+  snapshot_wait(radio_version);
+  radio_version = snapshot_packet(&local_packet, &radio_hdr);
+
+  while ((wait = radiosched_wait(local_packet.len)) > 0)
+    {
+      radio_sleep(wait);
+      radio_version = snapshot_packet(&local_packet, &radio_hdr);
+    }
+
+  radio_hdr.num++;
+  return 0;
+}
+#else
+static int radio_next(syncro_t *syncro)
+{
+  int err;
+  uint32_t wait;
+  uint32_t skipped;
+
+  /* Wait for packet. It is copied into the local buffer to prevent hold
+   * up from transmit time.
+   */
+
+  err = syncro_consume(syncro, SYNCRO_RADIO, &local_packet);
+  if (err)
+    {
+      return err;
+    }
+
+  /* Packets the radio was too slow to send are expected, but note it */
+
+  if (syncro_drops(syncro, SYNCRO_RADIO) != radio_drops)
+    {
+      radio_drops = syncro_drops(syncro, SYNCRO_RADIO);
+      pydebug("Radio thread has skipped %lu packets.\n",
+              (unsigned long)radio_drops);
+    }
+
+  while ((wait = radiosched_wait(local_packet.len)) > 0)
+    {
+      radio_sleep(wait);
+
+      skipped = syncro_skip(syncro, SYNCRO_RADIO);
+      if (syncro_consume_until(syncro, SYNCRO_RADIO, &local_packet,
+                               &radio_now) == 0)
+        {
+          radiosched_replaced(skipped + 1);
+        }
+    }
+
+  return 0;
+}
+#endif
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -77,13 +319,11 @@ static void close_fd(void *arg) { close(*(int *)(arg)); }
 
 void *radio_thread(void *arg)
 {
-  syncro_t *syncro = args_syncro(arg);
+  syncro_t *syncro = args_radio(arg);
   struct radio_config_s config = args_config(arg)->radio;
 
   int radio;
   int err;
-  ssize_t b_sent;
-  pkt = NULL;
 
   pyinfo("Radio thread started.\n");
 
@@ -99,6 +339,12 @@ void *radio_thread(void *arg)
 
   pthread_cleanup_push(close_fd, &radio);
 
+#ifdef CONFIG_PYGMY_RADIO_PROFILES
+  /* The radio starts on the pad profile, which the ground station expects */
+
+  radioprofile_init(&config);
+#endif
+
   /* Configure radio parameters. This configuration is only performed if the
    * radio transceiver driver is enabled, because this enables mocking using
    * another character driver like a file in place of the radio during tests.
@@ -144,51 +390,54 @@ void *radio_thread(void *arg)
   pyinfo("Radio configured.\n");
 #endif
 
-  /* Infinitely read sensors and send packets out */
+  /* Pace transmissions to the airtime the link settings allow */
 
-  for (;;)
-    {
+  radiosched_init(&config);
+  pyinfo("Radio airtime of a full packet is %lu ms.\n",
+         (unsigned long)(radiosched_airtime(&config,
+                                            CONFIG_PYGMY_PACKET_MAXLEN) /
+                         1000));
 
-      /* Wait for packet */
+#ifdef CONFIG_PYGMY_RADIO_LATEST
+  packet_header_init(&radio_hdr, config.callsign, 0);
+#endif
 
-      err = syncro_get_untransmitted(syncro, &pkt);
-      if (err)
-        {
-          pyerr("Error getting packet: %d\n", err);
-        }
+#ifdef CONFIG_PYGMY_RADIO_FEC
+  fec_enc_init(&fec, fec_groups, CONFIG_PYGMY_RADIO_FEC_DEPTH,
+               CONFIG_PYGMY_RADIO_FEC_GROUP);
+  pyinfo("Radio parity sent every %d packets, %d groups interleaved.\n",
+         CONFIG_PYGMY_RADIO_FEC_GROUP, CONFIG_PYGMY_RADIO_FEC_DEPTH);
+#endif
 
-      /* If packet is NULL, release it and try again */
+  /* Infinitely send the freshest data out */
 
-      if (pkt == NULL)
+  for (;;)
+    {
+      err = radio_next(syncro);
+      if (err)
         {
-          pywarn("Shared packet is NULL\n");
-          syncro_mark_transmitted(syncro);
+          pyerr("Error getting packet: %d\n", err);
           continue;
         }
 
-      /* Copy packet into local buffer to prevent hold up from transmit time
-       */
-
-      // TODO: it seems packets here are much shorter than when they are
-      // published
-      memcpy(local_packet.contents, pkt->contents, pkt->len);
-      local_packet.len = pkt->len;
-
-      /* Mark transmitted once copied so we can relinquish mutex */
-
-      syncro_mark_transmitted(syncro);
-
-      /* Send packet over radio */
+#ifdef CONFIG_PYGMY_RADIO_PROFILES
+      radioprofile_notice(&local_packet);
+#endif
 
-      b_sent = write(radio, local_packet.contents, local_packet.len);
-      if (b_sent < 0)
+#ifdef CONFIG_PYGMY_RADIO_FEC
+      err = radio_parity(radio, &local_packet);
+      if (err)
         {
-          pyerr("Packet failed to send: %d\n", errno);
-          continue; /* Try a new packet */
+          pywarn("Packet too long for parity, sent unprotected: %zu\n",
+                 local_packet.len);
         }
+#else
+      radio_send(radio, &local_packet);
+#endif
 
-      pydebug("Transmitted %d.\n",
-              ((struct packet_hdr_s *)(local_packet.contents))->num);
+#ifdef CONFIG_PYGMY_RADIO_PROFILES
+      radio_profile(radio, &config);
+#endif
     }
 
   pthread_cleanup_pop(1); /* Close radio */
@@ -0,0 +1,178 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "radioprofile.h"
+#include "syslogging.h"
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Spread factor of each radio profile. There is one profile per flight
+ * phase, and like the phases they only ever step forward, so the ground
+ * station can follow the same schedule.
+ */
+
+static const uint8_t spreads[] = {
+    [PHASE_PAD] = CONFIG_PYGMY_RADIO_PAD_SPREAD,
+    [PHASE_ASCENT] = CONFIG_PYGMY_RADIO_ASCENT_SPREAD,
+    [PHASE_DESCENT] = CONFIG_PYGMY_RADIO_DESCENT_SPREAD,
+    [PHASE_LANDED] = CONFIG_PYGMY_RADIO_LANDED_SPREAD,
+};
+
+static atomic_int current; /* Profile in use, read from any thread */
+
+/* Announced change, only touched by the radio thread */
+
+static enum flight_phase_e pending; /* Profile being switched to */
+static uint8_t countdown;           /* Notices left to send */
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: radioprofile_init
+ *
+ * Description:
+ *   Starts the radio on the pad profile, whatever the stored spread factor.
+ *
+ * Arguments:
+ *   config - The radio settings to apply the profile to
+ *
+ ****************************************************************************/
+
+void radioprofile_init(struct radio_config_s *config)
+{
+  atomic_store(&current, PHASE_PAD);
+  pending = PHASE_PAD;
+  countdown = 0;
+  config->spread = spreads[PHASE_PAD];
+}
+
+/****************************************************************************
+ * Name: radioprofile_spread
+ *
+ * Description:
+ *   Gets the spread factor of a radio profile.
+ *
+ ****************************************************************************/
+
+uint8_t radioprofile_spread(enum flight_phase_e profile)
+{
+  return spreads[profile];
+}
+
+/****************************************************************************
+ * Name: radioprofile_imu
+ *
+ * Description:
+ *   Checks if radio packets sent with the profile in use have room for IMU
+ *   blocks. Slow, long range profiles only carry the other blocks. Safe to
+ *   call from any thread.
+ *
+ ****************************************************************************/
+
+bool radioprofile_imu(void)
+{
+#ifdef CONFIG_PYGMY_RADIO_PROFILES
+  return spreads[atomic_load(&current)] <= CONFIG_PYGMY_RADIO_IMU_SPREAD;
+#else
+  return true;
+#endif
+}
+
+/****************************************************************************
+ * Name: radioprofile_notice
+ *
+ * Description:
+ *   Follows the flight phase, adding a notice to a radio packet about to be
+ *   sent while a profile change is coming up. The change is announced in
+ *   CONFIG_PYGMY_RADIO_PROFILE_NOTICE packets, each counting down to the
+ *   switch, so the ground station knows which packet is the last one with
+ *   the old settings even if it misses some of them. Profiles are stepped
+ *   through one at a time, each with its own notices, and profiles with the
+ *   same spread factor are stepped past without notice.
+ *
+ * Arguments:
+ *   pkt - The radio packet about to be sent
+ *
+ ****************************************************************************/
+
+void radioprofile_notice(struct packet_s *pkt)
+{
+  struct packet_hdr_s *hdr = (struct packet_hdr_s *)pkt->contents;
+  enum flight_phase_e target = phase_get();
+  enum flight_phase_e profile = atomic_load(&current);
+  profile_p blk;
+
+  if (pending == profile)
+    {
+      /* Step one profile at a time, even if the phase moved on further, so
+       * a ground station that missed every notice can step along too
+       */
+
+      while (profile < target && spreads[profile + 1] == spreads[profile])
+        {
+          profile++;
+        }
+
+      atomic_store(&current, profile);
+      pending = profile;
+      if (profile == target)
+        {
+          return;
+        }
+
+      pending = profile + 1;
+      countdown = CONFIG_PYGMY_RADIO_PROFILE_NOTICE;
+    }
+
+  if (countdown == 0)
+    {
+      return;
+    }
+
+  blk.profile = pending;
+  blk.spread = spreads[pending];
+  blk.countdown = countdown;
+
+  if (packet_push_block(pkt, PACKET_PROFILE, hdr->time, &blk,
+                        sizeof(blk)) == 0)
+    {
+      countdown--;
+    }
+}
+
+/****************************************************************************
+ * Name: radioprofile_switch
+ *
+ * Description:
+ *   Switches to the announced profile once the last notice is sent.
+ *
+ * Arguments:
+ *   config - The radio settings to apply the profile to
+ *
+ * Returns:
+ *   True if the settings changed and must be applied to the radio.
+ *
+ ****************************************************************************/
+
+bool radioprofile_switch(struct radio_config_s *config)
+{
+  if ((int)pending == atomic_load(&current) || countdown > 0)
+    {
+      return false;
+    }
+
+  atomic_store(&current, pending);
+  config->spread = spreads[pending];
+  pyinfo("Radio profile %s, spread factor sf%u\n", phase_name(pending),
+         config->spread);
+  return true;
+}
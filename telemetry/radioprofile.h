@@ -0,0 +1,67 @@
+#ifndef _PYGMY_RADIOPROFILE_H_
+#define _PYGMY_RADIOPROFILE_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../common/configuration.h"
+#include "../packets/packets.h"
+#include "phase.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Spread factor of the radio profile of each flight phase */
+
+#ifndef CONFIG_PYGMY_RADIO_PAD_SPREAD
+#define CONFIG_PYGMY_RADIO_PAD_SPREAD 7
+#endif
+
+#ifndef CONFIG_PYGMY_RADIO_ASCENT_SPREAD
+#define CONFIG_PYGMY_RADIO_ASCENT_SPREAD 9
+#endif
+
+#ifndef CONFIG_PYGMY_RADIO_DESCENT_SPREAD
+#define CONFIG_PYGMY_RADIO_DESCENT_SPREAD 10
+#endif
+
+#ifndef CONFIG_PYGMY_RADIO_LANDED_SPREAD
+#define CONFIG_PYGMY_RADIO_LANDED_SPREAD 12
+#endif
+
+/* Highest spread factor radio packets still carry IMU blocks at */
+
+#ifndef CONFIG_PYGMY_RADIO_IMU_SPREAD
+#define CONFIG_PYGMY_RADIO_IMU_SPREAD 9
+#endif
+
+/* Radio packets announcing a profile change before it happens */
+
+#ifndef CONFIG_PYGMY_RADIO_PROFILE_NOTICE
+#define CONFIG_PYGMY_RADIO_PROFILE_NOTICE 3
+#endif
+
+/* Space a profile notice takes in a radio packet */
+
+#ifdef CONFIG_PYGMY_RADIO_PROFILES
+#define RADIOPROFILE_RESERVE (sizeof(struct block_hdr_s) + sizeof(profile_p))
+#else
+#define RADIOPROFILE_RESERVE 0
+#endif
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void radioprofile_init(struct radio_config_s *config);
+uint8_t radioprofile_spread(enum flight_phase_e profile);
+bool radioprofile_imu(void);
+void radioprofile_notice(struct packet_s *pkt);
+bool radioprofile_switch(struct radio_config_s *config);
+
+#endif // _PYGMY_RADIOPROFILE_H_
@@ -0,0 +1,289 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "radiosched.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* LoRa coding rate as the `n` of 4/(4 + n). The RN2903 defaults to 4/5. */
+
+#define LORA_CR 1
+
+/* LoRa symbols added to the programmed preamble, in quarter symbols */
+
+#define LORA_PREAMBLE_EXTRA_Q 17
+
+/* Symbols in the LoRa header at the lowest coding rate */
+
+#define LORA_HEADER_SYMS 8
+
+/* FSK bit rate (RN2903 default) and framing bytes: sync word, length and
+ * CRC
+ */
+
+#define FSK_BITRATE 50000
+#define FSK_OVERHEAD 6
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Token bucket of airtime, only touched by the radio thread. Credit
+ * accrues at the duty cycle in real time, up to the airtime of one maximum
+ * length packet.
+ */
+
+static struct radio_config_s sched_config; /* Link being scheduled */
+static uint32_t credit_us;                 /* Airtime credit at `credit_at` */
+static struct timespec credit_at;          /* When credit was last updated */
+
+/* Statistics, which other threads may read */
+
+static struct radiosched_stats_s stats;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: credit_update
+ *
+ * Description:
+ *   Adds the airtime credit accrued since the last update.
+ *
+ ****************************************************************************/
+
+static void credit_update(void)
+{
+  struct timespec now;
+  uint64_t elapsed;
+  uint64_t credit;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  elapsed = (uint64_t)(now.tv_sec - credit_at.tv_sec) * 1000000 +
+            (now.tv_nsec - credit_at.tv_nsec) / 1000;
+  credit_at = now;
+
+  credit = credit_us + elapsed * CONFIG_PYGMY_RADIO_DUTY / 100;
+  credit_us = credit > stats.full_us ? stats.full_us : credit;
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: radiosched_airtime
+ *
+ * Description:
+ *   Calculates how long a packet is on air with the given radio settings,
+ *   following the Semtech SX1276 time on air formula for LoRa (explicit
+ *   header, CRC on, coding rate 4/5, low data rate optimization when
+ *   symbols are 16 ms or longer).
+ *
+ * Arguments:
+ *   config - The radio settings
+ *   len - The length of the packet in bytes
+ *
+ * Returns:
+ *   The time on air in microseconds
+ *
+ ****************************************************************************/
+
+uint32_t radiosched_airtime(const struct radio_config_s *config, size_t len)
+{
+  uint32_t sf = config->spread;
+  uint32_t bw_hz = config->bandwidth * 1000;
+  uint32_t de;
+  int32_t bits;
+  uint32_t payload_syms;
+  uint64_t quarters;
+
+  /* FSK sends every preamble and framing byte at the bit rate */
+
+  if (config->mod != 0)
+    {
+      return ((uint64_t)config->prlen + FSK_OVERHEAD + len) * 8 * 1000000 /
+             FSK_BITRATE;
+    }
+
+  if (sf < 6) sf = 6;
+  if (sf > 12) sf = 12;
+  if (bw_hz == 0) bw_hz = 125000;
+
+  /* Long symbols need low data rate optimization: 2^SF / BW >= 16 ms */
+
+  de = ((uint64_t)1000 << sf) >= (uint64_t)16 * bw_hz;
+
+  /* Payload, CRC and header bits, in blocks of 4 * (SF - 2DE) bits each
+   * coded into 4 + CR symbols
+   */
+
+  bits = 8 * (int32_t)len - 4 * (int32_t)sf + 28 + 16;
+  payload_syms = LORA_HEADER_SYMS;
+  if (bits > 0)
+    {
+      payload_syms += (bits + 4 * (sf - 2 * de) - 1) / (4 * (sf - 2 * de)) *
+                      (4 + LORA_CR);
+    }
+
+  /* Count in quarter symbols, since the preamble ends with a quarter */
+
+  quarters = 4 * (uint64_t)config->prlen + LORA_PREAMBLE_EXTRA_Q +
+             4 * (uint64_t)payload_syms;
+  return (quarters * (1000000ull << sf)) / (4 * (uint64_t)bw_hz);
+}
+
+/****************************************************************************
+ * Name: radiosched_init
+ *
+ * Description:
+ *   Resets the transmit schedule and statistics for a radio link. The
+ *   schedule starts with enough credit for one maximum length packet.
+ *
+ * Arguments:
+ *   config - The radio settings of the link
+ *
+ ****************************************************************************/
+
+void radiosched_init(const struct radio_config_s *config)
+{
+  sched_config = *config;
+  clock_gettime(CLOCK_MONOTONIC, &credit_at);
+
+  pthread_mutex_lock(&stats_lock);
+  stats = (struct radiosched_stats_s){0};
+  stats.full_us = radiosched_airtime(config, CONFIG_PYGMY_PACKET_MAXLEN);
+  pthread_mutex_unlock(&stats_lock);
+
+  credit_us = stats.full_us;
+}
+
+/****************************************************************************
+ * Name: radiosched_config
+ *
+ * Description:
+ *   Changes the settings of the radio link being scheduled, keeping the
+ *   airtime credit and statistics.
+ *
+ * Arguments:
+ *   config - The new radio settings
+ *
+ ****************************************************************************/
+
+void radiosched_config(const struct radio_config_s *config)
+{
+  credit_update();
+  sched_config = *config;
+
+  pthread_mutex_lock(&stats_lock);
+  stats.full_us = radiosched_airtime(config, CONFIG_PYGMY_PACKET_MAXLEN);
+  pthread_mutex_unlock(&stats_lock);
+
+  if (credit_us > stats.full_us)
+    {
+      credit_us = stats.full_us;
+    }
+}
+
+/****************************************************************************
+ * Name: radiosched_wait
+ *
+ * Description:
+ *   Gets how long to wait before a packet can be sent without exceeding the
+ *   radio duty cycle.
+ *
+ * Arguments:
+ *   len - The length of the packet in bytes
+ *
+ * Returns:
+ *   The time to wait in microseconds, 0 if the packet can be sent now
+ *
+ ****************************************************************************/
+
+uint32_t radiosched_wait(size_t len)
+{
+  uint32_t airtime = radiosched_airtime(&sched_config, len);
+  uint32_t wait;
+
+  credit_update();
+  if (credit_us >= airtime)
+    {
+      return 0;
+    }
+
+  wait = (uint64_t)(airtime - credit_us) * 100 / CONFIG_PYGMY_RADIO_DUTY + 1;
+
+  pthread_mutex_lock(&stats_lock);
+  stats.waited_us += wait;
+  pthread_mutex_unlock(&stats_lock);
+
+  return wait;
+}
+
+/****************************************************************************
+ * Name: radiosched_sent
+ *
+ * Description:
+ *   Records that a packet is being sent, using up its airtime. Call this
+ *   when the transmission starts, so that credit accrues while the radio
+ *   driver blocks on it.
+ *
+ * Arguments:
+ *   len - The length of the packet in bytes
+ *
+ ****************************************************************************/
+
+void radiosched_sent(size_t len)
+{
+  uint32_t airtime = radiosched_airtime(&sched_config, len);
+
+  credit_update();
+  credit_us = credit_us > airtime ? credit_us - airtime : 0;
+
+  pthread_mutex_lock(&stats_lock);
+  stats.sent++;
+  stats.bytes += len;
+  stats.airtime_us += airtime;
+  pthread_mutex_unlock(&stats_lock);
+}
+
+/****************************************************************************
+ * Name: radiosched_replaced
+ *
+ * Description:
+ *   Records that `n` packets waiting for airtime were replaced by a fresher
+ *   one and will never be sent.
+ *
+ ****************************************************************************/
+
+void radiosched_replaced(uint32_t n)
+{
+  pthread_mutex_lock(&stats_lock);
+  stats.replaced += n;
+  pthread_mutex_unlock(&stats_lock);
+}
+
+/****************************************************************************
+ * Name: radiosched_stats
+ *
+ * Description:
+ *   Gets a consistent copy of the radio link statistics. Safe to call from
+ *   any thread.
+ *
+ ****************************************************************************/
+
+void radiosched_stats(struct radiosched_stats_s *copy)
+{
+  pthread_mutex_lock(&stats_lock);
+  *copy = stats;
+  pthread_mutex_unlock(&stats_lock);
+}
@@ -0,0 +1,51 @@
+#ifndef _PYGMY_RADIOSCHED_H_
+#define _PYGMY_RADIOSCHED_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../common/configuration.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Percentage of the time the radio may spend transmitting */
+
+#ifndef CONFIG_PYGMY_RADIO_DUTY
+#define CONFIG_PYGMY_RADIO_DUTY 100
+#endif
+
+/****************************************************************************
+ * Public Types
+ ****************************************************************************/
+
+/* Radio link statistics */
+
+struct radiosched_stats_s
+{
+  uint32_t sent;        /* Packets transmitted */
+  uint32_t replaced;    /* Packets replaced by fresher ones before sending */
+  uint64_t bytes;       /* Bytes transmitted */
+  uint64_t airtime_us;  /* Time spent on air in total */
+  uint64_t waited_us;   /* Time spent waiting for airtime in total */
+  uint32_t full_us;     /* Airtime of a maximum length packet */
+};
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+uint32_t radiosched_airtime(const struct radio_config_s *config, size_t len);
+void radiosched_init(const struct radio_config_s *config);
+void radiosched_config(const struct radio_config_s *config);
+uint32_t radiosched_wait(size_t len);
+void radiosched_sent(size_t len);
+void radiosched_replaced(uint32_t n);
+void radiosched_stats(struct radiosched_stats_s *stats);
+
+#endif // _PYGMY_RADIOSCHED_H_
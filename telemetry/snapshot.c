@@ -0,0 +1,242 @@
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "../packets/packets.h"
+#include "radioprofile.h"
+#include "snapshot.h"
+
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Array length helper */
+
+#define array_len(arr) sizeof(arr) / sizeof((arr)[0])
+
+/* IMU block kinds, which slow radio profiles leave out */
+
+#define is_imu(kind)                                                         \
+  ((kind) == PACKET_ACCEL || (kind) == PACKET_GYRO || (kind) == PACKET_MAG)
+
+/* Largest single value block (coord_p) */
+
+#define SNAPSHOT_BLOCK_MAXLEN 8
+
+/* Oldest a value may be relative to the newest one and still be sent. Like
+ * the packager's limit on coordinates, this keeps every value sent within
+ * the range of block time offsets from the packet's base time.
+ */
+
+#define SNAPSHOT_MAXAGE (BLOCK_OFFSET_MAX / 2)
+
+/****************************************************************************
+ * Private Types
+ ****************************************************************************/
+
+/* Latest value of one block kind */
+
+struct snapshot_entry_s
+{
+  bool valid;                             /* A value was recorded */
+  pkt_time_t time;                        /* Mission time of the value */
+  uint8_t len;                            /* Length of the block */
+  uint8_t blk[SNAPSHOT_BLOCK_MAXLEN];     /* The block */
+};
+
+/****************************************************************************
+ * Private Data
+ ****************************************************************************/
+
+/* Order blocks are added to a snapshot packet in, most important first */
+
+static const uint8_t snapshot_order[] = {
+    PACKET_COORD, PACKET_ALT,   PACKET_VOLT,  PACKET_ACCEL,
+    PACKET_GYRO,  PACKET_MAG,   PACKET_PRESS, PACKET_TEMP,
+};
+
+/* Latest value of each block kind, written by the packet thread and read
+ * by the radio thread, both under `lock`
+ */
+
+static struct snapshot_entry_s entries[PACKET_VOLT + 1];
+static uint32_t version;  /* Incremented on every update */
+static bool waiting;      /* The radio thread is asleep */
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t is_updated = PTHREAD_COND_INITIALIZER;
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: snapshot_included
+ *
+ * Description:
+ *   Checks if the latest value of a block kind goes into snapshot packets.
+ *   Must be called with `lock` held.
+ *
+ * Arguments:
+ *   kind - The block kind
+ *   imu - The radio profile sends IMU blocks
+ *
+ ****************************************************************************/
+
+static bool snapshot_included(uint8_t kind, bool imu)
+{
+  return entries[kind].valid && (imu || !is_imu(kind));
+}
+
+/****************************************************************************
+ * Public Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: snapshot_update
+ *
+ * Description:
+ *   Records the latest value of a block kind, replacing the previous one.
+ *   Batches can't be recorded; their samples are recorded one at a time.
+ *
+ * Arguments:
+ *   kind - The block kind
+ *   time - The mission time of the value
+ *   blk - The block holding the value
+ *   nbytes - The length of the block
+ *
+ ****************************************************************************/
+
+void snapshot_update(uint8_t kind, pkt_time_t time, const void *blk,
+                     size_t nbytes)
+{
+  struct snapshot_entry_s *entry;
+
+  if (kind >= array_len(entries) || nbytes > SNAPSHOT_BLOCK_MAXLEN)
+    {
+      return;
+    }
+
+  entry = &entries[kind];
+
+  pthread_mutex_lock(&lock);
+  entry->valid = true;
+  entry->time = time;
+  entry->len = nbytes;
+  memcpy(entry->blk, blk, nbytes);
+  version++;
+
+  if (waiting)
+    {
+      pthread_cond_signal(&is_updated);
+    }
+  pthread_mutex_unlock(&lock);
+}
+
+/****************************************************************************
+ * Name: snapshot_wait
+ *
+ * Description:
+ *   Sleeps until the snapshot is newer than `seen`.
+ *
+ *   NOTE: Only one thread may wait.
+ *
+ * Arguments:
+ *   seen - The version of the snapshot already sent
+ *
+ * Returns:
+ *   The current version
+ *
+ ****************************************************************************/
+
+uint32_t snapshot_wait(uint32_t seen)
+{
+  uint32_t current;
+
+  pthread_mutex_lock(&lock);
+  waiting = true;
+  while (version == seen)
+    {
+      pthread_cond_wait(&is_updated, &lock);
+    }
+
+  waiting = false;
+  current = version;
+  pthread_mutex_unlock(&lock);
+
+  return current;
+}
+
+/****************************************************************************
+ * Name: snapshot_packet
+ *
+ * Description:
+ *   Assembles a packet from the latest value of every block kind. Values
+ *   that stopped being updated, such as the coordinates of a lost GPS fix,
+ *   are left out once they are more than `SNAPSHOT_MAXAGE` older than the
+ *   newest value. Otherwise they would set the packet's base time and
+ *   leave fresh values out of range.
+ *
+ * Arguments:
+ *   pkt - The packet to assemble, which is reset first
+ *   hdr - The packet header to start it with
+ *
+ * Returns:
+ *   The version of the snapshot in the packet
+ *
+ ****************************************************************************/
+
+uint32_t snapshot_packet(struct packet_s *pkt,
+                         const struct packet_hdr_s *hdr)
+{
+  uint32_t current;
+  pkt_time_t newest = 0;
+  bool found = false;
+  const struct snapshot_entry_s *entry;
+  bool imu = radioprofile_imu();
+
+  packet_reset(pkt);
+  packet_push(pkt, hdr, sizeof(*hdr));
+
+  pthread_mutex_lock(&lock);
+
+  /* Find the newest value to measure the age of the others against */
+
+  for (size_t i = 0; i < array_len(snapshot_order); i++)
+    {
+      entry = &entries[snapshot_order[i]];
+      if (snapshot_included(snapshot_order[i], imu) &&
+          (!found || (int32_t)(entry->time - newest) > 0))
+        {
+          newest = entry->time;
+          found = true;
+        }
+    }
+
+  for (size_t i = 0; i < array_len(snapshot_order); i++)
+    {
+      entry = &entries[snapshot_order[i]];
+      if (!snapshot_included(snapshot_order[i], imu) ||
+          (int32_t)(newest - entry->time) > SNAPSHOT_MAXAGE)
+        {
+          continue;
+        }
+
+      if (packet_push_block(pkt, snapshot_order[i], entry->time, entry->blk,
+                            entry->len) == ENOMEM)
+        {
+          break;
+        }
+    }
+
+  current = version;
+  pthread_mutex_unlock(&lock);
+
+  return current;
+}
@@ -0,0 +1,23 @@
+#ifndef _PYGMY_SNAPSHOT_H_
+#define _PYGMY_SNAPSHOT_H_
+
+/****************************************************************************
+ * Included Files
+ ****************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../packets/packets.h"
+
+/****************************************************************************
+ * Public Function Prototypes
+ ****************************************************************************/
+
+void snapshot_update(uint8_t kind, pkt_time_t time, const void *blk,
+                     size_t nbytes);
+uint32_t snapshot_wait(uint32_t version);
+uint32_t snapshot_packet(struct packet_s *pkt,
+                         const struct packet_hdr_s *hdr);
+
+#endif // _PYGMY_SNAPSHOT_H_
@@ -2,13 +2,87 @@
  * Included Files
  ****************************************************************************/
 
+#include <errno.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
 #include "../packets/packets.h"
 #include "syncro.h"
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Slot that holds the packet with sequence number `seq` */
+
+#define syncro_slot(syncro, seq)                                             \
+  (&(syncro)->slots[(seq) % CONFIG_PYGMY_SYNCRO_NSLOTS])
+
+/* Slot sequence lock values while packet `seq` is being written, and once it
+ * has been published.
+ */
+
+#define seqlock_writing(seq) (2 * (uint32_t)(seq) + 1)
+#define seqlock_stable(seq) (2 * (uint32_t)(seq) + 2)
+
+/****************************************************************************
+ * Private Functions
+ ****************************************************************************/
+
+/****************************************************************************
+ * Name: syncro_wait
+ *
+ * Description:
+ *   Sleeps until the producer publishes packet `cursor`, or until
+ *   `abstime` (CLOCK_MONOTONIC) passes if it isn't NULL. This is the only
+ *   place consumers use the lock.
+ *
+ * Return: 0 on success, ETIMEDOUT if `abstime` passed, errno error code on
+ * failure (mutex lock or condition wait)
+ *
+ ****************************************************************************/
+
+static int syncro_wait(syncro_t *syncro, uint32_t cursor,
+                       const struct timespec *abstime)
+{
+  int err = 0;
+
+  err = pthread_mutex_lock(&syncro->lock);
+  if (err) return err;
+
+  /* Announce we are sleeping before checking `head` again. Either the
+   * producer sees us and signals after it publishes, or we see the new
+   * packet here and don't sleep at all.
+   */
+
+  atomic_fetch_add(&syncro->sleepers, 1);
+
+  while (atomic_load(&syncro->head) == cursor && err == 0)
+    {
+      if (abstime == NULL)
+        {
+          err = pthread_cond_wait(&syncro->is_new, &syncro->lock);
+        }
+      else
+        {
+          err = pthread_cond_timedwait(&syncro->is_new, &syncro->lock,
+                                       abstime);
+        }
+    }
+
+  atomic_fetch_sub(&syncro->sleepers, 1);
+
+  pthread_mutex_unlock(&syncro->lock);
+
+  /* A packet published as the wait failed is still good to read */
+
+  return atomic_load(&syncro->head) == cursor ? err : 0;
+}
+
 /****************************************************************************
  * Public Functions
  ****************************************************************************/
@@ -29,163 +103,281 @@
 int syncro_init(syncro_t *syncro)
 {
   int err;
+  pthread_condattr_t attr;
 
-  syncro->logged = false;
-  syncro->transmitted = false;
-  syncro->pkt = NULL;
+  atomic_init(&syncro->head, 0);
+  atomic_init(&syncro->sleepers, 0);
+
+  for (int i = 0; i < SYNCRO_NCONSUMERS; i++)
+    {
+      syncro->cursors[i] = 0;
+      atomic_init(&syncro->drops[i], 0);
+    }
+
+  /* No slot holds a published packet yet. Mark them all as being written so
+   * that they can never match a sequence number a consumer expects.
+   */
+
+  for (int i = 0; i < CONFIG_PYGMY_SYNCRO_NSLOTS; i++)
+    {
+      atomic_init(&syncro->slots[i].seq, seqlock_writing(0));
+      packet_init(&syncro->slots[i].pkt, syncro->slots[i].contents);
+    }
 
   err = pthread_mutex_init(&syncro->lock, NULL);
   if (err) return err;
 
-  err = pthread_cond_init(&syncro->is_new, NULL);
+  /* Timed waits use the monotonic clock, like the rest of the telemetry */
+
+  err = pthread_condattr_init(&attr);
+  if (err) return err;
+
+  err = pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  if (err) return err;
+
+  err = pthread_cond_init(&syncro->is_new, &attr);
+  pthread_condattr_destroy(&attr);
   return err;
 }
 
 /****************************************************************************
- * Name: syncro_publish
+ * Name: syncro_claim
  *
  * Description:
- *   Publishes a new packet to subscribing threads.
+ *   Obtains the next free packet in the ring for the producer to construct.
+ *   The packet is reset and remains private to the producer until it is
+ *   published with `syncro_publish`. If a consumer has fallen a full ring
+ *   behind, this slot holds the oldest packet that consumer has not read
+ *   yet; that consumer will count it as dropped instead of blocking the
+ *   producer.
+ *
+ *   NOTE: Only one thread may produce packets.
  *
  * Parameters:
  *   syncro - The monitor object
- *   pkt - The packet to be published
  *
- * Return: 0 on success, errno error code on failure (mutex/cond init)
+ * Return: The packet to construct
  *
  ****************************************************************************/
 
-int syncro_publish(syncro_t *syncro, struct packet_s *pkt)
+struct packet_s *syncro_claim(syncro_t *syncro)
 {
-  int err;
+  uint32_t head = atomic_load_explicit(&syncro->head, memory_order_relaxed);
+  struct syncro_slot_s *slot = syncro_slot(syncro, head);
 
-  /* Exclusive access */
+  /* Mark the slot as being written before touching the packet, so any
+   * consumer still copying the old packet out of it notices the change.
+   */
 
-  err = pthread_mutex_lock(&syncro->lock);
-  if (err) return err;
-
-  syncro->pkt = pkt;           /* Store new packet */
-  syncro->logged = false;      /* New packet not yet logged */
-  syncro->transmitted = false; /* New packet not yet transmitted */
-  pthread_cond_broadcast(&syncro->is_new); /* Signal change to listeners */
+  atomic_store_explicit(&slot->seq, seqlock_writing(head),
+                        memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
 
-  /* Release access */
-
-  pthread_mutex_unlock(&syncro->lock);
-  return err;
+  packet_reset(&slot->pkt);
+  return &slot->pkt;
 }
 
 /****************************************************************************
- * Name: syncro_get_unlogged
+ * Name: syncro_publish
  *
  * Description:
- *   Waits for a packet that hasn't been logged and obtains a pointer to it
+ *   Publishes the packet obtained from `syncro_claim` to subscribing
+ *   threads. This never blocks unless a consumer is asleep waiting for the
+ *   packet, in which case the lock is taken just long enough to wake it.
  *
  * Parameters:
  *   syncro - The monitor object
- *   pkt - Where to store the pointer to the new packet
  *
  * Return: 0 on success, errno error code on failure (mutex lock)
  *
  ****************************************************************************/
 
-int syncro_get_unlogged(syncro_t *syncro, struct packet_s **pkt)
+int syncro_publish(syncro_t *syncro)
 {
   int err;
+  uint32_t head = atomic_load_explicit(&syncro->head, memory_order_relaxed);
 
-  /* Exclusive access */
+  /* Packet contents are complete, then make it visible to consumers */
 
-  err = pthread_mutex_lock(&syncro->lock);
-  if (err) return err;
+  atomic_store_explicit(&syncro_slot(syncro, head)->seq, seqlock_stable(head),
+                        memory_order_release);
+  atomic_store(&syncro->head, head + 1);
 
-  /* Wait for change in packet status */
+  /* Only signal when someone is actually sleeping */
 
-  while (syncro->logged)
+  if (atomic_load(&syncro->sleepers) == 0)
     {
-      pthread_cond_wait(&syncro->is_new, &syncro->lock);
+      return 0;
     }
 
-  /* A new packet that hasn't been logged yet was acquired, return it to the
-   * user under the lock still */
+  err = pthread_mutex_lock(&syncro->lock);
+  if (err) return err;
 
-  *pkt = syncro->pkt;
+  pthread_cond_broadcast(&syncro->is_new); /* Signal change to listeners */
 
+  pthread_mutex_unlock(&syncro->lock);
   return 0;
 }
 
 /****************************************************************************
- * Name: syncro_get_untransmitted
+ * Name: syncro_consume
+ *
+ * Description:
+ *   Waits as long as it takes for a packet that `consumer` hasn't seen yet.
+ *   See `syncro_consume_until`.
+ *
+ ****************************************************************************/
+
+int syncro_consume(syncro_t *syncro, enum syncro_consumer_e consumer,
+                   struct packet_s *pkt)
+{
+  return syncro_consume_until(syncro, consumer, pkt, NULL);
+}
+
+/****************************************************************************
+ * Name: syncro_consume_until
  *
  * Description:
- *   Waits for a packet that hasn't been transmitted and obtains a pointer to
- *it
+ *   Waits for a packet that `consumer` hasn't seen yet and copies it into
+ *   `pkt`. The producer is never stalled by the copy: if it overwrites the
+ *   slot while it is being copied, the copy is discarded and retried. If the
+ *   consumer fell so far behind that its next packet was overwritten, it
+ *   resumes from the oldest packet still in the ring and the skipped packets
+ *   are counted as drops.
+ *
+ *   NOTE: Each consumer may only be used by one thread.
  *
  * Parameters:
  *   syncro - The monitor object
- *   pkt - Where to store the pointer to the new packet
+ *   consumer - The consumer reading the packet
+ *   pkt - Where to copy the packet, with a buffer of at least
+ *         `CONFIG_PYGMY_PACKET_MAXLEN` bytes
+ *   abstime - CLOCK_MONOTONIC time to give up waiting at, or NULL to wait
+ *             forever
  *
- * Return: 0 on success, errno error code on failure (mutex lock)
+ * Return: 0 on success, ETIMEDOUT if no packet arrived before `abstime`,
+ * errno error code on failure (mutex lock)
  *
  ****************************************************************************/
 
-int syncro_get_untransmitted(syncro_t *syncro, struct packet_s **pkt)
+int syncro_consume_until(syncro_t *syncro, enum syncro_consumer_e consumer,
+                         struct packet_s *pkt,
+                         const struct timespec *abstime)
 {
   int err;
+  uint32_t head;
+  uint32_t seq;
+  size_t len;
+  uint32_t *cursor = &syncro->cursors[consumer];
+  struct syncro_slot_s *slot;
 
-  /* Exclusive access */
-
-  err = pthread_mutex_lock(&syncro->lock);
-  if (err) return err;
-
-  /* Wait for change in packet status */
-
-  while (syncro->transmitted)
+  for (;;)
     {
-      pthread_cond_wait(&syncro->is_new, &syncro->lock);
+      /* Wait for a packet this consumer hasn't read */
+
+      head = atomic_load_explicit(&syncro->head, memory_order_acquire);
+      if (*cursor == head)
+        {
+          err = syncro_wait(syncro, *cursor, abstime);
+          if (err) return err;
+          continue;
+        }
+
+      /* The slot at `head` belongs to the producer, so only the newest
+       * `CONFIG_PYGMY_SYNCRO_NSLOTS - 1` packets can be read. Anything older
+       * has been overwritten.
+       */
+
+      if (head - *cursor > CONFIG_PYGMY_SYNCRO_NSLOTS - 1)
+        {
+          atomic_fetch_add(&syncro->drops[consumer],
+                           head - *cursor - (CONFIG_PYGMY_SYNCRO_NSLOTS - 1));
+          *cursor = head - (CONFIG_PYGMY_SYNCRO_NSLOTS - 1);
+        }
+
+      /* Copy the packet out under the slot's sequence lock */
+
+      slot = syncro_slot(syncro, *cursor);
+      seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+      if (seq != seqlock_stable(*cursor))
+        {
+          continue; /* Overwritten since `head` was read */
+        }
+
+      /* The length may be torn if the producer got to the slot, so bound it
+       * before copying.
+       */
+
+      len = slot->pkt.len;
+      if (len > CONFIG_PYGMY_PACKET_MAXLEN)
+        {
+          len = CONFIG_PYGMY_PACKET_MAXLEN;
+        }
+
+      memcpy(pkt->contents, slot->contents, len);
+      pkt->len = len;
+
+      atomic_thread_fence(memory_order_acquire);
+      if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq)
+        {
+          continue; /* Producer wrote over the packet while we copied it */
+        }
+
+      (*cursor)++;
+      return 0;
     }
-
-  /* A new packet that hasn't been logged yet was acquired, return it to the
-   * user under the lock still */
-
-  *pkt = syncro->pkt;
-
-  return 0;
 }
 
 /****************************************************************************
- * Name: syncro_mark_logged
+ * Name: syncro_skip
  *
  * Description:
- *   Mark the currently active packet as logged
+ *   Moves `consumer` ahead to the newest published packet, for consumers
+ *   that only want the freshest data. Skipped packets are not counted as
+ *   drops.
+ *
+ *   NOTE: Each consumer may only be used by one thread.
  *
  * Parameters:
  *   syncro - The monitor object
+ *   consumer - The consumer to move ahead
  *
- * Return: 0 on success, errno error code on failure (mutex unlock)
+ * Return: The number of packets skipped
  *
  ****************************************************************************/
 
-int syncro_mark_logged(syncro_t *syncro)
+uint32_t syncro_skip(syncro_t *syncro, enum syncro_consumer_e consumer)
 {
-  syncro->logged = true;
-  return pthread_mutex_unlock(&syncro->lock);
+  uint32_t head = atomic_load_explicit(&syncro->head, memory_order_acquire);
+  uint32_t *cursor = &syncro->cursors[consumer];
+  uint32_t skipped;
+
+  if (head - *cursor <= 1)
+    {
+      return 0;
+    }
+
+  skipped = head - 1 - *cursor;
+  *cursor = head - 1;
+  return skipped;
 }
 
 /****************************************************************************
- * Name: syncro_mark_transmitted
+ * Name: syncro_drops
  *
  * Description:
- *   Mark the currently active packet as transmitted
+ *   Gets the number of packets `consumer` has lost because the producer
+ *   overwrote them before they were read.
  *
  * Parameters:
  *   syncro - The monitor object
+ *   consumer - The consumer to get the drop count of
  *
- * Return: 0 on success, errno error code on failure (mutex unlock)
+ * Return: The number of dropped packets
  *
  ****************************************************************************/
 
-int syncro_mark_transmitted(syncro_t *syncro)
+uint32_t syncro_drops(syncro_t *syncro, enum syncro_consumer_e consumer)
 {
-  syncro->transmitted = true;
-  return pthread_mutex_unlock(&syncro->lock);
+  return atomic_load(&syncro->drops[consumer]);
 }
@@ -6,23 +6,72 @@
  ****************************************************************************/
 
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
 
 #include "../packets/packets.h"
 
+/****************************************************************************
+ * Pre-processor Definitions
+ ****************************************************************************/
+
+/* Number of packet buffers in the ring shared between threads */
+
+#ifndef CONFIG_PYGMY_SYNCRO_NSLOTS
+#define CONFIG_PYGMY_SYNCRO_NSLOTS 8
+#endif
+
+#if CONFIG_PYGMY_SYNCRO_NSLOTS < 2
+#error "CONFIG_PYGMY_SYNCRO_NSLOTS must be at least 2"
+#endif
+
 /****************************************************************************
  * Public Types
  ****************************************************************************/
 
-/* Synchronization object for packet to be transmitted and logged */
+/* Threads which consume packets from the synchronization object */
+
+enum syncro_consumer_e
+{
+  SYNCRO_LOGGER = 0, /* Logging thread */
+  SYNCRO_RADIO,      /* Radio thread */
+  SYNCRO_NCONSUMERS, /* Number of consumers */
+};
+
+/* A packet buffer in the ring. The sequence number is a per-slot seqlock:
+ * it is odd while the producer writes packet `n` into the slot (2n + 1) and
+ * even once that packet is published (2n + 2).
+ */
+
+struct syncro_slot_s
+{
+  atomic_uint_least32_t seq;                    /* Slot sequence lock */
+  struct packet_s pkt;                          /* Packet in this slot */
+  uint8_t contents[CONFIG_PYGMY_PACKET_MAXLEN]; /* Packet contents */
+};
+
+/* Synchronization object for packets to be transmitted and logged. Packets
+ * are published into a ring of slots by a single producer. Each consumer has
+ * its own read cursor, so a slow consumer only loses the packets it didn't
+ * get to in time instead of holding back the producer or the other
+ * consumers.
+ *
+ * Publishing and reading are lock-free. The mutex and condition variable are
+ * only used by consumers to sleep when they have caught up to the producer;
+ * the producer only touches them when a consumer is asleep.
+ */
 
 typedef struct
 {
-  bool logged;           /* True if this packet has been logged */
-  bool transmitted;      /* True if this packet has been transmitted */
-  struct packet_s *pkt;  /* The packet being shared */
-  pthread_mutex_t lock;  /* Mutex over packet modifications */
-  pthread_cond_t is_new; /* Condition that new packet was added */
+  struct syncro_slot_s slots[CONFIG_PYGMY_SYNCRO_NSLOTS]; /* Packet ring */
+  atomic_uint_least32_t head;                     /* Next sequence number */
+  uint32_t cursors[SYNCRO_NCONSUMERS];            /* Next to read */
+  atomic_uint_least32_t drops[SYNCRO_NCONSUMERS]; /* Packets missed */
+  atomic_uint_least32_t sleepers;                 /* Consumers asleep */
+  pthread_mutex_t lock;                           /* Lock for sleeping */
+  pthread_cond_t is_new;                          /* New packet was added */
 } syncro_t;
 
 /****************************************************************************
@@ -30,10 +79,14 @@ typedef struct
  ****************************************************************************/
 
 int syncro_init(syncro_t *syncro);
-int syncro_publish(syncro_t *syncro, struct packet_s *pkt);
-int syncro_get_unlogged(syncro_t *syncro, struct packet_s **pkt);
-int syncro_get_untransmitted(syncro_t *syncro, struct packet_s **pkt);
-int syncro_mark_logged(syncro_t *syncro);
-int syncro_mark_transmitted(syncro_t *syncro);
+struct packet_s *syncro_claim(syncro_t *syncro);
+int syncro_publish(syncro_t *syncro);
+int syncro_consume(syncro_t *syncro, enum syncro_consumer_e consumer,
+                   struct packet_s *pkt);
+int syncro_consume_until(syncro_t *syncro, enum syncro_consumer_e consumer,
+                         struct packet_s *pkt,
+                         const struct timespec *abstime);
+uint32_t syncro_skip(syncro_t *syncro, enum syncro_consumer_e consumer);
+uint32_t syncro_drops(syncro_t *syncro, enum syncro_consumer_e consumer);
 
 #endif // _PYGMY_SYNCRO_H_
@@ -35,7 +35,9 @@
 #include <sys/boardctl.h>
 
 #include "../common/configuration.h"
+#include "../packets/frame.h"
 #include "arguments.h"
+#include "backlog.h"
 #include "syncro.h"
 #include "syslogging.h"
 
@@ -47,6 +49,10 @@
 #define PYGMY_LOG_THREAD_PRIORITY 130
 #endif
 
+#ifndef PYGMY_LOG_WRITER_THREAD_PRIORITY
+#define PYGMY_LOG_WRITER_THREAD_PRIORITY 110
+#endif
+
 #ifndef PYGMY_RADIO_THREAD_PRIORITY
 #define PYGMY_RADIO_THREAD_PRIORITY 90
 #endif
@@ -65,9 +71,20 @@
 
 static pthread_t radio_pid;
 static pthread_t log_pid;
+static pthread_t log_writer_pid;
 static pthread_t packet_pid;
 static pthread_t configure_pid;
 
+/* Packet rings of the log and radio streams. They hold every slot, far too
+ * large for the main thread's stack. In latest value mode the radio reads
+ * the latest values instead of a ring.
+ */
+
+static syncro_t syncro;
+#ifndef CONFIG_PYGMY_RADIO_LATEST
+static syncro_t radio_syncro;
+#endif
+
 /****************************************************************************
  * Private Functions
  ****************************************************************************/
@@ -144,6 +161,7 @@ static int usb_init(void)
  ****************************************************************************/
 
 void *log_thread(void *arg);
+void *log_writer_thread(void *arg);
 void *radio_thread(void *arg);
 void *packet_thread(void *arg);
 void *configure_thread(void *arg);
@@ -162,9 +180,11 @@ int main(int argc, FAR char *argv[])
   int configfile;
   ssize_t b_read;
   struct configuration_s config;
-  syncro_t syncro;
   const struct thread_args_t args = {
       .syncro = &syncro,
+#ifndef CONFIG_PYGMY_RADIO_LATEST
+      .radio = &radio_syncro,
+#endif
       .config = &config,
   };
 
@@ -219,7 +239,7 @@ int main(int argc, FAR char *argv[])
       pyerr("Failed to set priority of configuration thread: %d\n", err);
     }
 
-  /* Initialize synchronization object */
+  /* Initialize synchronization objects of the log and radio streams */
 
   err = syncro_init(&syncro);
   if (err)
@@ -228,6 +248,28 @@ int main(int argc, FAR char *argv[])
       return EXIT_FAILURE;
     }
 
+#ifndef CONFIG_PYGMY_RADIO_LATEST
+  err = syncro_init(&radio_syncro);
+  if (err)
+    {
+      pyerr("Could not initialize radio synchronization object: %d\n", err);
+      return EXIT_FAILURE;
+    }
+#endif
+
+  /* Build the CRC tables before any thread frames or parses data */
+
+  frame_crc_init();
+
+  /* Initialize the backlog between the logging and log writer threads */
+
+  err = backlog_init();
+  if (err)
+    {
+      pyerr("Could not initialize log backlog: %d\n", err);
+      return EXIT_FAILURE;
+    }
+
   /* Start packet thread */
 
   err = pthread_create(&packet_pid, NULL, packet_thread, (void *)&args);
@@ -256,6 +298,24 @@ int main(int argc, FAR char *argv[])
       pyerr("Failed to set priority of logging thread: %d\n", err);
     }
 
+  /* Start log writer thread. It sits above the packet and radio threads so
+   * the backlog drains as soon as flash allows, but below the logging
+   * thread so copying packets out of the ring is never held up by it.
+   */
+
+  err = pthread_create(&log_writer_pid, NULL, log_writer_thread,
+                       (void *)&args);
+  if (err < 0)
+    {
+      pyerr("Failed to start log writer thread %d\n", err);
+    }
+
+  err = pthread_setschedprio(log_writer_pid, PYGMY_LOG_WRITER_THREAD_PRIORITY);
+  if (err < 0)
+    {
+      pyerr("Failed to set priority of log writer thread: %d\n", err);
+    }
+
   /* Start radio broadcast thread */
 
   err = pthread_create(&radio_pid, NULL, radio_thread, (void *)&args);
@@ -276,6 +336,12 @@ int main(int argc, FAR char *argv[])
       pyerr("Logging thread exited with error: %d\n", err);
     }
 
+  pthread_join(log_writer_pid, (void *)&err);
+  if (err)
+    {
+      pyerr("Log writer thread exited with error: %d\n", err);
+    }
+
   pthread_join(radio_pid, (void *)&err);
   if (err)
     {